@@ -63,12 +63,71 @@
 // NOTE: BENCH_* macros will be empty unless BENCHMARKYES is defined
 // (usually in project settings)
 
-void HpgCreator::computeHpgCurve(const xs::Reach& reach, double flow, double pressurizedHeight, bool reverseSlope, double& yNormal, double& yCritical, hpg::hpgvec& curve)
+// This computes a mild-slope profile of the curve with fixed steps, or
+// adaptive ones if there is a profile tolerance.
+int HpgCreator::computeProfile(const xs::Reach& reach, double flow, double yInit, bool reverseSlope, bool freeOnly, double& yUp, double& volume, double& hf_reach, ProfileWorkspace* workspace) const
+{
+    if (this->profileTolerance > 0.)
+        return ComputeAdaptiveProfile(reach, flow, yInit, this->numSteps, reverseSlope, freeOnly, this->g, this->kn, this->maxDepthFrac, this->profileTolerance, yUp, volume, hf_reach, workspace);
+    else if (freeOnly)
+        return ComputeFreeProfile(reach, flow, yInit, this->numSteps, false, reverseSlope, this->g, this->kn, this->maxDepthFrac, yUp, volume, hf_reach, workspace);
+    else
+        return ComputeCombinedProfile(reach, flow, yInit, this->numSteps, false, reverseSlope, this->g, this->kn, this->maxDepthFrac, yUp, volume, hf_reach, workspace);
+}
+
+
+// This computes the profiles of the curve at several downstream depths
+// together (see ComputeProfiles), or one by one if the steps are adaptive.
+void HpgCreator::computeProfiles(const xs::Reach& reach, double flow, int n, const double* yInit, bool reverseSlope, bool freeOnly, double* yUp, double* volume, double* hf_reach, int* errors, ProfileWorkspace* workspace) const
+{
+    if (this->profileTolerance > 0.)
+    {
+        for (int k = 0; k < n; k++)
+            errors[k] = computeProfile(reach, flow, yInit[k], reverseSlope, freeOnly, yUp[k], volume[k], hf_reach[k], workspace);
+    }
+    else
+    {
+        ComputeProfiles(reach, flow, n, yInit, this->numSteps, reverseSlope, freeOnly, this->g, this->kn, this->maxDepthFrac, yUp, volume, hf_reach, errors, *workspace);
+    }
+}
+
+
+int HpgCreator::computeHpgCurve(const xs::Reach& reach, double flow, double pressurizedHeight, bool reverseSlope, double& yNormal, double& yCritical, hpg::hpgvec& curve, double* fullHf, ProfileWorkspace* workspace) const
 {
     BENCH_INIT;
 
+    // The error code is local so that curves for different flows can be
+    // computed at the same time (see AutoCreateHpg).
+    int errorCode = 0;
+
+    // Every profile of the curve reuses the same arrays, and continues
+    // from the one before it.  The first starts from scratch, so the curve
+    // is the same whatever the workspace computed before.
+    ProfileWorkspace local;
+    if (workspace == NULL)
+        workspace = &local;
+    workspace->setWarmStart(this->warmStart);
+    workspace->clearGuess();
+
     bool computeFreeOnly = pressurizedHeight < 1e-6;
 
+    // The profiles are computed a few downstream depths at a time, as
+    // many as ComputeProfiles takes, and used in order; the ones after the
+    // depth that ends a loop below are dropped.  Adaptive profiles are
+    // computed one at a time, since they don't gain from it.
+    int lanes = this->profileTolerance > 0. ? 1 : PROFILE_LANES;
+    double yInits[PROFILE_LANES], yComps[PROFILE_LANES], volumes[PROFILE_LANES], hfs[PROFILE_LANES];
+    int errors[PROFILE_LANES];
+
+    // Once the pipe is full from end to end, the upstream is the downstream
+    // plus a friction loss that only depends on the flow.  The curve can
+    // then end, and the loss is returned in fullHf instead of computing the
+    // points up to the pressurized height.
+    bool closedForm = this->closedFormFull && !computeFreeOnly && fullHf != NULL;
+    int fullPoints = 0;
+    if (fullHf)
+        *fullHf = -1.0;
+
     //double slope = reach.getSlope();// * (reverseSlope ? -1. : 1.);
     double maxDepth = reach.getMaxDepth();
     double dsInvert = reach.getDsInvert();
@@ -88,8 +147,8 @@ void HpgCreator::computeHpgCurve(const xs::Reach& reach, double flow, double pre
         {
             if (computeFreeOnly)
             {
-                this->errorCode = hpg::error::divergence;
-                return;
+                errorCode = hpg::error::divergence;
+                return errorCode;
             }
         }
         else
@@ -111,8 +170,8 @@ void HpgCreator::computeHpgCurve(const xs::Reach& reach, double flow, double pre
         }
         else
         {
-            //this->errorCode = hpg::error::divergence;
-            //return;
+            //errorCode = hpg::error::divergence;
+            //return errorCode;
         }
     }
         
@@ -141,36 +200,57 @@ void HpgCreator::computeHpgCurve(const xs::Reach& reach, double flow, double pre
             double yDlast = yNormal;
             // We iterate until we've reached or exceeded the maximum depth.
             int count = 0;
-            this->errorCode = 0;
-            while (std::abs(yComp - yNormal) <= dy)
+            errorCode = 0;
+            bool searching = true;
+            while (searching)
             {
-                yDlast = yInit;
-                // Go to the next depth.
-                yInit = yInit + dy;
+                // The next depths.
+                for (int k = 0; k < lanes; k++)
+                    yInits[k] = (k == 0 ? yInit : yInits[k - 1]) + dy;
 
-                this->errorCode = ComputeCombinedProfile(reach, flow, yInit, this->numSteps, false, reverseSlope, this->g, this->kn, this->maxDepthFrac, yComp, volume, hf_reach);
+                computeProfiles(reach, flow, lanes, yInits, reverseSlope, false, yComps, volumes, hfs, errors, workspace);
 
-                // If the solution went imaginary, did not converge, or reached
-                // the maximum pipe depth and not enough points were found, then
-                // terminate early.  If there was another error (at_min_depth)
-                // then continue to the next higher depth.
-                if (this->errorCode)
+                for (int k = 0; k < lanes; k++)
                 {
-                    if (this->errorCode == hpg::error::imaginary)
-                        break;
-                    else if (this->errorCode == hpg::error::divergence)
-                        break;
-                    else if (this->errorCode == hpg::error::at_max_depth && count < this->minCurvePoints)
+                    yDlast = yInit;
+                    yInit = yInits[k];
+                    errorCode = errors[k];
+                    if (!errorCode)
+                        yComp = yComps[k];
+                    volume = volumes[k];
+                    hf_reach = hfs[k];
+
+                    // If the solution went imaginary, did not converge, or reached
+                    // the maximum pipe depth and not enough points were found, then
+                    // terminate early.  If there was another error (at_min_depth)
+                    // then continue to the next higher depth.
+                    if (errorCode)
+                    {
+                        if (errorCode == hpg::error::imaginary)
+                            searching = false;
+                        else if (errorCode == hpg::error::divergence)
+                            searching = false;
+                        else if (errorCode == hpg::error::at_max_depth && count < this->minCurvePoints)
+                            searching = false;
+                    }
+                    if (searching && std::abs(yComp - yNormal) > dy)
+                        searching = false;
+
+                    // The curve continues from this profile.
+                    if (!searching)
+                    {
+                        workspace->continueFrom(k);
                         break;
+                    }
                 }
             }
 
-            if (this->errorCode == 0)
+            if (errorCode == 0)
             {
                 yMin = yInit;
                 yDthatMakesSteepYNormal = yDlast;
                 //yDthatMakesSteepYNormal = (yInit - yNormal) / 2.0;
-                //this->errorCode = ComputeCombinedProfile(reach, flow, yDthatMakesSteepYNormal, this->numSteps, false, reverseSlope, this->g, this->kn, this->maxDepthFrac, yComp, volume, hf_reach);
+                //errorCode = ComputeCombinedProfile(reach, flow, yDthatMakesSteepYNormal, this->numSteps, false, reverseSlope, this->g, this->kn, this->maxDepthFrac, yComp, volume, hf_reach);
             }
         }
         else
@@ -239,51 +319,76 @@ void HpgCreator::computeHpgCurve(const xs::Reach& reach, double flow, double pre
 
     // We iterate until we've reached or exceeded the maximum depth.
     int count = 0;
-    for (auto yInit : yDownElevations)
+    bool ended = false;
+    for (size_t first = 0; first < yDownElevations.size() && !ended; first += lanes)
     {
-        this->errorCode = 0;
-
-        // Now compute the point (downstream -> upstream if mild or
+        // Now compute the points (downstream -> upstream if mild or
         // adverse, upstream -> downstream if steep).
-        if (computeFreeOnly)
-        {
-            this->errorCode = ComputeFreeProfile(reach, flow, yInit, this->numSteps, false, reverseSlope, this->g, this->kn, this->maxDepthFrac, yComp, volume, hf_reach);
-        }
-        else
-        {
-            this->errorCode = ComputeCombinedProfile(reach, flow, yInit, this->numSteps, false, reverseSlope, this->g, this->kn, this->maxDepthFrac, yComp, volume, hf_reach);
-        }
+        int n = (int)std::min((size_t)lanes, yDownElevations.size() - first);
+        computeProfiles(reach, flow, n, &yDownElevations[first], reverseSlope, computeFreeOnly, yComps, volumes, hfs, errors, workspace);
 
-        // If the solution went imaginary, did not converge, or reached
-        // the maximum pipe depth and not enough points were found, then
-        // terminate early.  If there was another error (at_min_depth)
-        // then continue to the next higher depth.
-        if (this->errorCode)
+        for (int k = 0; k < n; k++)
         {
-            if (this->errorCode == hpg::error::imaginary)
-                break;
-            else if (this->errorCode == hpg::error::divergence)
-                break;
-            else if (this->errorCode == hpg::error::at_max_depth && count < this->minCurvePoints)
-                break;
-        }
-
-        // If there was no error, then add the point to the curve.
-        if (! this->errorCode)
-        {
-            if (reverseSlope)
+            double yInit = yDownElevations[first + k];
+            errorCode = errors[k];
+            if (!errorCode)
+                yComp = yComps[k];
+            volume = volumes[k];
+            hf_reach = hfs[k];
+
+            // If the solution went imaginary, did not converge, or reached
+            // the maximum pipe depth and not enough points were found, then
+            // terminate early.  If there was another error (at_min_depth)
+            // then continue to the next higher depth.
+            if (errorCode)
             {
-				curve.push_back(hpg::point(yInit + usInvert, yComp + dsInvert, volume, hf_reach));
+                if (errorCode == hpg::error::imaginary)
+                    ended = true;
+                else if (errorCode == hpg::error::divergence)
+                    ended = true;
+                else if (errorCode == hpg::error::at_max_depth && count < this->minCurvePoints)
+                    ended = true;
+                if (ended)
+                    break;
             }
 
-            else
+            // If there was no error, then add the point to the curve.
+            if (! errorCode)
             {
-                curve.push_back(hpg::point(yInit + dsInvert, yComp + usInvert, volume, hf_reach));
-            }
+                if (reverseSlope)
+                {
+					curve.push_back(hpg::point(yInit + usInvert, yComp + dsInvert, volume, hf_reach));
+                }
 
-            count++;
+                else
+                {
+                    curve.push_back(hpg::point(yInit + dsInvert, yComp + usInvert, volume, hf_reach));
+                }
+
+                count++;
+
+                // Two full points in a row, so that the last segment of the
+                // splines is full as well, and enough points for a valid curve.
+                const hpg::point& p = curve.back();
+                if (closedForm && yInit >= maxDepth && yComp >= maxDepth &&
+                    std::abs(p.y - p.x - hf_reach) < 1e-6 * (1.0 + hf_reach))
+                {
+                    if (++fullPoints >= 2 && (int)curve.size() > this->minCurvePoints)
+                    {
+                        *fullHf = hf_reach;
+                        ended = true;
+                        break;
+                    }
+                }
+                else
+                {
+                    fullPoints = 0;
+                }
+            }
         }
     }
+
+    return errorCode;
 }
 
 
@@ -295,22 +400,20 @@ void HpgCreator::computeHpgCurve(const xs::Reach& reach, double flow, double pre
 // This is a wrapper around computeHpgCurve.  It returns true if a valid
 // HPC was computed and false otherwise.  If false, then it also clears
 // the curve variable so that no possibly bad values are stored.
-bool HpgCreator::computeValidHpgCurve(const xs::Reach& reach, double flow, double pressurizedHeight, bool reverseSlope, double& yNormal, double& yCritical, hpg::hpgvec &curve)
+bool HpgCreator::computeValidHpgCurve(const xs::Reach& reach, double flow, double pressurizedHeight, bool reverseSlope, double& yNormal, double& yCritical, hpg::hpgvec &curve, double* fullHf, ProfileWorkspace* workspace) const
 {
-    this->errorCode = 0;
     using namespace std;
 
-    computeHpgCurve(reach, flow, pressurizedHeight, reverseSlope, yNormal, yCritical, curve);
+    int errorCode = computeHpgCurve(reach, flow, pressurizedHeight, reverseSlope, yNormal, yCritical, curve, fullHf, workspace);
 
     // We want to clear the error code if there was any, but we got valid points.
-    if ((!this->errorCode ||
-         this->errorCode == hpg::error::divergence ||
-         this->errorCode == hpg::error::at_max_depth ||
-         this->errorCode == hpg::error::imaginary ||
-         this->errorCode == hpg::error::at_min_depth) &&
+    if ((!errorCode ||
+         errorCode == hpg::error::divergence ||
+         errorCode == hpg::error::at_max_depth ||
+         errorCode == hpg::error::imaginary ||
+         errorCode == hpg::error::at_min_depth) &&
          curve.size() > this->minCurvePoints)
     {
-        this->errorCode = 0;
         return true;
     }
     else
@@ -66,26 +66,35 @@ struct solver_params
 {
     double L, N, S, Q, kn, g, dx;
     int count;
-    std::shared_ptr<xs::CrossSection> xs;
+    xs::CrossSection* xs; // not a shared_ptr, so that a profile doesn't touch its reference count
     double first_area;
     int isSteep;
     bool isFull;
     bool isEmpty;
     int maxIter, curIter;
+    int errorCode; // set by compute_variables; kept per call so profiles can run concurrently
+    ProfileStats* stats; // counts the Newton iterations, or NULL
 };
 
 
 struct profile_params
 {
     double Y, Z, Sf, A, P, T, V, PoG;
+    double dPdy; // for profile_func_deriv, which is always evaluated at the depth of the last profile_func
 };
 
-int profile_error_code;
 #define ERR_ZERO_AREA 399
 
+struct profile_state;
+
 inline double profile_func(double y, solver_params& params, profile_params& x1, profile_params& x2);
+inline double profile_residual(solver_params& params, profile_params& x1, profile_params& x2);
 inline double profile_func_deriv(double y, solver_params& params, profile_params& x1, profile_params& x2);
 inline void compute_variables(double y, solver_params& params, profile_params& x);
+inline void compute_variables(int count, const double* y, solver_params* const* params, profile_params* const* x);
+inline double first_guess(double y1, double y_n, double maxDepth, const double* G, int i);
+inline bool solve_step(solver_params& params, profile_params& x1, profile_params& x2, double maxDepth, double& y2k, double& y2);
+inline void solve_steps(int count, const int* lanes, profile_state* s, bool* converged);
 
 
 void writeArray(FILE* fh, std::unique_ptr<double[]> a, int aSize)
@@ -101,16 +110,44 @@ void writeArray(FILE* fh, std::unique_ptr<double[]> a, int aSize)
 //      JM Mier, October 2010, UIUC
 //      Based on previous version by JM Mier, November 2007, UIUC
 //      JM Mier, UIUC, September 2013 - Modified to include English units
-int ComputeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, bool freeOnly, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach);
+int ComputeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, bool freeOnly, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach, ProfileWorkspace& workspace);
+
+int ComputeFreeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach, ProfileWorkspace* workspace)
+{
+    ProfileWorkspace local;
+    return ComputeProfile(reach, flow, yInit, nC, isSteep, reverseSlope, true, g, kn, maxDepthFrac, yUp, volume, hf_reach, workspace ? *workspace : local);
+}
 
-int ComputeFreeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach)
+int ComputeCombinedProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach, ProfileWorkspace* workspace)
 {
-    return ComputeProfile(reach, flow, yInit, nC, isSteep, reverseSlope, true, g, kn, maxDepthFrac, yUp, volume, hf_reach);
+    ProfileWorkspace local;
+    return ComputeProfile(reach, flow, yInit, nC, isSteep, reverseSlope, false, g, kn, maxDepthFrac, yUp, volume, hf_reach, workspace ? *workspace : local);
 }
 
-int ComputeCombinedProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach)
+
+void ProfileWorkspace::reset(int nC, int count)
 {
-    return ComputeProfile(reach, flow, yInit, nC, isSteep, reverseSlope, false, g, kn, maxDepthFrac, yUp, volume, hf_reach);
+    // The depths of the last profile are the guess of this one, as long as
+    // the arrays are laid out the same.
+    guess = warmStart && last && sections == nC + 1;
+    last = true;
+    int from = lastLane;
+    lastLane = count - 1;
+
+    // The arrays are laid out one after the other, nC + 1 values each,
+    // and the lanes one after the other.
+    sections = nC + 1;
+    size_t size = (size_t)sections * ArrayCount * count;
+    if (values.size() < size)
+        values.resize(size);
+    if (flags.size() < (size_t)sections * 2 * count)
+        flags.resize((size_t)sections * 2 * count);
+
+    if (guess)
+        std::copy(get(Y, from), get(Y, from) + sections, get(Guess));
+    for (int lane = 0; lane < count; lane++)
+        std::fill(get(X, lane), get(X, lane) + (size_t)sections * Guess, 0.);
+    std::fill(flags.begin(), flags.begin() + sections * 2 * count, 0);
 }
 
 
@@ -152,18 +189,42 @@ perhaps you can find some more information there.
 */
 
 
-int ComputeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, bool freeOnly, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach)
+// A profile being computed by compute_profiles, in one of its lanes, and
+// the section it is at.
+struct profile_state
 {
-    // Initialization
-	hf_reach = 0;
-    volume = 0;
-    profile_error_code = 0;
+    int i;
+    bool done;
+    const xs::Reach* reach;
+    solver_params params;
+    profile_params x1, x2;
+    int nC;
+    double slope, maxDepth, yInit, y_c, y_n;
+    double volumeArea, lastArea, curX, hf_reach;
+    double y2, y2k;
+    bool isFull, isEmpty, isSuper, passedThroughJump;
+    double *X, *Y, *Z, *V, *Sf, *PoG, *H;
+    unsigned char *e2, *p2;
+    const double* G;
+};
+
 
+// This computes the downstream end of a profile in the lane of the
+// workspace.  Returns at_max_depth if the profile ends there.
+int start_profile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, bool freeOnly, double g, double kn, double maxDepthFrac, ProfileWorkspace& workspace, int lane, profile_state& s)
+{
     // Shortcuts for reach properties.
     double slope = reach.getSlope() * (reverseSlope ? -1. : 1.);
     double length = reach.getLength();
     double maxDepth = reach.getMaxDepth() * maxDepthFrac;
 
+    s.reach = &reach;
+    s.nC = nC;
+    s.slope = slope;
+    s.maxDepth = maxDepth;
+    s.yInit = yInit;
+    s.hf_reach = 0;
+
     //// If the flow is zero, assume a level-pool upstream elevation.
     //if (isZero(flow))
     //{
@@ -171,10 +232,12 @@ int ComputeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bo
     //}
 
 
-    solver_params params;
-    params.xs = reach.getXs();
+    solver_params& params = s.params;
+    params.xs = reach.getXs().get();
     params.curIter = 0;
     params.maxIter = 50;
+    params.errorCode = 0;
+    params.stats = &workspace.stats;
     params.L = length;
     params.N = reach.getRoughness();
     params.S = slope;
@@ -187,62 +250,47 @@ int ComputeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bo
     if (isSteep)
         params.dx = -params.dx; // make the x-increment negative if it's steep so we can use the same code for computing steep/mild
 
-    profile_params x1;
-    double volumeArea = 0.0, lastArea = 0.0;
-    double curX = 0.0;
+    profile_params& x1 = s.x1;
+    s.volumeArea = 0.0;
+    s.lastArea = 0.0;
+    s.curX = 0.0;
     x1.Z = 0.0;
     if (isSteep)
-        curX = length; // start in the x-direction from the top of the reach if the reach is steep
+        s.curX = length; // start in the x-direction from the top of the reach if the reach is steep
     if (isSteep || slope < 0.0)
         x1.Z = length*fabs(slope); // start in the z-direction from the top of the reach if the reach is steep or adverse
 
     ///////////////////////////////////////////////////////////////////////////
     // Create profile variables
-    using namespace std;
-    double* X_ = new double[nC + 1];
-    double* Y_ = new double[nC + 1];
-    double* Z_ = new double[nC + 1];
-    double* V_ = new double[nC + 1];
-    double* Sf_ = new double[nC + 1];
-    double* PoG_ = new double[nC + 1];
-    double* H_ = new double[nC + 1];
-    bool* e2_ = new bool[nC + 1];
-    bool* p2_ = new bool[nC + 1];
-
-    std::fill(X_, X_ + nC + 1, 0.);
-    std::fill(Y_, Y_ + nC + 1, 0.);
-    std::fill(Z_, Z_ + nC + 1, 0.);
-    std::fill(V_, V_ + nC + 1, 0.);
-    std::fill(Sf_, Sf_ + nC + 1, 0.);
-    std::fill(PoG_, PoG_ + nC + 1, 0.);
-    std::fill(H_, H_ + nC + 1, 0.);
-    std::fill(e2_, e2_ + nC + 1, false);
-    std::fill(p2_, p2_ + nC + 1, false);
-
-    unique_ptr<double[]> X(X_);
-    unique_ptr<double[]> Y(Y_);
-    unique_ptr<double[]> Z(Z_);
-    unique_ptr<double[]> V(V_);
-    unique_ptr<double[]> Sf(Sf_);
-    unique_ptr<double[]> PoG(PoG_);
-    unique_ptr<double[]> H(H_);
-    unique_ptr<bool[]> e2(e2_);
-    unique_ptr<bool[]> p2(p2_);
+    double* X = s.X = workspace.get(ProfileWorkspace::X, lane);
+    double* Y = s.Y = workspace.get(ProfileWorkspace::Y, lane);
+    double* Z = s.Z = workspace.get(ProfileWorkspace::Z, lane);
+    double* V = s.V = workspace.get(ProfileWorkspace::V, lane);
+    double* Sf = s.Sf = workspace.get(ProfileWorkspace::Sf, lane);
+    double* PoG = s.PoG = workspace.get(ProfileWorkspace::PoG, lane);
+    double* H = s.H = workspace.get(ProfileWorkspace::H, lane);
+    s.e2 = workspace.emptied(lane);
+    s.p2 = workspace.unpressurized(lane);
+    s.G = workspace.getGuess(lane);
+    workspace.stats.profiles++;
 
     ///////////////////////////////////////////////////////////////////////////
     // Perform computations at downstream end of conduit.
     
-    bool isFull = false;
-    bool isEmpty = false;
+    bool& isFull = s.isFull;
+    bool& isEmpty = s.isEmpty;
+    isFull = false;
+    isEmpty = false;
 
-    double y_c;
+    double& y_c = s.y_c;
     bool yCvalid = true;
     if (ComputeCriticalDepth(reach, flow, g, y_c))
     {
         yCvalid = false;
     }
 
-    double y_n = maxDepth;
+    double& y_n = s.y_n;
+    y_n = maxDepth;
     bool yNvalid = true;
     if (reverseSlope || ComputeNormalDepth(reach, flow, g, kn, y_n))
     {
@@ -296,7 +344,7 @@ int ComputeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bo
     }
 
     // If the area is zero, then the reach is empty and we return empty.
-    if (!isEmpty && profile_error_code == ERR_ZERO_AREA)
+    if (!isEmpty && params.errorCode == ERR_ZERO_AREA)
     {
         isEmpty = true;
         compute_variables(Y[0], params, x1);
@@ -310,302 +358,733 @@ int ComputeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bo
 
     // Standard-step method.
     // Sub-index of 2 is the unknown; Sub-index of 1 is the current known.
-    double y2, Sf2, V2;
-    double y2k = Y[0]; // initial guess
-    profile_params x2;
-    int error = 0;
+    s.y2k = Y[0]; // initial guess
 
     if (Y[0] >= 0.98 * maxDepth)
     {
         isFull = true;
     }
 
-    bool isSuper = y_n < y_c;
-    bool passedThroughJump = false;
+    s.isSuper = y_n < y_c;
+    s.passedThroughJump = false;
+    return 0;
+}
+
 
-    int i = 0;
-    for (i = 1; i < nC + 1; i++)
+// This ends a profile whose sections were computed up to i, or which
+// stopped at i with the error.
+int finish_profile(profile_state& s, int i, int error, double& yUp, double& volume)
+{
+    const xs::Reach& reach = *s.reach;
+    solver_params& params = s.params;
+    int nC = s.nC;
+
+    // Compute the volume (the sum of the areas of the cross section
+    // at each step minus the average of the first and last cross
+    // section areas times the x-step).
+    volume = (s.volumeArea - (s.lastArea + params.first_area) / 2.0) * fabs(params.dx);
+
+    // Due to numerical solution, sometimes the volume might be slightly larger than the 
+    // full volume, so we bound it here.
+    double fullVolume = params.xs->computeArea(params.xs->getMaxDepth()) * reach.getLength();
+    if (((s.y2 - s.maxDepth >= -0.1) && (s.yInit - s.maxDepth >= -0.1)) || volume > fullVolume)
+        volume = fullVolume;
+
+#ifdef DEBUG_PROFILE
+    FILE* fh = fopen("profile.txt", "w");
+    for (int i = 0; i < nC+1; i++)
+    {
+        if (i > 0)
+            fprintf(fh, "\t");
+        fprintf(fh, "%f", s.X[i]);
+    }
+    fprintf(fh, "\n");
+    for (int i = 0; i < nC+1; i++)
     {
-        curX += params.dx;
+        if (i > 0)
+            fprintf(fh, "\t");
+        fprintf(fh, "%f", s.Y[i]);
+    }
+    fprintf(fh, "\n");
+    for (int i = 0; i < nC+1; i++)
+    {
+        if (i > 0)
+            fprintf(fh, "\t");
+        fprintf(fh, "%f", s.Z[i]);
+    }
+    fprintf(fh, "\n");
+    fclose(fh);
+#endif
+
+    // If we terminated early, then return an error.
+    if (i < nC)
+    {
+        return 1;
+    }
+
+    // If there was an error, then return it.
+    else if (error != 0)
+    {
+        return 1;
+    }
+
+    // Otherwise we successfully solved for a point.
+    else
+    {
+        yUp = s.y2 + s.PoG[nC];
+        return 0;
+    }
+}
 
-        X[i] = X[i - 1] + params.dx;
-        Z[i] = Z[0] + slope * (X[i] - X[0]);
-        x2.Z = Z[i];
 
-        // If the flow is zero we simply use this to compute the volume
-        if (isZero(flow))
+// This computes the profiles of the lanes of the workspace, n of them,
+// from their downstream ends up.  Each pass takes one section of each
+// lane, the same as the loop below would on its own, but the variables
+// of the sections and the iterations of the Newton solves of all of the
+// lanes are computed together.  A lane only takes a section once the lane
+// before it has taken it, since it continues from its depths there
+// (which leaves each lane a section behind the one before it); a lane
+// whose profile ends, or whose section is done again after the pipe
+// stops being empty or full, just leaves the others to go on.
+void compute_profiles(const xs::Reach& reach, double flow, int n, const double* yInit, int nC, bool isSteep, bool reverseSlope, bool freeOnly, double g, double kn, double maxDepthFrac, double* yUp, double* volume, double* hf_reach, int* errors, ProfileWorkspace& workspace)
+{
+    profile_state s[PROFILE_LANES];
+    for (int k = 0; k < n; k++)
+    {
+        // Initialization
+        hf_reach[k] = 0;
+        volume[k] = 0;
+        s[k].i = 1;
+        s[k].done = false;
+        if (start_profile(reach, flow, yInit[k], nC, isSteep, reverseSlope, freeOnly, g, kn, maxDepthFrac, workspace, k, s[k]))
         {
-            y2 = std::max(0., yInit - curX * slope);
-            compute_variables(y2, params, x2);
-            Y[i] = y2;
-            V[i] = 0;
-            Sf[i] = 0;
-            lastArea = x2.A;
-            volumeArea += x2.A;
-            continue;
+            errors[k] = hpg::error::at_max_depth;
+            s[k].done = true;
         }
+    }
 
-        else if (isEmpty)
+    int lanes[PROFILE_LANES], solving[PROFILE_LANES];
+    double depths[PROFILE_LANES];
+    solver_params* params[PROFILE_LANES];
+    profile_params* x[PROFILE_LANES];
+    bool converged[PROFILE_LANES];
+    for (;;)
+    {
+        int count = 0;
+        for (int k = 0; k < n; k++)
         {
-            compute_variables(0.0001 * maxDepth, params, x2);
-            y2 = 0;
-            Sf2 = slope;
-            V2 = 0;
+            if (!s[k].done && (k == 0 || s[k - 1].done || s[k - 1].i > s[k].i))
+                lanes[count++] = k;
         }
+        if (count == 0)
+            break;
 
-        // If the previous section is pressurized, it stays pressurized upstream.
-        else if (isFull)
+        // The variables that each section starts from.
+        for (int j = 0; j < count; j++)
         {
-            compute_variables(maxDepth, params, x2);
-            y2 = maxDepth;
-            Sf2 = x2.Sf;
-            V2 = x2.V;
-            if (freeOnly)
+            profile_state& p = s[lanes[j]];
+            int i = p.i;
+            p.curX += p.params.dx;
+
+            p.X[i] = p.X[i - 1] + p.params.dx;
+            p.Z[i] = p.Z[0] + p.slope * (p.X[i] - p.X[0]);
+            p.x2.Z = p.Z[i];
+
+            params[j] = &p.params;
+            x[j] = &p.x2;
+
+            // If the flow is zero we simply use this to compute the volume
+            if (isZero(flow))
+                depths[j] = std::max(0., p.yInit - p.curX * p.slope);
+            else if (p.isEmpty)
+                depths[j] = 0.0001 * p.maxDepth;
+            // If the previous section is pressurized, it stays pressurized upstream.
+            else if (p.isFull)
+                depths[j] = p.maxDepth;
+            // Otherwise, the previous section was not pressurized.
+            else
             {
-                return hpg::error::at_max_depth;
+                // Y can't get higher than the max height in conduit
+                // or Y can't get smaller than the min depth in conduit (included to avoid having A2=0 when Y=0, which gives problems later on due to division by 0)
+                depths[j] = std::max(std::min(p.Y[i - 1], 0.9999 * p.maxDepth), 0.0001 * p.maxDepth);
+                x[j] = &p.x1;
             }
         }
+        compute_variables(count, depths, params, x);
 
-        // Otherwise, the previous section was not pressurized.
-        else
+        // The Newton solves of the sections with a free surface.
+        int solves = 0;
+        for (int j = 0; j < count; j++)
         {
-            // Y can't get higher than the max height in conduit
-            // or Y can't get smaller than the min depth in conduit (included to avoid having A2=0 when Y=0, which gives problems later on due to division by 0)
-            y2 = std::max(std::min(Y[i - 1], 0.9999 * maxDepth), 0.0001 * maxDepth);
-            compute_variables(y2, params, x1);
-            x1.Z = x2.Z - slope * params.dx;
-            x1.PoG = PoG[i - 1];
-
-            if (!e2[i] && !p2[i])
-            {
-                y2k = y2 + 0.01 * (y_n - y2);
-            }
-            y2k = std::max(std::min(y2k, 0.9999 * maxDepth), 0.0001 * maxDepth);
+            profile_state& p = s[lanes[j]];
+            int i = p.i;
+            p.y2 = depths[j];
+            if (isZero(flow) || p.isEmpty || p.isFull)
+                continue;
 
-            double fn = 1.0;
-            int iterCount = 0;
+            p.x1.Z = p.x2.Z - p.slope * p.params.dx;
+            p.x1.PoG = p.PoG[i - 1];
 
-            // This is the actual solver for the given upstream point.  We need
-            // to iterate until the solution converges or we've reached the max
-            // number of iterations (divergence).
-            bool converged = false;
-            bool solutionNotChanging = false;
+            if (!p.e2[i] && !p.p2[i])
+                p.y2k = first_guess(p.y2, p.y_n, p.maxDepth, p.G, i);
+            p.y2k = std::max(std::min(p.y2k, 0.9999 * p.maxDepth), 0.0001 * p.maxDepth);
 
             // If we've passed through a hydraulic jump then we don't want to solve anymore, we need
             // to use normal depth.
-            if (isSuper && passedThroughJump)
+            if (!(p.isSuper && p.passedThroughJump))
+                solving[solves++] = lanes[j];
+        }
+        solve_steps(solves, solving, s, converged);
+
+        for (int j = 0; j < count; j++)
+        {
+            int k = lanes[j];
+            profile_state& p = s[k];
+            solver_params& params = p.params;
+            profile_params& x1 = p.x1;
+            profile_params& x2 = p.x2;
+            double maxDepth = p.maxDepth;
+            double& y2 = p.y2;
+            int i = p.i;
+            double* Y = p.Y;
+            double* Z = p.Z;
+            double* V = p.V;
+            double* Sf = p.Sf;
+            double* PoG = p.PoG;
+            double* H = p.H;
+
+            double Sf2, V2;
+            if (isZero(flow))
             {
-                converged = true;
-                y2 = y_n;
+                Y[i] = y2;
+                V[i] = 0;
+                Sf[i] = 0;
+                p.lastArea = x2.A;
+                p.volumeArea += x2.A;
             }
-
-            while (!converged && iterCount < params.maxIter)
+            else
             {
-                // These functions contain the equations and math for the solution.
-                fn = profile_func(y2k, params, x1, x2);
-                double dfn = profile_func_deriv(y2k, params, x1, x2);
+                if (p.isEmpty)
+                {
+                    y2 = 0;
+                    Sf2 = p.slope;
+                    V2 = 0;
+                }
+                else if (p.isFull)
+                {
+                    y2 = maxDepth;
+                    Sf2 = x2.Sf;
+                    V2 = x2.V;
+                    if (freeOnly)
+                    {
+                        hf_reach[k] = p.hf_reach;
+                        errors[k] = hpg::error::at_max_depth;
+                        p.done = true;
+                        continue;
+                    }
+                }
+                else
+                {
+                    bool isConverged = true;
+                    if (p.isSuper && p.passedThroughJump)
+                        y2 = p.y_n;
+                    else
+                        isConverged = converged[k];
 
-                double y2kp1 = y2k - fn/dfn;
+                    if (!isConverged)
+                    {
+                        p.passedThroughJump = p.isSuper && true;
+                        y2 = p.y_n; // **THIS CONDITION WILL HAVE TO CHANGE WHEN THE SUPERCRITICAL LOGIC IS FULLY IMPLEMENTED**
+                        compute_variables(p.y_n, params, x2);
+                        Sf2 = x2.Sf;
+                        V2 = x1.V;
+                    }
 
-                solutionNotChanging = false;
-                if (std::abs(y2kp1 - y2k) / (0.5 * std::abs(y2kp1 + y2k)) < SOL_TOL)
+                    // If the conduit gets empty in this section, relcalculate for empty.
+                    if (y2 <= 0.0001 * maxDepth && !p.e2[i])
+                    {
+                        p.isEmpty = true;
+                        y2 = 0;
+                        Sf2 = p.slope;
+                        V2 = 0;
+                    }
+
+                    // If the flow gets pressurized in this section, recalculate for pressurized conditions.
+                    else if (y2 >= 0.9999 * maxDepth && !p.p2[i])
+                    {
+                        p.isFull = true;
+                        y2 = maxDepth;
+                        compute_variables(maxDepth, params, x2);
+                        Sf2 = x2.Sf;
+                        V2 = x2.V;
+                        if (freeOnly)
+                        {
+                            hf_reach[k] = p.hf_reach;
+                            errors[k] = hpg::error::at_max_depth;
+                            p.done = true;
+                            continue;
+                        }
+                    }
+                    else
+                    {
+                        Sf2 = x2.Sf;
+                        V2 = x2.V;
+                    }
+
+                    if (params.errorCode)
+                    {
+                        hf_reach[k] = p.hf_reach;
+                        errors[k] = finish_profile(p, i, params.errorCode, yUp[k], volume[k]);
+                        p.done = true;
+                        continue;
+                    }
+                }
+
+                // Once Sf1 and Y1 are obtained, compute hydraulic variables for the section
+                Y[i] = y2;
+                V[i] = V2;
+                Sf[i] = Sf2;
+
+                double sfAvg = (Sf[i] + Sf[i - 1]) * 0.5;
+                p.hf_reach += sfAvg * std::abs(params.dx);
+
+                // For PRESSURIZED flow, use the average friction slope to get energy, then derive pressure
+                if (p.isFull)
                 {
-                    converged = true;
-                    y2 = y2kp1;
+                    H[i] = H[i - 1] + sfAvg * std::abs(params.dx);
+                    PoG[i] = H[i] - Z[i] - Y[i] - V[i] * V[i] / (2. * g);
                 }
+                // For NON-PRESSURIZED flow, use the individual elements of the energy equation (PoG = 0), this way the local energy loss (HL) in a hydraulic jump will be properly represented
                 else
                 {
-                    iterCount++;
-                    double y2km1 = y2k;
-                    // Bound the estimate by the pipe empty/full values.
-                    y2k = std::max(std::min(y2kp1, 0.9999 * maxDepth), 0.0001 * maxDepth);
-
-                    // Exit statement to avoid loop the same condition; this is useful when there is a change
-                    // from non-pressurized to pressurized or empty.
-                    if (isZero(y2km1 - y2k))
+                    PoG[i] = 0;
+                    H[i] = Z[i] + Y[i] + PoG[i] + V[i] * V[i] / (2. * g);
+                }
+
+                // Final checks, in case empty or pressurized conditions reversed at this section
+                // If conduit is NOT EMPTY any more in this section, recalculate (when total energy decreases as we go upstream, which is not possible)
+                if (p.isEmpty && (H[i] - H[i - 1]) < 0)
+                {
+                    p.isEmpty = false;
+                    p.e2[i] = true;
+                    H[i] = H[i - 1];
+                    p.y2k = H[i] - Z[i] - PoG[i] - V[i] * V[i] / (2. * g);
+                    p.i--;
+                }
+                // If flow gets UNPRESSURIZED in this section, recalculate
+                else if (p.isFull && PoG[i] <= 0)
+                {
+                    double yTemp = H[i] - Z[i] - V[i] * V[i] / (2. * g);
+                    if (yTemp < 0.98 * maxDepth)
                     {
-                        solutionNotChanging = true;
-                        break;
+                        p.isFull = false;
+                        p.p2[i] = true;
+                        PoG[i] = 0;
+                        p.y2k = H[i] - Z[i] - PoG[i] - V[i] * V[i] / (2. * g);
+                        p.i--;
                     }
                 }
+
+                p.lastArea = x2.A;
+                p.volumeArea += x2.A;
+            }
+
+            if (++p.i > nC)
+            {
+                hf_reach[k] = p.hf_reach;
+                errors[k] = finish_profile(p, p.i, 0, yUp[k], volume[k]);
+                p.done = true;
+            }
+        }
+    }
+}
+
+
+int ComputeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, bool freeOnly, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach, ProfileWorkspace& workspace)
+{
+    int error;
+    workspace.reset(nC);
+    compute_profiles(reach, flow, 1, &yInit, nC, isSteep, reverseSlope, freeOnly, g, kn, maxDepthFrac, &yUp, &volume, &hf_reach, &error, workspace);
+    return error;
+}
+
+
+void ComputeProfiles(const xs::Reach& reach, double flow, int n, const double* yInit, int nC, bool reverseSlope, bool freeOnly, double g, double kn, double maxDepthFrac, double* yUp, double* volume, double* hf_reach, int* errors, ProfileWorkspace& workspace)
+{
+    n = std::min(n, PROFILE_LANES);
+    if (n <= 0)
+        return;
+    workspace.reset(nC, n);
+    compute_profiles(reach, flow, n, yInit, nC, false, reverseSlope, freeOnly, g, kn, maxDepthFrac, yUp, volume, hf_reach, errors, workspace);
+}
+
+
+
+// A section of an adaptive profile (see ComputeAdaptiveProfile) along with
+// the state of the flow there.
+struct profile_section
+{
+    double X, Y, Z, V, Sf, PoG, H, A;
+    bool isEmpty, isFull, passedThroughJump;
+};
+
+
+enum step_outcome
+{
+    step_same, // the flow is in the same state as downstream
+    step_changed, // the section emptied, filled, stopped being either, or the flow went through a jump
+    step_error,
+    step_at_max_depth
+};
+
+
+// This takes one step of the standard-step method in ComputeProfile, of
+// length dx upstream of section s1, including its checks for the section
+// emptying or filling up and their reversal.
+step_outcome standard_step(solver_params& params, const profile_section& s1, double dx, double maxDepth, double y_n, bool isSuper, bool freeOnly, profile_section& s2)
+{
+    double slope = params.S;
+    double g = params.g;
+    params.dx = dx;
+
+    s2 = s1;
+    s2.X = s1.X + dx;
+    s2.Z = s1.Z + slope * dx;
+
+    profile_params x1, x2;
+    x2.Z = s2.Z;
+    x2.PoG = 0;
+
+    step_outcome outcome = step_same;
+    bool emptied = false, unpressurized = false;
+    double y2k = 0.0;
+    for (;;)
+    {
+        double y2, Sf2, V2;
+        if (s2.isEmpty)
+        {
+            compute_variables(0.0001 * maxDepth, params, x2);
+            y2 = 0;
+            Sf2 = slope;
+            V2 = 0;
+        }
+        else if (s2.isFull)
+        {
+            compute_variables(maxDepth, params, x2);
+            y2 = maxDepth;
+            Sf2 = x2.Sf;
+            V2 = x2.V;
+            if (freeOnly)
+                return step_at_max_depth;
+        }
+        else
+        {
+            y2 = std::max(std::min(s1.Y, 0.9999 * maxDepth), 0.0001 * maxDepth);
+            compute_variables(y2, params, x1);
+            x1.Z = s1.Z;
+            x1.PoG = s1.PoG;
+
+            if (!emptied && !unpressurized)
+                y2k = y2 + 0.01 * (y_n - y2);
+            y2k = std::max(std::min(y2k, 0.9999 * maxDepth), 0.0001 * maxDepth);
+
+            bool converged = true;
+            if (isSuper && s2.passedThroughJump)
+            {
+                y2 = y_n;
+                compute_variables(y_n, params, x2);
+            }
+            else
+            {
+                converged = solve_step(params, x1, x2, maxDepth, y2k, y2);
             }
 
-            if (iterCount >= params.maxIter || solutionNotChanging)
+            if (!converged)
             {
-                passedThroughJump = isSuper && true;
-                y2 = y_n; // **THIS CONDITION WILL HAVE TO CHANGE WHEN THE SUPERCRITICAL LOGIC IS FULLY IMPLEMENTED**
+                s2.passedThroughJump = isSuper;
+                y2 = y_n;
                 compute_variables(y_n, params, x2);
-                Sf2 = x2.Sf;
-                V2 = x1.V;
+                outcome = step_changed;
             }
 
-            // If the conduit gets empty in this section, relcalculate for empty.
-            if (y2 <= 0.0001 * maxDepth && !e2[i])
+            if (y2 <= 0.0001 * maxDepth && !emptied)
             {
-                isEmpty = true;
+                s2.isEmpty = true;
                 y2 = 0;
-                Sf2 = slope;
-                V2 = 0;
+                outcome = step_changed;
             }
-
-            // If the flow gets pressurized in this section, recalculate for pressurized conditions.
-            else if (y2 >= 0.9999 * maxDepth && !p2[i])
+            else if (y2 >= 0.9999 * maxDepth && !unpressurized)
             {
-                isFull = true;
+                s2.isFull = true;
                 y2 = maxDepth;
                 compute_variables(maxDepth, params, x2);
-                Sf2 = x2.Sf;
-                V2 = x2.V;
                 if (freeOnly)
-                {
-                    return hpg::error::at_max_depth;
-                }
-            }
-            else
-            {
-                Sf2 = x2.Sf;
-                V2 = x2.V;
+                    return step_at_max_depth;
+                outcome = step_changed;
             }
 
-            if (profile_error_code)
-            {
-                error = profile_error_code;
-                break;
-            }
-        }
+            Sf2 = s2.isEmpty ? slope : x2.Sf;
+            V2 = s2.isEmpty ? 0 : x2.V;
 
-        // Once Sf1 and Y1 are obtained, compute hydraulic variables for the section
-        Y[i] = y2;
-        V[i] = V2;
-        Sf[i] = Sf2;
+            if (params.errorCode)
+                return step_error;
+        }
 
-		double sfAvg = (Sf[i] + Sf[i - 1]) * 0.5;
-		hf_reach += sfAvg * std::abs(params.dx);
+        s2.Y = y2;
+        s2.V = V2;
+        s2.Sf = Sf2;
+        s2.A = x2.A;
 
-        // For PRESSURIZED flow, use the average friction slope to get energy, then derive pressure
-        if (isFull)
+        if (s2.isFull)
         {
-            H[i] = H[i - 1] + sfAvg * std::abs(params.dx);
-            PoG[i] = H[i] - Z[i] - Y[i] - V[i] * V[i] / (2. * g);
+            s2.H = s1.H + (s2.Sf + s1.Sf) * 0.5 * dx;
+            s2.PoG = s2.H - s2.Z - s2.Y - s2.V * s2.V / (2. * g);
         }
-        // For NON-PRESSURIZED flow, use the individual elements of the energy equation (PoG = 0), this way the local energy loss (HL) in a hydraulic jump will be properly represented
         else
         {
-            PoG[i] = 0;
-            H[i] = Z[i] + Y[i] + PoG[i] + V[i] * V[i] / (2. * g);
+            s2.PoG = 0;
+            s2.H = s2.Z + s2.Y + s2.V * s2.V / (2. * g);
         }
 
-        // Final checks, in case empty or pressurized conditions reversed at this section
-        // If conduit is NOT EMPTY any more in this section, recalculate (when total energy decreases as we go upstream, which is not possible)
-        if (isEmpty && (H[i] - H[i - 1]) < 0)
+        // The same checks as ComputeProfile: the step is done again when
+        // the section isn't empty or pressurized any more.
+        if (s2.isEmpty && s2.H - s1.H < 0)
         {
-            isEmpty = false;
-            e2[i] = true;
-            H[i] = H[i - 1];
-            y2k = H[i] - Z[i] - PoG[i] - V[i] * V[i] / (2. * g);
-            i--;
+            s2.isEmpty = false;
+            emptied = true;
+            s2.H = s1.H;
+            y2k = s2.H - s2.Z - s2.PoG - s2.V * s2.V / (2. * g);
+            outcome = step_changed;
+            continue;
         }
-        // If flow gets UNPRESSURIZED in this section, recalculate
-        else if (isFull && PoG[i] <= 0)
+        else if (s2.isFull && s2.PoG <= 0)
         {
-            double yTemp = H[i] - Z[i] - V[i] * V[i] / (2. * g);
+            double yTemp = s2.H - s2.Z - s2.V * s2.V / (2. * g);
             if (yTemp < 0.98 * maxDepth)
             {
-                isFull = false;
-                p2[i] = true;
-                PoG[i] = 0;
-                y2k = H[i] - Z[i] - PoG[i] - V[i] * V[i] / (2. * g);
-                i--;
+                s2.isFull = false;
+                unpressurized = true;
+                s2.PoG = 0;
+                y2k = s2.H - s2.Z - s2.PoG - s2.V * s2.V / (2. * g);
+                outcome = step_changed;
+                continue;
             }
         }
 
-        if (!isEmpty)
-        {
-            //// Save the results of this step for the next step.
-            //params.E1 = params.E2;
-            //params.Sf1 = params.Sf2;
-        }
+        return outcome;
+    }
+}
+
 
-        lastArea = x2.A;
-        volumeArea += x2.A;
+// This is ComputeProfile with steps of varying length.  Each step is
+// checked against two steps half as long (step doubling); the difference
+// in the upstream depth is the error of the step, which has to stay under
+// tolerance * dx / length so that the error of the head at the upstream end
+// stays under the tolerance.  The steps grow where the profile is smooth,
+// e.g. along a long reach at normal depth or pressurized, and shrink down
+// to length / nC, the step of ComputeProfile, wherever a step changes the
+// state of the flow (the pipe empties, fills, or the flow goes through a
+// jump near critical depth), so those are placed the same as with fixed
+// steps.
+int ComputeAdaptiveProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool reverseSlope, bool freeOnly, double g, double kn, double maxDepthFrac, double tolerance, double& yUp, double& volume, double& hf_reach, ProfileWorkspace* workspace, int* steps)
+{
+    // With no flow the profile is a level pool, which the fixed steps
+    // only integrate the volume of.
+    if (isZero(flow) || tolerance <= 0.0)
+    {
+        if (steps)
+            *steps = nC;
+        ProfileWorkspace local;
+        return ComputeProfile(reach, flow, yInit, nC, false, reverseSlope, freeOnly, g, kn, maxDepthFrac, yUp, volume, hf_reach, workspace ? *workspace : local);
     }
 
-    // Compute the volume (the sum of the areas of the cross section
-    // at each step minus the average of the first and last cross
-    // section areas times the x-step).
-    volume = (volumeArea - (lastArea + params.first_area) / 2.0) * fabs(params.dx);
+    hf_reach = 0;
+    volume = 0;
 
-    // Due to numerical solution, sometimes the volume might be slightly larger than the 
-    // full volume, so we bound it here.
-    double fullVolume = params.xs->computeArea(params.xs->getMaxDepth()) * reach.getLength();
-    if (((y2 - maxDepth >= -0.1) && (yInit - maxDepth >= -0.1)) || volume > fullVolume)
-        volume = fullVolume;
+    double slope = reach.getSlope() * (reverseSlope ? -1. : 1.);
+    double length = reach.getLength();
+    double maxDepth = reach.getMaxDepth() * maxDepthFrac;
 
-#ifdef DEBUG_PROFILE
-    FILE* fh = fopen("profile.txt", "w");
-    for (int i = 0; i < nC+1; i++)
+    solver_params params;
+    params.xs = reach.getXs().get();
+    params.curIter = 0;
+    params.maxIter = 50;
+    params.errorCode = 0;
+    params.stats = workspace ? &workspace->stats : NULL;
+    params.L = length;
+    params.N = reach.getRoughness();
+    params.S = slope;
+    params.Q = flow;
+    params.kn = kn;
+    params.g = g;
+    params.isSteep = 1;
+    params.first_area = -1.0;
+    params.dx = length / nC;
+
+    double y_c;
+    ComputeCriticalDepth(reach, flow, g, y_c);
+
+    double y_n = maxDepth;
+    if (!reverseSlope)
+        ComputeNormalDepth(reach, flow, g, kn, y_n);
+
+    ///////////////////////////////////////////////////////////////////////////
+    // The downstream end of the conduit, the same as in ComputeProfile.
+    profile_section s;
+    s.X = 0;
+    s.Z = slope < 0.0 ? length * fabs(slope) : 0.0;
+    s.Y = std::max(y_c, yInit);
+    s.isEmpty = false;
+    s.isFull = false;
+    s.passedThroughJump = false;
+
+    profile_params x1;
+    if (s.Y <= 0.0001 * maxDepth)
     {
-        if (i > 0)
-            fprintf(fh, "\t");
-        fprintf(fh, "%f", X[i]);
+        s.isEmpty = true;
+        compute_variables(s.Y, params, x1);
     }
-    fprintf(fh, "\n");
-    for (int i = 0; i < nC+1; i++)
+    else if (s.Y >= 0.9999 * maxDepth)
     {
-        if (i > 0)
-            fprintf(fh, "\t");
-        fprintf(fh, "%f", Y[i]);
+        s.isFull = true;
+        s.Y = maxDepth;
+        compute_variables(s.Y, params, x1);
+        s.PoG = std::max(std::min(0., y_c - maxDepth), yInit - maxDepth);
+        if (freeOnly)
+            return hpg::error::at_max_depth;
     }
-    fprintf(fh, "\n");
-    for (int i = 0; i < nC+1; i++)
+    else
     {
-        if (i > 0)
-            fprintf(fh, "\t");
-        fprintf(fh, "%f", Z[i]);
+        compute_variables(s.Y, params, x1);
     }
-    fprintf(fh, "\n");
-    fclose(fh);
-#endif
 
-    // If we terminated early, then return an error.
-    if (i < nC)
+    if (params.errorCode == ERR_ZERO_AREA)
+        s.isEmpty = true;
+
+    if (s.isEmpty)
     {
-        return 1;
+        s.Y = 0;
+        s.Sf = slope;
+        s.V = 0;
+        s.PoG = 0;
+        s.A = 0;
     }
-
-    // If there was an error, then return it.
-    else if (error != 0)
+    else
     {
-        return 1;
+        s.Sf = x1.Sf;
+        s.V = x1.V;
+        s.A = x1.A;
+        if (!s.isFull)
+            s.PoG = 0;
     }
 
-    // Otherwise we successfully solved for a point.
-    else
+    s.H = s.Z + s.Y + s.PoG + s.V * s.V / (2. * g);
+
+    if (s.Y >= 0.98 * maxDepth)
+        s.isFull = true;
+
+    bool isSuper = y_n < y_c;
+    if (params.stats)
+        params.stats->profiles++;
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Standard steps, from the downstream end up.
+    double minStep = length / nC;
+    double dx = minStep;
+    int count = 0;
+    while (length - s.X > 1e-9 * length)
     {
-        yUp = y2 + PoG[nC];
-        return 0;
+        double step = std::min(dx, length - s.X);
+        bool finest = step <= minStep;
+
+        profile_section whole, half, end;
+        step_outcome outcome = standard_step(params, s, step, maxDepth, y_n, isSuper, freeOnly, whole);
+        count++;
+        if (outcome == step_error)
+            return 1;
+
+        if (finest)
+        {
+            if (outcome == step_at_max_depth)
+                return hpg::error::at_max_depth;
+            hf_reach += (s.Sf + whole.Sf) * 0.5 * step;
+            volume += (s.A + whole.A) * 0.5 * step;
+            s = whole;
+            dx = 2. * minStep;
+            continue;
+        }
+
+        // A change in the state of the flow is only taken at the finest
+        // step, so the step is done again shorter.
+        if (outcome == step_same)
+        {
+            outcome = standard_step(params, s, step / 2., maxDepth, y_n, isSuper, freeOnly, half);
+            count++;
+        }
+        if (outcome == step_same)
+        {
+            outcome = standard_step(params, half, step / 2., maxDepth, y_n, isSuper, freeOnly, end);
+            count++;
+        }
+        if (outcome == step_error)
+            return 1;
+        else if (outcome != step_same)
+        {
+            dx = std::max(minStep, step / 4.);
+            continue;
+        }
+
+        // The error of a standard step goes with dx^3, so the error
+        // allowed per unit of length goes with dx^2.
+        double error = std::abs((end.Y + end.PoG) - (whole.Y + whole.PoG));
+        double allowed = tolerance * step / length;
+        double factor = error > 0.0 ? 0.9 * std::sqrt(allowed / error) : 2.;
+        if (error > allowed)
+        {
+            dx = std::max(minStep, step * std::max(0.2, factor));
+            continue;
+        }
+
+        hf_reach += ((s.Sf + half.Sf) * 0.5 + (half.Sf + end.Sf) * 0.5) * step / 2.;
+        volume += (s.A + 2. * half.A + end.A) * 0.25 * step;
+        s = end;
+        dx = std::max(minStep, step * std::min(2., factor));
     }
+
+    // Bound the volume, as in ComputeProfile.
+    double fullVolume = params.xs->computeArea(params.xs->getMaxDepth()) * reach.getLength();
+    if (((s.Y - maxDepth >= -0.1) && (yInit - maxDepth >= -0.1)) || volume > fullVolume)
+        volume = fullVolume;
+
+    if (steps)
+        *steps = count;
+
+    yUp = s.Y + s.PoG;
+    return 0;
 }
 
 
-// This function computes the variables (theta, wetted perimeter, etc.)
-// for later on.
-inline void compute_variables(double y, solver_params& params, profile_params& x)
+// This sets the variables at depth y from the properties of the cross
+// section there and (P/A)^(4/3).
+inline void set_variables(double y, const xs::Properties& props, double power, solver_params& params, profile_params& x)
 {
-    x.A = params.xs->computeArea(y);
+    x.A = props.area;
     if (isZero(x.A)) // is it zero?
     {
-        profile_error_code = ERR_ZERO_AREA;
+        params.errorCode = ERR_ZERO_AREA;
         return;
     }
 
-    x.P = params.xs->computeWettedPerimiter(y);
-    x.T = params.xs->computeTopWidth(y);
+    x.P = props.wettedPerimeter;
+    x.T = props.topWidth;
+    x.dPdy = props.dPdy;
     x.V = params.Q / x.A;
     x.Y = y;
     //x.E = x.Z + y + params.Q * params.Q / (x.A * x.A * 2.0 * params.g);
-    x.Sf = (params.Q * params.N * std::pow(x.P, 2.0/3.0)) / (params.kn * std::pow(x.A, 5.0/3.0));
-    x.Sf = x.Sf * x.Sf; // square it
+    // Sf = (Q n P^(2/3) / (kn A^(5/3)))^2 = (Q n / kn)^2 (P/A)^(4/3) / A^2,
+    // which takes one pow instead of two.
+    x.Sf = params.Q * params.N / params.kn;
+    x.Sf = x.Sf * x.Sf * power / (x.A * x.A);
     x.PoG = 0;
 
     if (isZero(params.first_area + 1.0))
@@ -613,12 +1092,47 @@ inline void compute_variables(double y, solver_params& params, profile_params& x
 }
 
 
+// This function computes the variables (theta, wetted perimeter, etc.)
+// for later on.
+inline void compute_variables(double y, solver_params& params, profile_params& x)
+{
+    xs::Properties props;
+    params.xs->computeAll(y, props);
+    set_variables(y, props, std::pow(props.wettedPerimeter / props.area, FOURTHIRDS), params, x);
+}
+
+
+// This is compute_variables for the lanes of ComputeProfiles, x[j] at
+// depth y[j], which all have the same cross section.  The properties and
+// the pows of all of the lanes are each computed in one loop.
+inline void compute_variables(int count, const double* y, solver_params* const* params, profile_params* const* x)
+{
+    xs::Properties props[PROFILE_LANES];
+    params[0]->xs->computeAll(count, y, props);
+
+    double power[PROFILE_LANES];
+    for (int j = 0; j < count; j++)
+        power[j] = props[j].wettedPerimeter / props[j].area;
+    for (int j = 0; j < count; j++)
+        power[j] = std::pow(power[j], FOURTHIRDS);
+
+    for (int j = 0; j < count; j++)
+        set_variables(y[j], props[j], power[j], *params[j], *x[j]);
+}
+
+
 // This the function we're attempting to find the root for.
 // This works for both steep, mild, and adverse.
 inline double profile_func(double y, solver_params& params, profile_params& x1, profile_params& x2)
 {
     compute_variables(y, params, x2);
+    return profile_residual(params, x1, x2);
+}
+
 
+// This is profile_func once the variables of x2 are computed.
+inline double profile_residual(solver_params& params, profile_params& x1, profile_params& x2)
+{
     double E2 = (x2.Z + x2.Y + x2.V*x2.V/(2.*params.g) + x2.PoG);
     double E1 = (x1.Z + x1.Y + x1.V*x1.V/(2.*params.g) + x1.PoG);
     double fn = E2 - E1 - (x2.Sf + x1.Sf) / 2.0 * fabs(params.dx);
@@ -636,16 +1150,18 @@ inline double profile_func_deriv(double y, solver_params& params, profile_params
     double g = params.g;
     double A = x2.A;
     double dx = fabs(params.dx);
-    double n = params.N;
     double P = x2.P;
-    double T = x2.T;
 
-    double dPdy = params.xs->computeDpDy(y);
-    double dAdy = params.xs->computeDaDy(y);
+    // compute_variables computed these at y for profile_func.
+    double dPdy = x2.dPdy;
+    double dAdy = x2.T;
 
-    double dfn = 1. - Q*Q * dAdy / (g * A*A*A) - 0.5 * std::sqrt(x1.Sf / x2.Sf) * dx * Q*Q * n*n / (2. * params.kn * params.kn) *
+    // (Q n / kn)^2 d/dy[P^(4/3) / A^(10/3)] is x2.Sf (4/3 dP/P - 10/3 dA/A),
+    // so the slope already computed at y stands in for the four pows, and
+    // sqrt(x1.Sf / x2.Sf) x2.Sf folds into sqrt(x1.Sf x2.Sf).
+    double dfn = 1. - Q*Q * dAdy / (g * A*A*A) - 0.25 * std::sqrt(x1.Sf * x2.Sf) * dx *
         (
-            4./3. * std::pow(P, ONETHIRD) / std::pow(A, TENTHIRDS) * dPdy - TENTHIRDS * dAdy * std::pow(P, FOURTHIRDS) / std::pow(A, THIRTEENTHIRDS)
+            FOURTHIRDS * dPdy / P - TENTHIRDS * dAdy / A
         );
     //double dfn = 1 - Q*Q * dAdy / (g * A*A*A) - Q*Q * n*n / 2. * dx *
     //    (
@@ -655,3 +1171,127 @@ inline double profile_func_deriv(double y, solver_params& params, profile_params
     return dfn * params.isSteep;
 }
 
+
+// This is the actual solver for the given upstream point.  We need to
+// iterate until the solution converges or we've reached the max number of
+// iterations (divergence).  y2k is the initial guess and is left at the
+// last estimate; returns false if the depth didn't converge.
+inline bool solve_step(solver_params& params, profile_params& x1, profile_params& x2, double maxDepth, double& y2k, double& y2)
+{
+    if (params.stats)
+        params.stats->solves++;
+
+    int iterCount = 0;
+    while (iterCount < params.maxIter)
+    {
+        if (params.stats)
+            params.stats->iterations++;
+
+        // These functions contain the equations and math for the solution.
+        double fn = profile_func(y2k, params, x1, x2);
+        double dfn = profile_func_deriv(y2k, params, x1, x2);
+
+        double y2kp1 = y2k - fn/dfn;
+
+        if (std::abs(y2kp1 - y2k) / (0.5 * std::abs(y2kp1 + y2k)) < SOL_TOL)
+        {
+            y2 = y2kp1;
+            return true;
+        }
+
+        iterCount++;
+        double y2km1 = y2k;
+        // Bound the estimate by the pipe empty/full values.
+        y2k = std::max(std::min(y2kp1, 0.9999 * maxDepth), 0.0001 * maxDepth);
+
+        // Exit statement to avoid loop the same condition; this is useful when there is a change
+        // from non-pressurized to pressurized or empty.
+        if (isZero(y2km1 - y2k))
+            return false;
+    }
+
+    return false;
+}
+
+
+// The first estimate of the depth of section i of a profile, from the
+// depth y1 of the section below it: a hundredth of the way to normal
+// depth, or the change in depth of the last profile G over the same step.
+inline double first_guess(double y1, double y_n, double maxDepth, const double* G, int i)
+{
+    // Continue from the last profile where it had a free surface
+    // over this step and no jump, by adding its change in depth.
+    if (G && G[i - 1] > 0.0001 * maxDepth && G[i - 1] < 0.9999 * maxDepth &&
+        G[i] > 0.0001 * maxDepth && G[i] < 0.9999 * maxDepth &&
+        std::abs(G[i] - G[i - 1]) < 0.01 * maxDepth)
+    {
+        return y1 + (G[i] - G[i - 1]);
+    }
+    return y1 + 0.01 * (y_n - y1);
+}
+
+
+// This is solve_step for several lanes of compute_profiles, in lockstep:
+// each iteration computes the variables of every lane that is still
+// iterating at once.  converged[k] is what solve_step returns for lane k.
+inline void solve_steps(int count, const int* lanes, profile_state* s, bool* converged)
+{
+    int active[PROFILE_LANES];
+    int iterations[PROFILE_LANES];
+    double depths[PROFILE_LANES];
+    solver_params* params[PROFILE_LANES];
+    profile_params* x[PROFILE_LANES];
+    for (int j = 0; j < count; j++)
+    {
+        solver_params& p = s[lanes[j]].params;
+        if (p.stats)
+            p.stats->solves++;
+        active[j] = j;
+        converged[lanes[j]] = false;
+        iterations[j] = 0;
+    }
+
+    int m = count;
+    while (m > 0)
+    {
+        for (int a = 0; a < m; a++)
+        {
+            profile_state& p = s[lanes[active[a]]];
+            depths[a] = p.y2k;
+            params[a] = &p.params;
+            x[a] = &p.x2;
+        }
+        compute_variables(m, depths, params, x);
+
+        int left = 0;
+        for (int a = 0; a < m; a++)
+        {
+            int j = active[a];
+            profile_state& p = s[lanes[j]];
+            if (p.params.stats)
+                p.params.stats->iterations++;
+            iterations[j]++;
+
+            double fn = profile_residual(p.params, p.x1, p.x2);
+            double dfn = profile_func_deriv(p.y2k, p.params, p.x1, p.x2);
+
+            double y2kp1 = p.y2k - fn/dfn;
+
+            if (std::abs(y2kp1 - p.y2k) / (0.5 * std::abs(y2kp1 + p.y2k)) < SOL_TOL)
+            {
+                p.y2 = y2kp1;
+                converged[lanes[j]] = true;
+                continue;
+            }
+
+            double y2km1 = p.y2k;
+            p.y2k = std::max(std::min(y2kp1, 0.9999 * p.maxDepth), 0.0001 * p.maxDepth);
+
+            // The same exits as solve_step.
+            if (isZero(y2km1 - p.y2k) || iterations[j] >= p.params.maxIter)
+                continue;
+            active[left++] = j;
+        }
+        m = left;
+    }
+}
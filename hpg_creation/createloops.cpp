@@ -49,6 +49,9 @@
 #include <iostream>
 #include <stdlib.h>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <functional>
 
 #include "../hpg_interp/hpg.hpp"
 #include "../hpg/math.hpp"
@@ -84,9 +87,13 @@ std::shared_ptr<hpg::Hpg> HpgCreator::AutoCreateHpg(const xs::Reach& reach)
     hpg->setRoughness(reach.getRoughness());
     hpg->setMaxDepth(reach.getMaxDepth());
     hpg->setMaxDepthFraction(this->maxDepthFrac);
+    hpg->setSourceHash(getSourceHash(reach));
 
     double pressurizedHeight = 1000;
 
+    this->profileStats = ProfileStats();
+    this->workspace.stats = ProfileStats();
+
     int numStepsSave = this->numSteps;
     this->numSteps = std::max(this->numSteps, (int)round(reach.getLength() / 10.0));
 
@@ -142,30 +149,68 @@ std::shared_ptr<hpg::Hpg> HpgCreator::AutoCreateHpg(const xs::Reach& reach)
             //else if (flows.back() > maxFlow)
             //    flows.back() = round(maxFlow, 1.0);
 
-            double yNormal = 0.0;
-            double yCritical = 0.0;
+            // For every flow, compute a curve.  The curves don't depend on
+            // each other, so each worker takes the next flow off the list
+            // and the curves are added to the HPG in flow order once they
+            // have all finished, which makes the HPG the same as the one a
+            // single thread would create.
+            int count = (int)flows.size();
+            std::vector<hpg::hpgvec> curves(count);
+            std::vector<double> fullHfs(count, -1.0);
+            std::vector<char> valids(count, 0);
+            std::atomic<int> next(0);
+
+            unsigned int threads = (unsigned int)this->numThreads;
+            if (threads == 0)
+                threads = std::max(std::thread::hardware_concurrency(), 1u);
+            threads = std::min(threads, (unsigned int)count);
+            std::vector<ProfileWorkspace> workspaces(std::max(threads, 1u));
+
+            auto worker = [&](ProfileWorkspace& workspace)
+            {
+                for (int i = next++; i < count; i = next++)
+                {
+                    // Calculate a backwater profile.  computeHpgCurve() automatically
+                    // determines slope type (from normal/critical) and calculates
+                    // accordingly, computing its profiles in the lanes of the
+                    // workspace of this thread.
+                    double yNormal = 0.0;
+                    double yCritical = 0.0;
+                    valids[i] = computeValidHpgCurve(reach, flows[i], pressurizedHeight, slopeRev != 0, yNormal, yCritical, curves[i], &fullHfs[i], &workspace);
+                }
+            };
 
-            // For every flow, compute a curve.
-            for (unsigned int i = 0; i < flows.size(); i++)
+            if (threads <= 1)
+            {
+                worker(workspaces[0]);
+            }
+            else
             {
-                double curFlow = flows.at(i);
+                std::vector<std::thread> pool;
+                for (unsigned int t = 0; t < threads; t++)
+                    pool.push_back(std::thread(worker, std::ref(workspaces[t])));
+                for (unsigned int t = 0; t < threads; t++)
+                    pool[t].join();
+            }
 
-                // Calculate a backwater profile.  computeHpgCurve() automatically
-                // determines slope type (from normal/critical) and calculates
-                // accordingly.
-                hpg::hpgvec curve;
-                bool valid = computeValidHpgCurve(reach, curFlow, pressurizedHeight, slopeRev, yNormal, yCritical, curve);
+            for (size_t t = 0; t < workspaces.size(); t++)
+                this->profileStats.add(workspaces[t].stats);
+
+            for (int i = 0; i < count; i++)
+            {
+                double curFlow = flows[i];
+                hpg::hpgvec& curve = curves[i];
 
                 // Check if an error occurred.
-                if (valid)
+                if (valids[i])
                 {
                     // If the curve has more than this->minCurvePoints add it to the HPG.
                     if ((int)curve.size() >= this->minCurvePoints)
                     {
                         if (slopeRev)
-                            hpg->AddCurve(-curFlow, curve, (hpg::point)(curve.at(0)));
+                            hpg->AddCurve(-curFlow, curve, (hpg::point)(curve.at(0)), fullHfs[i]);
                         else
-                            hpg->AddCurve(curFlow, curve, (hpg::point)(curve.at(0)));
+                            hpg->AddCurve(curFlow, curve, (hpg::point)(curve.at(0)), fullHfs[i]);
                     }
                 }
                 //else
@@ -179,6 +224,7 @@ std::shared_ptr<hpg::Hpg> HpgCreator::AutoCreateHpg(const xs::Reach& reach)
     }
 
     this->numSteps = numStepsSave;
+    this->profileStats.add(this->workspace.stats);
 
     if (this->errorCode)
     {
@@ -47,10 +47,17 @@
 
 
 #include <algorithm>
+#include <sstream>
+#include <iomanip>
 
 #include "hpg_creator.hpp"
 
 
+// Change this whenever a change to the creator changes the HPGs it creates,
+// so that getSourceHash tells the old HPGs apart.
+#define HPG_CREATOR_VERSION 4
+
+
 HpgCreator::HpgCreator()
 {
 
@@ -61,6 +68,10 @@ HpgCreator::HpgCreator()
     this->maxIterations = 40;
     this->maxIterations = 100;
     this->minCurvePoints = 4;
+    this->closedFormFull = true;
+    this->numThreads = 0;
+    this->profileTolerance = 0.;
+    this->warmStart = true;
     this->errorCode = 0;
     this->numSteps = 1000.;
 
@@ -155,6 +166,49 @@ void HpgCreator::setMinCurveSize(int size)
 }
 
 
+std::string HpgCreator::getSourceHash(const xs::Reach& reach) const
+{
+    std::stringstream source;
+    source << std::setprecision(17)
+        << "creator=" << HPG_CREATOR_VERSION
+        << " xs=" << (int)reach.getXs()->getType()
+        << " max_depth=" << reach.getMaxDepth()
+        << " length=" << reach.getLength()
+        << " roughness=" << reach.getRoughness()
+        << " ds_invert=" << reach.getDsInvert()
+        << " us_invert=" << reach.getUsInvert()
+        << " ds_sta=" << reach.getDsStation()
+        << " steps=" << this->numSteps
+        << " curves=" << this->numHpc
+        << " points=" << this->numPoints
+        << " max_depth_frac=" << this->maxDepthFrac
+        << " tol=" << this->convergenceTol
+        << " iter=" << this->maxIterations
+        << " g=" << this->g
+        << " kn=" << this->kn
+        << " min_points=" << this->minCurvePoints
+        << " closed_form_full=" << this->closedFormFull
+        << " warm_start=" << this->warmStart;
+    // Only with adaptive steps, so the hashes of the HPGs from fixed steps
+    // stay the same.
+    if (this->profileTolerance > 0.)
+        source << " profile_tol=" << this->profileTolerance;
+
+    // 64-bit FNV-1a.
+    std::string text = source.str();
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+
+    std::stringstream hex;
+    hex << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return hex.str();
+}
+
+
 int HpgCreator::getError()
 {
     return this->errorCode;
@@ -171,3 +225,57 @@ void HpgCreator::setNumBackwaterSteps(int numComp)
 {
     this->numSteps = std::max(20, numComp);
 }
+
+
+bool HpgCreator::getClosedFormFull()
+{
+    return this->closedFormFull;
+}
+
+
+void HpgCreator::setClosedFormFull(bool closedForm)
+{
+    this->closedFormFull = closedForm;
+}
+
+
+int HpgCreator::getNumThreads()
+{
+    return this->numThreads;
+}
+
+
+void HpgCreator::setNumThreads(int threads)
+{
+    this->numThreads = std::max(0, threads);
+}
+
+
+double HpgCreator::getProfileTolerance()
+{
+    return this->profileTolerance;
+}
+
+
+void HpgCreator::setProfileTolerance(double tolerance)
+{
+    this->profileTolerance = std::max(0., tolerance);
+}
+
+
+bool HpgCreator::getWarmStart()
+{
+    return this->warmStart;
+}
+
+
+void HpgCreator::setWarmStart(bool warm)
+{
+    this->warmStart = warm;
+}
+
+
+ProfileStats HpgCreator::getProfileStats()
+{
+    return this->profileStats;
+}
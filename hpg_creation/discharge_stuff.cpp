@@ -69,13 +69,13 @@ double HpgCreator::findMaxFlow(const xs::Reach& reach, bool reverseSlope, double
     double end = reach.getMaxDepth() * 500;
 
     hpg::hpgvec curve;
-    bool valid = computeValidHpgCurve(reach, end, 0., reverseSlope, yNormal, yCritical, curve);
+    bool valid = computeValidHpgCurve(reach, end, 0., reverseSlope, yNormal, yCritical, curve, NULL, &this->workspace);
     int iterations = 0;
     while (valid && iterations < 50)
     {
         end += 100 * reach.getMaxDepth();
         curve.clear();
-        valid = computeValidHpgCurve(reach, end, 0., reverseSlope, yNormal, yCritical, curve);
+        valid = computeValidHpgCurve(reach, end, 0., reverseSlope, yNormal, yCritical, curve, NULL, &this->workspace);
         iterations++;
     }
 
@@ -95,7 +95,7 @@ double HpgCreator::findMaxFlow(const xs::Reach& reach, bool reverseSlope, double
     while (fabs(end - start) > 1 && iterations < 50)
     {
         double guess = 0.5 * (end - start) + start;
-        valid = computeValidHpgCurve(reach, guess, 0., reverseSlope, yNormal, yCritical, curve);
+        valid = computeValidHpgCurve(reach, guess, 0., reverseSlope, yNormal, yCritical, curve, NULL, &this->workspace);
         if (valid)
         {
             yCritMax = yCritical;
@@ -54,6 +54,7 @@
 #include "../hpg_interp/hpg.hpp"
 #include "../hpg/error.hpp"
 #include "../xslib/reach.h"
+#include "profile.h"
 
 
 /** @file
@@ -91,6 +92,12 @@ private:
     short units; /**< units specifier; defaults to English units */
     int errorCode; /**< error code; 0 == no error, non-0 == error */
     int minCurvePoints; /**< this is the minimum number of points on a curve that are required */
+    bool closedFormFull; /**< end each curve once the pipe is full and store its friction loss instead; defaults to true */
+    int numThreads; /**< number of threads used to compute the curves of an HPG; 0 == one per core; defaults to 0 */
+    double profileTolerance; /**< error of the upstream head of a backwater profile with adaptive steps; 0 == fixed steps; defaults to 0 */
+    bool warmStart; /**< start the Newton solves of each profile of a curve from the profile of the downstream depth before it; defaults to true */
+    ProfileWorkspace workspace; /**< arrays of the profiles computed by findMaxFlow; the curve threads have their own */
+    ProfileStats profileStats; /**< Newton iterations of the profiles of the last HPG created */
 public:
     /**
     * Constructor initializes everything to default values.
@@ -99,6 +106,15 @@ public:
 
     std::shared_ptr<hpg::Hpg> AutoCreateHpg(const xs::Reach& reach);
 
+    /**
+    * getSourceHash returns a hash of everything the HPG that AutoCreateHpg
+    * creates for the reach depends on: the reach, the settings below and
+    * the version of the creator.  AutoCreateHpg stores it in the HPG (see
+    * hpg::Hpg::getSourceHash), so an existing HPG is up to date if its hash
+    * is the same.  The number of threads isn't part of it.
+    */
+    std::string getSourceHash(const xs::Reach& reach) const;
+
     // These should be private
     double findMaxFlow(const xs::Reach& reach, bool reverseSlope, double &yCritMax);
     void findFlowIncrements(const xs::Reach& reach, bool reverseSlope, double minDepth, double maxDepth, std::deque<double> &flows);
@@ -110,8 +126,15 @@ public:
     //double FindCriticalFlow(const xs::Reach& reach, double depth);
     //double FindMinFlow(const xs::Reach& reach, bool reverseSlope, double starting_discharge, double ending_discharge, double &y_critical_min);
 
-    void computeHpgCurve(const xs::Reach& reach, double flow, double pressurizedHeight, bool reverseSlope, double& yNormal, double& yCritical, hpg::hpgvec &curve);
-    bool computeValidHpgCurve(const xs::Reach& reach, double flow, double pressurizedHeight, bool reverseSlope, double& yNormal, double& yCritical, hpg::hpgvec &curve);
+    // These are const and keep their error state local, so they can be
+    // called from several threads at once, each with its own workspace
+    // (or NULL to allocate one for the curve).
+    int computeHpgCurve(const xs::Reach& reach, double flow, double pressurizedHeight, bool reverseSlope, double& yNormal, double& yCritical, hpg::hpgvec &curve, double* fullHf = NULL, ProfileWorkspace* workspace = NULL) const;
+    bool computeValidHpgCurve(const xs::Reach& reach, double flow, double pressurizedHeight, bool reverseSlope, double& yNormal, double& yCritical, hpg::hpgvec &curve, double* fullHf = NULL, ProfileWorkspace* workspace = NULL) const;
+
+private:
+    int computeProfile(const xs::Reach& reach, double flow, double yInit, bool reverseSlope, bool freeOnly, double& yUp, double& volume, double& hf_reach, ProfileWorkspace* workspace) const;
+    void computeProfiles(const xs::Reach& reach, double flow, int n, const double* yInit, bool reverseSlope, bool freeOnly, double* yUp, double* volume, double* hf_reach, int* errors, ProfileWorkspace* workspace) const;
 
 public:
     /**
@@ -185,6 +208,63 @@ public:
     int getNumBackwaterSteps();
     void setNumBackwaterSteps(int numComp);
 
+    /**
+    * getClosedFormFull says if each curve ends once the pipe is full
+    * from end to end, leaving the rest of the curve to the friction
+    * loss stored with it (see hpg::Hpg::AddCurve).
+    */
+    bool getClosedFormFull();
+    /**
+    * setClosedFormFull sets if each curve ends once the pipe is full,
+    * rather than being computed up to the pressurized height.
+    */
+    void setClosedFormFull(bool closedForm);
+
+    /**
+    * getNumThreads returns the number of threads used to compute the
+    * curves of an HPG; 0 means one thread per core.
+    */
+    int getNumThreads();
+    /**
+    * setNumThreads sets the number of threads used to compute the curves
+    * of an HPG.  The HPG does not depend on it; the curves are added in
+    * flow order whichever thread computed them.
+    */
+    void setNumThreads(int threads);
+
+    /**
+    * getProfileTolerance returns the error allowed in the upstream head of
+    * each backwater profile when its steps are adaptive; 0 means the
+    * profiles take the fixed number of backwater steps.
+    */
+    double getProfileTolerance();
+    /**
+    * setProfileTolerance makes the backwater profiles take steps that grow
+    * and shrink to keep the error of the upstream head under the tolerance
+    * (see ComputeAdaptiveProfile), which takes far fewer steps on long
+    * reaches.  The number of backwater steps then sets the shortest step.
+    */
+    void setProfileTolerance(double tolerance);
+
+    /**
+    * getWarmStart says if the profiles of a curve start their Newton
+    * solves from the profile of the downstream depth before them.
+    */
+    bool getWarmStart();
+    /**
+    * setWarmStart sets if the profiles of a curve start their Newton
+    * solves from the profile before them (see ProfileWorkspace) instead
+    * of from scratch.  Each curve starts from scratch either way, so the
+    * HPG doesn't depend on which thread computed which curve.
+    */
+    void setWarmStart(bool warm);
+
+    /**
+    * getProfileStats returns the number of profiles, Newton solves and
+    * Newton iterations it took to create the last HPG.
+    */
+    ProfileStats getProfileStats();
+
     /**
     * Return the error code.
     */
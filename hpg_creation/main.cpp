@@ -56,11 +56,16 @@
 
 void PrintUsage(char* progName);
 int Interactive();
+int Thin(int argc, char** argv);
 
 
 int main(int argc, char** argv)
 {
-    if (argc >= 7)
+    if (argc >= 5 && !strcmp(argv[1], "-thin"))
+    {
+        return Thin(argc, argv);
+    }
+    else if (argc >= 7)
     {
         double diameter = atof(argv[1]);
         double length = atof(argv[2]);
@@ -105,7 +110,52 @@ void PrintUsage(char* progName)
     std::cout << "USAGE: " << progName << " <diameter> <length> <roughness> <slope> <dsInvert> \n"
         << "    <output_file> <nodeID> <dsStation> <this->maxDepthFrac>\n\n"
         << "where <this->maxDepthFrac> defaults to 0.80 (pipe full = 80% of diameter).\n"
-        << "<nodeID> and <dsStation> are optional." << std::endl;
+        << "<nodeID> and <dsStation> are optional.\n\n"
+        << "       " << progName << " -thin <input_file> <output_file> <maxHeadError> [<maxVolumeError>]\n\n"
+        << "removes the points and curves of an HPG that it can do without, keeping the\n"
+        << "upstream head and hf within <maxHeadError> and the volume within <maxVolumeError>\n"
+        << "(a fraction, default 0.001) of the original.  Binary HPGs are saved as binary." << std::endl;
+}
+
+
+int Thin(int argc, char** argv)
+{
+    using namespace std;
+
+    string input = argv[2];
+    string output = argv[3];
+    double maxHeadError = atof(argv[4]);
+    double maxVolumeError = 0.001;
+    if (argc >= 6)
+        maxVolumeError = atof(argv[5]);
+
+    hpg::Hpg hpg;
+    if (!hpg.LoadFromFile(input))
+    {
+        cout << "Unable to load " << input << ": " << hpg.getErrorMessage() << endl;
+        return 1;
+    }
+
+    hpg::ThinStats stats;
+    if (HPGFAILURE(hpg.Thin(maxHeadError, maxVolumeError, &stats)))
+    {
+        cout << "Unable to thin " << input << ": " << hpg.getErrorMessage() << endl;
+        return 1;
+    }
+
+    bool saved = hpg::Hpg::IsBinaryFile(input) ? hpg.SaveBinary(output) : hpg.SaveToFile(output);
+    if (!saved)
+    {
+        cout << "Unable to save " << output << ": " << hpg.getErrorMessage() << endl;
+        return 1;
+    }
+
+    cout << "Curves: " << stats.curvesBefore << " -> " << stats.curvesAfter << endl
+        << "Points: " << stats.pointsBefore << " -> " << stats.pointsAfter << endl
+        << "Largest head change: " << stats.maxHeadError << endl
+        << "Largest volume change: " << stats.maxVolumeError << " (relative)" << endl
+        << "Samples compared: " << stats.samples << endl;
+    return 0;
 }
 
 
@@ -68,7 +68,7 @@ int ComputeNormalDepth(const xs::Reach& reach, double Q, double g, double kn, do
     double d = reach.getMaxDepth();
     double Ss = sqrt(reach.getSlope());
 
-    std::shared_ptr<xs::CrossSection> xs = reach.getXs();
+    xs::CrossSection* xs = reach.getXs().get();
 
     double initialGuess = d / 2; // ((n / kn) * Q * std::pow(M_PI, TWOTHIRDS)) / (std::pow(0.75 * d, FIVETHIRDS) * Ss);
     yN = initialGuess;
@@ -79,10 +79,12 @@ int ComputeNormalDepth(const xs::Reach& reach, double Q, double g, double kn, do
     {
         double y = std::max(std::min(yN, 0.9999 * d), 0.0001 * d);
 
-        double A = xs->computeArea(y);
-        double P = xs->computeWettedPerimiter(y);
-        double T = xs->computeTopWidth(y);
-        double dPdy = xs->computeDpDy(y);
+        xs::Properties props;
+        xs->computeAll(y, props);
+        double A = props.area;
+        double P = props.wettedPerimeter;
+        double T = props.topWidth;
+        double dPdy = props.dPdy;
         double Rp = A / P; // std::pow(A / P, TWOTHIRDS);
 
         double F = A * std::pow(Rp, TWOTHIRDS) - Q * (n/kn) / Ss;
@@ -131,7 +133,7 @@ int ComputeCriticalDepth(const xs::Reach& reach, double Q, double g, double& yC)
 {
     double d = reach.getMaxDepth();
 
-    std::shared_ptr<xs::CrossSection> xs = reach.getXs();
+    xs::CrossSection* xs = reach.getXs().get();
 
     double initialGuess = std::sqrt(Q / std::sqrt(d * g));
     yC = initialGuess;
@@ -142,10 +144,11 @@ int ComputeCriticalDepth(const xs::Reach& reach, double Q, double g, double& yC)
     {
         double y = std::max(std::min(yC, 0.9999 * d), 0.0001 * d);
 
-        double A = xs->computeArea(y);
-        double P = xs->computeWettedPerimiter(y);
-        double T = xs->computeTopWidth(y);
-        double dTdy = xs->computeDtDy(y);
+        xs::Properties props;
+        xs->computeAll(y, props);
+        double A = props.area;
+        double T = props.topWidth;
+        double dTdy = props.dTdy;
 
         double F = Q*Q * T / (g * A*A*A) - 1;
         double dF = (Q*Q / g) * ( -3. * T*T / (A*A*A*A) + dTdy / (A*A*A) );
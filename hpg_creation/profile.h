@@ -49,12 +49,118 @@
 #define PROFILE_HPG_H__
 
 
+#include <vector>
+
 #include "../api.h"
 #include "../xslib/reach.h"
 
 
-int ComputeFreeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach);
-int ComputeCombinedProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach);
+/// Counts of the Newton iterations of the profiles computed with a
+/// workspace, one solve for each section of free surface.
+struct ProfileStats
+{
+    long long profiles;
+    long long solves;
+    long long iterations;
+
+    ProfileStats() : profiles(0), solves(0), iterations(0) { }
+
+    void add(const ProfileStats& other)
+    {
+        profiles += other.profiles;
+        solves += other.solves;
+        iterations += other.iterations;
+    }
+};
+
+
+/// The most profiles that ComputeProfiles computes together.
+#define PROFILE_LANES 4
+
+
+/// The arrays that a backwater profile keeps for each of its nC + 1
+/// sections.  A profile is computed thousands of times for each HPG, so a
+/// workspace is kept and reused instead of allocating the arrays each
+/// time; its memory only grows when a profile has more sections than any
+/// before it.  A workspace can only be used by one thread at a time.
+///
+/// With a warm start, the depths of the last profile are kept as the
+/// Guess of the next one if it has as many sections: each Newton solve
+/// then starts from the change in depth of the last profile over the same
+/// step, which takes fewer iterations when the profiles are close, e.g.
+/// for one downstream depth after the other.
+///
+/// The profiles that ComputeProfiles computes together each have a lane
+/// of arrays.  Each lane continues from the depths of the lane before it,
+/// and the first from the last profile, as if they had been computed one
+/// after the other.
+class ProfileWorkspace
+{
+public:
+    enum Array { X, Y, Z, V, Sf, PoG, H, Guess, ArrayCount };
+
+    ProfileWorkspace() : sections(0), warmStart(false), last(false), guess(false), lastLane(0) { }
+
+    /// Makes room for nC + 1 sections in each of count lanes and zeroes
+    /// the arrays, except for the guess.
+    void reset(int nC, int count = 1);
+
+    double* get(Array a, int lane = 0) { return &values[(lane * ArrayCount + a) * sections]; }
+    /// Set where a section stopped being empty or pressurized.
+    unsigned char* emptied(int lane = 0) { return &flags[lane * 2 * sections]; }
+    unsigned char* unpressurized(int lane = 0) { return &flags[(lane * 2 + 1) * sections]; }
+
+    void setWarmStart(bool warm) { warmStart = warm; }
+    /// Forgets the last profile, so the next one doesn't have a guess.
+    void clearGuess() { last = false; }
+    /// Makes the next profile continue from the profile of the lane
+    /// instead of the last lane, when the profiles after it are dropped.
+    void continueFrom(int lane) { lastLane = lane; }
+    /// The depths that the profile of the lane continues from, or NULL.
+    const double* getGuess(int lane = 0)
+    {
+        if (lane > 0)
+            return warmStart ? get(Y, lane - 1) : NULL;
+        return guess ? get(Guess) : NULL;
+    }
+
+    ProfileStats stats;
+
+private:
+    int sections;
+    bool warmStart;
+    bool last;
+    bool guess;
+    int lastLane;
+    std::vector<double> values;
+    std::vector<unsigned char> flags;
+};
+
+
+// If workspace is NULL, the profile uses a workspace of its own.
+int ComputeFreeProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach, ProfileWorkspace* workspace = NULL);
+int ComputeCombinedProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool isSteep, bool reverseSlope, double g, double kn, double maxDepthFrac, double& yUp, double& volume, double& hf_reach, ProfileWorkspace* workspace = NULL);
+
+/// Computes the n profiles of one flow for the downstream depths
+/// yInit[0..n), the same as ComputeCombinedProfile (or ComputeFreeProfile
+/// if freeOnly) computes them one after the other with the workspace.
+/// The profiles are computed in lockstep, one lane each (see
+/// ProfileWorkspace), so that their Newton solves and the properties of
+/// their cross sections are computed together.  A lane only takes a step
+/// after the lane before it, whose depths it continues from.  n is at most
+/// PROFILE_LANES; errors[k] is what ComputeCombinedProfile would return for
+/// profile k.
+void ComputeProfiles(const xs::Reach& reach, double flow, int n, const double* yInit, int nC, bool reverseSlope, bool freeOnly, double g, double kn, double maxDepthFrac, double* yUp, double* volume, double* hf_reach, int* errors, ProfileWorkspace& workspace);
+
+/// A mild-slope profile (free surface only if freeOnly) whose steps grow
+/// and shrink to keep the error of the upstream head under tolerance,
+/// instead of nC steps of the same length.  Steps are never shorter than
+/// length / nC, which is the length of the steps wherever the pipe empties,
+/// fills or the flow goes through a jump.  steps is set to the number of
+/// standard steps computed.  The workspace counts the Newton iterations;
+/// its arrays are only used by profiles with no flow, which are computed
+/// with fixed steps.
+int ComputeAdaptiveProfile(const xs::Reach& reach, double flow, double yInit, int nC, bool reverseSlope, bool freeOnly, double g, double kn, double maxDepthFrac, double tolerance, double& yUp, double& volume, double& hf_reach, ProfileWorkspace* workspace = NULL, int* steps = NULL);
 
 
 #endif//PROFILE_HPG_H__
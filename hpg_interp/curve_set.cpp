@@ -0,0 +1,621 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <math.h>
+
+#include "curve_set.h"
+
+
+namespace hpg
+{
+
+    CurveSet::CurveSet()
+    {
+        clear();
+    }
+
+    void CurveSet::clear()
+    {
+        flows.clear();
+        offsets.assign(1, 0);
+        x.clear();
+        y.clear();
+        v.clear();
+        hf.clear();
+        valid.clear();
+        curveFlags.clear();
+        critX.clear();
+        critY.clear();
+        critV.clear();
+        critHf.clear();
+        critValid.clear();
+        fullHf.clear();
+        desc.clear();
+        ascending = descending = true;
+        clearSplines();
+    }
+
+    void CurveSet::clearSplines()
+    {
+        slopeUs.clear();
+        slopeVol.clear();
+        slopeHf.clear();
+        usOffsets.assign(1, 0);
+        usKnots.clear();
+        usValues.clear();
+        usSlope.clear();
+        lazy.reset();
+        for (unsigned int i = 0; i < curveFlags.size(); i++)
+            curveFlags[i] &= ~Curve_Splined;
+    }
+
+    static unsigned char packValid(const point& p)
+    {
+        return (unsigned char)((p.x_valid ? Valid_X : 0) | (p.y_valid ? Valid_Y : 0) |
+            (p.v_valid ? Valid_V : 0) | (p.hf_valid ? Valid_Hf : 0));
+    }
+
+    /// Index of the last element of the ascending array kt[0..n) that is
+    /// below t, or 0 if there is none; the same as lower_bound - 1, clamped
+    /// at 0.  The search has no data-dependent branches, so scattered
+    /// queries don't pay for mispredicted branches.
+    static unsigned int lastBelow(const double* kt, unsigned int n, double t)
+    {
+        const double* base = kt;
+        while (n > 1)
+        {
+            unsigned int half = n / 2;
+            base = (base[half] < t) ? base + half : base;
+            n -= half;
+        }
+        return (unsigned int)(base - kt);
+    }
+
+    /// The same as lastBelow for a descending array: the last element
+    /// above t, or 0 if there is none.
+    static unsigned int lastAbove(const double* kt, unsigned int n, double t)
+    {
+        const double* base = kt;
+        while (n > 1)
+        {
+            unsigned int half = n / 2;
+            base = (base[half] > t) ? base + half : base;
+            n -= half;
+        }
+        return (unsigned int)(base - kt);
+    }
+
+    static point unpackPoint(double x, double y, double v, double hf, unsigned char bits)
+    {
+        point p;
+        p.x = x;
+        p.y = y;
+        p.v = v;
+        p.hf = hf;
+        p.x_valid = (bits & Valid_X) != 0;
+        p.y_valid = (bits & Valid_Y) != 0;
+        p.v_valid = (bits & Valid_V) != 0;
+        p.hf_valid = (bits & Valid_Hf) != 0;
+        return p;
+    }
+
+    void CurveSet::addCurve(double flow, const hpgvec& curve, const point& crit, double fullHf)
+    {
+        if (!flows.empty())
+        {
+            ascending = ascending && flow > flows.back();
+            descending = descending && flow < flows.back();
+        }
+        flows.push_back(flow);
+        curveFlags.push_back(0);
+
+        for (hpgvec::const_iterator it = curve.begin(); it != curve.end(); it++)
+        {
+            x.push_back(it->x);
+            y.push_back(it->y);
+            v.push_back(it->v);
+            hf.push_back(it->hf);
+            valid.push_back(packValid(*it));
+        }
+        offsets.push_back((unsigned int)x.size());
+
+        critX.push_back(crit.x);
+        critY.push_back(crit.y);
+        critV.push_back(crit.v);
+        critHf.push_back(crit.hf);
+        critValid.push_back(packValid(crit));
+        this->fullHf.push_back(fullHf);
+
+        desc.push_back(describeCurve((unsigned int)flows.size() - 1));
+    }
+
+    void CurveSet::describeCurves()
+    {
+        desc.clear();
+        for (unsigned int i = 0; i < count(); i++)
+            desc.push_back(describeCurve(i));
+    }
+
+    CurveDesc CurveSet::describeCurve(unsigned int curve) const
+    {
+        CurveDesc d = CurveDesc();
+        if (curveSize(curve) > 0)
+        {
+            unsigned int first = firstIndex(curve);
+            unsigned int last = lastIndex(curve);
+            d.firstX = x[first];
+            d.firstY = y[first];
+            d.firstV = v[first];
+            d.firstHf = hf[first];
+            d.lastX = x[last];
+            d.lastY = y[last];
+            if (x[first] > y[first])
+                d.flags |= Desc_Steep;
+            if (fullHf[curve] >= 0.0)
+                d.flags |= Desc_Surcharged;
+        }
+        d.critX = critX[curve];
+        d.critY = critY[curve];
+        return d;
+    }
+
+    /// Compute the segment slopes of a linear spline through n knots.  The
+    /// last slope repeats the previous one so that extrapolating past the
+    /// end uses the last segment.
+    static void computeSlopes(const double* t, const double* f, unsigned int n, double* slope)
+    {
+        for (unsigned int i = 0; i + 1 < n; i++)
+            slope[i] = (f[i + 1] - f[i]) / (t[i + 1] - t[i]);
+        slope[n - 1] = slope[n - 2];
+    }
+
+    /// Append the DS = f(US) spline of the n points (x, y) to the knot
+    /// arrays.  It only keeps the points where the upstream value moves by
+    /// more than a small tolerance; if fewer than two are left the spline is
+    /// null and nothing is appended.
+    static void appendUsSpline(const double* x, const double* y, unsigned int n, bool usFilterAbs,
+        std::vector<double>& knots, std::vector<double>& values, std::vector<double>& slope)
+    {
+        unsigned int usFirst = (unsigned int)knots.size();
+        double lastY = 0;
+        for (unsigned int j = 0; j < n; j++)
+        {
+            if (usFilterAbs)
+            {
+                if (j == 0 || fabs(lastY - y[j]) > 0.0001)
+                {
+                    knots.push_back(y[j]);
+                    values.push_back(x[j]);
+                }
+                lastY = y[j];
+            }
+            else if (j == 0 || (y[j] - lastY) > 0.0001)
+            {
+                lastY = y[j];
+                knots.push_back(y[j]);
+                values.push_back(x[j]);
+            }
+        }
+
+        unsigned int usN = (unsigned int)knots.size() - usFirst;
+        slope.resize(knots.size(), 0.0);
+        if (usN >= 2)
+            computeSlopes(&knots[usFirst], &values[usFirst], usN, &slope[usFirst]);
+        else
+        {
+            knots.resize(usFirst);
+            values.resize(usFirst);
+            slope.resize(usFirst);
+        }
+    }
+
+    /// The splines of one curve in lazy mode.  These hold the same values as
+    /// the curve's part of the CurveSet arrays, but the slopes are indexed by
+    /// point from the start of the curve.
+    struct CurveSplines
+    {
+        std::vector<double> slopeUs;
+        std::vector<double> slopeVol;
+        std::vector<double> slopeHf;
+        std::vector<double> usKnots;
+        std::vector<double> usValues;
+        std::vector<double> usSlope;
+    };
+
+    /// The splines of every curve of a CurveSet in lazy mode.  Each curve has
+    /// a once-flag, so the first thread to evaluate the curve builds its
+    /// splines and any other thread evaluating it meanwhile waits for them.
+    class LazySplines
+    {
+    public:
+        LazySplines(unsigned int count, bool usFilterAbs)
+            : built(0), memory(0), curves(new CurveSplines[count]),
+              once(new std::once_flag[count]), usFilterAbs(usFilterAbs)
+        {
+        }
+
+        const CurveSplines& get(const CurveSet& c, unsigned int curve)
+        {
+            std::call_once(once[curve], [&]() { build(c, curve); });
+            return curves[curve];
+        }
+
+        std::atomic<unsigned int> built;    //< number of curves built
+        std::atomic<size_t> memory;         //< bytes used by the built curves
+
+    private:
+        std::unique_ptr<CurveSplines[]> curves;
+        std::unique_ptr<std::once_flag[]> once;
+        bool usFilterAbs;
+
+        void build(const CurveSet& c, unsigned int curve)
+        {
+            CurveSplines& s = curves[curve];
+            unsigned int first = c.offsets[curve];
+            unsigned int n = c.offsets[curve + 1] - first;
+
+            // Curves without enough points get null splines, as in
+            // CurveSet::setupSplines.
+            s.slopeUs.assign(n, 0.0);
+            s.slopeVol.assign(n, 0.0);
+            s.slopeHf.assign(n, 0.0);
+            if (n >= 2)
+            {
+                computeSlopes(&c.x[first], &c.y[first], n, &s.slopeUs[0]);
+                computeSlopes(&c.x[first], &c.v[first], n, &s.slopeVol[0]);
+                computeSlopes(&c.x[first], &c.hf[first], n, &s.slopeHf[0]);
+                appendUsSpline(&c.x[first], &c.y[first], n, usFilterAbs, s.usKnots, s.usValues, s.usSlope);
+            }
+
+            memory += sizeof(double) * (3 * s.slopeUs.size() + 3 * s.usKnots.size());
+            built++;
+        }
+    };
+
+    void CurveSet::setupSplines(bool usFilterAbs, bool onFirstUse)
+    {
+        clearSplines();
+
+        if (onFirstUse)
+        {
+            // Only say which curves have splines; LazySplines builds them.
+            lazy = std::make_shared<LazySplines>(count(), usFilterAbs);
+            for (unsigned int i = 0; i < count(); i++)
+            {
+                if (curveSize(i) >= 2)
+                    curveFlags[i] |= Curve_Splined;
+            }
+            return;
+        }
+
+        slopeUs.resize(x.size(), 0.0);
+        slopeVol.resize(x.size(), 0.0);
+        slopeHf.resize(x.size(), 0.0);
+        usKnots.reserve(x.size());
+        usValues.reserve(x.size());
+
+        for (unsigned int i = 0; i < count(); i++)
+        {
+            unsigned int first = offsets[i];
+            unsigned int n = offsets[i + 1] - first;
+
+            // Curves without enough points get null splines.
+            if (n >= 2)
+            {
+                computeSlopes(&x[first], &y[first], n, &slopeUs[first]);
+                computeSlopes(&x[first], &v[first], n, &slopeVol[first]);
+                computeSlopes(&x[first], &hf[first], n, &slopeHf[first]);
+                appendUsSpline(&x[first], &y[first], n, usFilterAbs, usKnots, usValues, usSlope);
+
+                curveFlags[i] |= Curve_Splined;
+            }
+
+            usOffsets.push_back((unsigned int)usKnots.size());
+        }
+    }
+
+    unsigned int CurveSet::builtCount() const
+    {
+        if (lazy)
+            return lazy->built;
+
+        unsigned int n = 0;
+        for (unsigned int i = 0; i < curveFlags.size(); i++)
+        {
+            if (curveFlags[i] & Curve_Splined)
+                n++;
+        }
+        return n;
+    }
+
+    size_t CurveSet::splineMemory() const
+    {
+        if (lazy)
+            return lazy->memory;
+
+        return sizeof(double) * (slopeUs.size() + slopeVol.size() + slopeHf.size() +
+            usKnots.size() + usValues.size() + usSlope.size()) +
+            sizeof(unsigned int) * (usOffsets.size() - 1);
+    }
+
+    point CurveSet::pointAt(unsigned int index) const
+    {
+        return unpackPoint(x[index], y[index], v[index], hf[index], valid[index]);
+    }
+
+    point CurveSet::critAt(unsigned int curve) const
+    {
+        return unpackPoint(critX[curve], critY[curve], critV[curve], critHf[curve], critValid[curve]);
+    }
+
+    int CurveSet::lowerBracket(double flow, bool adverse, CurveHints* hints) const
+    {
+        if (!hints)
+            return searchBracket(flow, adverse);
+
+        int n = (int)flows.size();
+        const double* f = n ? &flows[0] : NULL;
+
+        bool ordered = adverse ? descending : ascending;
+
+        // Check the last result first: with ordered flows, curve h is the
+        // answer if it is below the flow and the next curve isn't.
+        int h = hints->flow;
+        if (ordered && h >= -1 && h < n)
+        {
+            bool belowH = (h == -1) || (adverse ? f[h] > flow : f[h] < flow);
+            bool belowNext = (h + 1 < n) && (adverse ? f[h + 1] > flow : f[h + 1] < flow);
+            if (belowH && !belowNext)
+                return h;
+        }
+
+        int index = searchBracket(flow, adverse);
+        hints->flow = index;
+        return index;
+    }
+
+    int CurveSet::searchBracket(double flow, bool adverse) const
+    {
+        int n = (int)flows.size();
+        if (n == 0)
+            return -1;
+        const double* f = &flows[0];
+
+        if (adverse ? descending : ascending)
+        {
+            if (adverse)
+                return (f[0] > flow) ? (int)lastAbove(f, n, flow) : -1;
+            else
+                return (f[0] < flow) ? (int)lastBelow(f, n, flow) : -1;
+        }
+
+        // Unordered flows; fall back to scanning.
+        int index = -1;
+        for (int i = 0; i < n && (adverse ? f[i] > flow : f[i] < flow); i++)
+            index = i;
+        return index;
+    }
+
+    unsigned int CurveSet::findSegment(const double* kt, unsigned int n, double t, unsigned int curve, CurveHints* hints) const
+    {
+        // The knot kt[idx] immediately below t, for kt[0] <= t <= kt[n-1].
+        // Try the last segment used and its neighbours before searching.
+        if (!hints)
+            return lastBelow(kt, n, t);
+        if (hints->seg.size() < flows.size())
+            hints->seg.resize(flows.size(), 0);
+
+        unsigned int& hint = hints->seg[curve];
+        unsigned int h = hint;
+        if (h + 1 < n && kt[h] < t && t <= kt[h + 1])
+            return h;
+        if (h + 2 < n && kt[h + 1] < t && t <= kt[h + 2])
+            return (hint = h + 1);
+        if (h >= 1 && h < n && kt[h - 1] < t && t <= kt[h])
+            return (hint = h - 1);
+
+        hint = lastBelow(kt, n, t);
+        return hint;
+    }
+
+    unsigned int CurveSet::splineSize(unsigned int curve, CurveSpline which) const
+    {
+        if (curve >= curveFlags.size() || !(curveFlags[curve] & Curve_Splined))
+            return 0;
+        if (which == Spl_DS_US)
+        {
+            if (lazy)
+                return (unsigned int)lazy->get(*this, curve).usKnots.size();
+            return usOffsets[curve + 1] - usOffsets[curve];
+        }
+        return offsets[curve + 1] - offsets[curve];
+    }
+
+    double CurveSet::evalSpline(unsigned int curve, CurveSpline which, double t, CurveHints* hints, double* slopeAt) const
+    {
+        unsigned int start, n;
+        const double* kt;
+        const double* kf;
+        const double* slope;
+
+        const CurveSplines* s = lazy ? &lazy->get(*this, curve) : NULL;
+
+        if (which == Spl_DS_US)
+        {
+            if (s)
+            {
+                n = (unsigned int)s->usKnots.size();
+                kt = s->usKnots.data();
+                kf = s->usValues.data();
+                slope = s->usSlope.data();
+            }
+            else
+            {
+                start = usOffsets[curve];
+                n = usOffsets[curve + 1] - start;
+                kt = &usKnots[start];
+                kf = &usValues[start];
+                slope = &usSlope[start];
+            }
+        }
+        else
+        {
+            start = offsets[curve];
+            n = offsets[curve + 1] - start;
+            kt = &x[start];
+            if (which == Spl_US_DS)
+            {
+                kf = &y[start];
+                slope = s ? s->slopeUs.data() : &slopeUs[start];
+            }
+            else if (which == Spl_Vol)
+            {
+                kf = &v[start];
+                slope = s ? s->slopeVol.data() : &slopeVol[start];
+            }
+            else
+            {
+                kf = &hf[start];
+                slope = s ? s->slopeHf.data() : &slopeHf[start];
+            }
+        }
+
+        // Find the closest knot kt[idx] < t, idx=0 even if t < kt[0].  Past
+        // either end this extrapolates along the end segment.
+        unsigned int idx;
+        if (t < kt[0])
+            idx = 0;
+        else if (t > kt[n - 1])
+            idx = n - 1;
+        else if (which == Spl_DS_US)
+            idx = lastBelow(kt, n, t);
+        else
+            idx = findSegment(kt, n, t, curve, hints);
+
+        if (slopeAt)
+            *slopeAt = slope[idx];
+        return slope[idx] * (t - kt[idx]) + kf[idx];
+    }
+
+    void CurveSet::evalDsSplines(unsigned int curve, double ds, double& us, double& vol, double& hf, CurveHints* hints, double* slopes) const
+    {
+        unsigned int start = offsets[curve];
+        unsigned int n = offsets[curve + 1] - start;
+        const double* kt = &x[start];
+
+        unsigned int idx;
+        if (ds < kt[0])
+            idx = 0;
+        else if (ds > kt[n - 1])
+            idx = n - 1;
+        else
+            idx = findSegment(kt, n, ds, curve, hints);
+
+        evalDsSegment(curve, start + idx, ds, us, vol, hf, slopes);
+    }
+
+    unsigned int CurveSet::dsSegment(unsigned int curve, double ds) const
+    {
+        // lastBelow also covers the extrapolation past either end: it gives
+        // the first knot below kt[0] and the last knot above kt[n-1].
+        unsigned int start = offsets[curve];
+        return start + lastBelow(&x[start], offsets[curve + 1] - start, ds);
+    }
+
+    void CurveSet::evalDsSegment(unsigned int curve, unsigned int seg, double ds, double& us, double& vol, double& hf, double* slopes) const
+    {
+        double h = ds - x[seg];
+
+        // Past the end of the curve the pipe is full: the upstream is the
+        // downstream plus the friction loss, and the rest stays put.
+        if (h > 0.0 && seg + 1 == offsets[curve + 1] && fullHf[curve] >= 0.0)
+        {
+            us = ds + fullHf[curve];
+            vol = v[seg];
+            hf = fullHf[curve];
+            if (slopes)
+            {
+                slopes[0] = 1.0;
+                slopes[1] = 0.0;
+                slopes[2] = 0.0;
+            }
+            return;
+        }
+
+        const double* su;
+        const double* sv;
+        const double* sh;
+        if (lazy)
+        {
+            const CurveSplines& s = lazy->get(*this, curve);
+            unsigned int k = seg - offsets[curve];
+            su = &s.slopeUs[k];
+            sv = &s.slopeVol[k];
+            sh = &s.slopeHf[k];
+        }
+        else
+        {
+            su = &slopeUs[seg];
+            sv = &slopeVol[seg];
+            sh = &slopeHf[seg];
+        }
+
+        us = *su * h + y[seg];
+        vol = *sv * h + v[seg];
+        hf = *sh * h + this->hf[seg];
+        if (slopes)
+        {
+            slopes[0] = *su;
+            slopes[1] = *sv;
+            slopes[2] = *sh;
+        }
+    }
+
+}
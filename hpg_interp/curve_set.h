@@ -0,0 +1,264 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#ifndef __CURVE_SET_H______________________20161012093512__
+#define __CURVE_SET_H______________________20161012093512__
+
+#include <vector>
+#include <memory>
+
+#include "point.h"
+#include "types.h"
+
+
+namespace hpg
+{
+    /// The splines that are kept for every curve.
+    enum CurveSpline
+    {
+        Spl_US_DS = 0,      //< US = f(DS)
+        Spl_Vol,            //< Volume = f(DS)
+        Spl_Hf,             //< Hf = f(DS)
+        Spl_DS_US,          //< DS = f(US)
+        Spl_Count,
+    };
+
+    /// Bits in CurveSet::valid, one set per point.  These mirror the
+    /// *_valid members of hpg::point.
+    enum PointValid
+    {
+        Valid_X  = 0x1,
+        Valid_Y  = 0x2,
+        Valid_V  = 0x4,
+        Valid_Hf = 0x8,
+    };
+
+    /// Bits in CurveSet::curveFlags, one set per curve.
+    enum CurveFlag
+    {
+        Curve_Splined = 0x1,    //< the splines of this curve have been set up
+    };
+
+    /// Bits in CurveDesc::flags.
+    enum CurveDescFlag
+    {
+        Desc_Steep = 0x1,       //< the first point is below the critical upstream (x > y)
+        Desc_Surcharged = 0x2,  //< the pipe is full past the last point (see CurveSet::fullHf)
+    };
+
+    /// What the queries need to know about one curve, worked out once when
+    /// the curve is added: its end points (the downstream range of its
+    /// splines is [firstX, lastX]), critical point and steepness.  Looking
+    /// these up costs one cache line per curve instead of unpacking points.
+    struct CurveDesc
+    {
+        double firstX;
+        double firstY;
+        double firstV;
+        double firstHf;
+        double lastX;
+        double lastY;
+        double critX;
+        double critY;
+        unsigned int flags;     //< CurveDescFlag bits
+    };
+
+    class LazySplines;
+
+    /// Lookup hints for the queries on one CurveSet.  Flows and downstream
+    /// depths change slowly from one query to the next, so the last bracket
+    /// found is checked first.  The hints are kept by the caller rather
+    /// than the set, so that a set can be searched from several threads,
+    /// each with its own hints (or none).
+    struct CurveHints
+    {
+        int flow;                           //< last result of lowerBracket
+        std::vector<unsigned int> seg;      //< last knot segment used on each curve
+
+        CurveHints() : flow(-1) {}
+    };
+
+    /**
+    * Contiguous storage for all of the curves in one flow direction
+    * (positive or adverse) of a HPG.
+    *
+    * Curve i owns the points [offsets[i], offsets[i+1]) of the x/y/v/hf
+    * arrays.  The curve splines are the same piecewise-linear splines that
+    * tk::spline builds with cubic_spline=false, so the only coefficient
+    * per knot is the slope of the segment to its right (the last knot
+    * repeats the slope of the last segment, for extrapolation).
+    *
+    * The US, volume and hf splines are knotted at the downstream values,
+    * so their slopes are indexed the same as the points.  The DS = f(US)
+    * spline drops points that don't rise, so it has its own knots in
+    * [usOffsets[i], usOffsets[i+1]).
+    *
+    * A curve with a full-pipe friction loss (fullHf >= 0) ends where the
+    * pipe becomes full from end to end.  Past its last point the upstream
+    * is the downstream plus that loss, and the volume and hf don't change,
+    * so the splines are replaced by that closed form there rather than
+    * being extrapolated.
+    *
+    * In lazy mode the coefficient arrays stay empty.  Instead each curve
+    * gets its own coefficients the first time one of its splines is
+    * evaluated, so only the curves that the queries actually reach cost
+    * anything.  Curve_Splined still says which curves have splines.
+    */
+    class CurveSet
+    {
+    public:
+        std::vector<double> flows;              //< flow for each curve
+        std::vector<unsigned int> offsets;      //< start of each curve in the point arrays, plus the end
+        std::vector<double> x;                  //< downstream values
+        std::vector<double> y;                  //< upstream values
+        std::vector<double> v;                  //< volumes
+        std::vector<double> hf;                 //< friction losses
+        std::vector<unsigned char> valid;       //< PointValid bits for each point
+        std::vector<unsigned char> curveFlags;  //< CurveFlag bits for each curve
+        std::vector<double> critX;              //< critical (first) point of each curve
+        std::vector<double> critY;
+        std::vector<double> critV;
+        std::vector<double> critHf;
+        std::vector<unsigned char> critValid;
+        std::vector<double> fullHf;             //< friction loss of each curve once the pipe is full, or < 0
+        std::vector<CurveDesc> desc;            //< descriptor of each curve
+
+        std::vector<double> slopeUs;            //< slopes of US = f(DS), per point
+        std::vector<double> slopeVol;           //< slopes of Volume = f(DS), per point
+        std::vector<double> slopeHf;            //< slopes of Hf = f(DS), per point
+        std::vector<unsigned int> usOffsets;    //< start of each DS = f(US) spline, plus the end
+        std::vector<double> usKnots;            //< upstream knots of DS = f(US)
+        std::vector<double> usValues;           //< downstream values of DS = f(US)
+        std::vector<double> usSlope;            //< slopes of DS = f(US)
+
+        bool ascending;                         //< flows are strictly increasing
+        bool descending;                        //< flows are strictly decreasing
+
+        CurveSet();
+
+        void clear();
+        void clearSplines();
+
+        /// Append a curve and its critical point.  If fullHf >= 0 the pipe
+        /// is full past the last point of the curve, with this friction loss.
+        void addCurve(double flow, const hpgvec& curve, const point& crit, double fullHf = -1.0);
+
+        /// Work out the descriptors of every curve again, after the point
+        /// arrays have been filled in directly.
+        void describeCurves();
+
+        /// Set up the splines of every curve.  usFilterAbs selects how the
+        /// DS = f(US) knots are thinned (see setupPosSplines/setupAdvSplines).
+        /// If onFirstUse, the splines of each curve are only built the first
+        /// time the curve is evaluated.
+        void setupSplines(bool usFilterAbs, bool onFirstUse = false);
+
+        /// Say if the splines are built on first use.
+        bool isLazy() const { return lazy != NULL; }
+        /// Number of curves whose splines have been built.
+        unsigned int builtCount() const;
+        /// Bytes used by the spline coefficients built so far.
+        size_t splineMemory() const;
+
+        /// Index of the curve immediately below the given flow: the last of
+        /// the leading curves whose flow is below 'flow' (above it when
+        /// adverse), or -1 if there is none.  Uses a binary search when the
+        /// flows are ordered, and the last result as a hint if 'hints'
+        /// isn't NULL.
+        int lowerBracket(double flow, bool adverse, CurveHints* hints) const;
+
+        /// The same as lowerBracket, without the hint.  This is cheaper for
+        /// scattered flows, where the hint rarely matches.
+        int searchBracket(double flow, bool adverse) const;
+
+        unsigned int count() const { return (unsigned int)flows.size(); }
+        unsigned int curveSize(unsigned int curve) const { return offsets[curve + 1] - offsets[curve]; }
+        unsigned int firstIndex(unsigned int curve) const { return offsets[curve]; }
+        unsigned int lastIndex(unsigned int curve) const { return offsets[curve + 1] - 1; }
+
+        point pointAt(unsigned int index) const;
+        point critAt(unsigned int curve) const;
+
+        /// Number of knots in the spline, 0 for a null spline.
+        unsigned int splineSize(unsigned int curve, CurveSpline which) const;
+
+        /// Evaluate spline 'which' of the given curve at t.  This gives the
+        /// same results as tk::spline, including the linear extrapolation
+        /// past either end.  The segment hints are used and updated if
+        /// 'hints' isn't NULL.  If 'slope' isn't NULL it receives the slope
+        /// of the spline at t.
+        double evalSpline(unsigned int curve, CurveSpline which, double t, CurveHints* hints = NULL, double* slope = NULL) const;
+
+        /// Evaluate the US, volume and hf splines of the given curve at the
+        /// downstream value ds.  They share their knots, so the segment is
+        /// only looked up once.  If 'slopes' isn't NULL it receives the
+        /// slopes of the three splines at ds, in the same order.  Past the
+        /// end of a curve with a full-pipe friction loss this is the closed
+        /// form instead, without a search.
+        void evalDsSplines(unsigned int curve, double ds, double& us, double& vol, double& hf, CurveHints* hints = NULL, double* slopes = NULL) const;
+
+        /// The point index of the segment of the US, volume and hf splines
+        /// of the given curve that ds falls in, without using the hint.
+        unsigned int dsSegment(unsigned int curve, double ds) const;
+
+        /// Evaluate the US, volume and hf splines of the given curve at ds on
+        /// the segment that starts at point index 'seg' (from dsSegment).
+        void evalDsSegment(unsigned int curve, unsigned int seg, double ds, double& us, double& vol, double& hf, double* slopes = NULL) const;
+
+    private:
+        /// The per-curve splines of lazy mode, or NULL.  Copies of the set
+        /// share them, since they have the same points.
+        std::shared_ptr<LazySplines> lazy;
+
+        CurveDesc describeCurve(unsigned int curve) const;
+        unsigned int findSegment(const double* kt, unsigned int n, double t, unsigned int curve, CurveHints* hints) const;
+    };
+}
+
+
+#endif//__CURVE_SET_H______________________20161012093512__
@@ -56,6 +56,7 @@ namespace hpg
     Hpg::Hpg()
     {
         impl = new Impl();
+        impl->lazySplines = false;
         initialize();
     }
 
@@ -95,23 +96,14 @@ namespace hpg
     //    return impl->advValues.at(f);
     //}
 
-    bool Hpg::isCurveSteep(unsigned int curve)
+    void Hpg::AddCurve(double flow, hpgvec& curve, point crit, double fullHf)
     {
-        point p = impl->posValues.at(curve).at(0);
-        if (p.x <= p.y)
-            return false;
-        else
-            return true;
-    }
+        // The lookup table no longer matches the curves.
+        impl->grid.reset();
 
-    void Hpg::AddCurve(double flow, hpgvec& curve, point crit)
-    {
         if (flow >= -1e-6)
         {
-            impl->posFlowCount++;
-            impl->posFlows.push_back(flow);
-            impl->posValues.push_back(curve);
-            impl->posCritical.push_back(crit);
+            impl->pos.addCurve(flow, curve, crit, fullHf);
             if (flow < impl->minPosFlow)
                 impl->minPosFlow = flow;
             if (flow > impl->maxPosFlow)
@@ -119,10 +111,7 @@ namespace hpg
         }
         else
         {
-            impl->advFlowCount++;
-            impl->advFlows.push_back(flow);
-            impl->advValues.push_back(curve);
-            impl->advCritical.push_back(crit);
+            impl->adv.addCurve(flow, curve, crit, fullHf);
             if (flow > impl->minAdvFlow)
                 impl->minAdvFlow = flow;
             if (flow < impl->maxAdvFlow)
@@ -154,13 +143,16 @@ namespace hpg
         impl->maxAdvFlow = 0.0;
         impl->minAdvFlow = -1000000.0;
         //    minPosFlow = maxPosFlow = minAdvFlow = maxAdvFlow = 0.0;
-        impl->posFlowCount = impl->advFlowCount = 0;
+        impl->pos.clear();
+        impl->adv.clear();
+        impl->grid.reset();
 
         impl->dsInvertValid = impl->usInvertValid = impl->dsStationValid = impl->usStationValid =
             impl->slopeValid = impl->lengthValid = impl->roughnessValid = impl->maxDepthValid = impl->unsteadyDepthPctValid = false;
         impl->dsInvert = impl->usInvert = impl->dsStation = impl->usStation = impl->slope =
             impl->length = impl->roughness = impl->maxDepth = impl->unsteadyDepthPct = 0.0;
         impl->nodeId = "";
+        impl->sourceHash = "";
         impl->version = 2;
     }
 
@@ -169,32 +161,8 @@ namespace hpg
         impl->copyFrom(copy.impl);
 
         // Erase all the splines.  We recreate them in setupSplines below.
-        //for (unsigned int i = 0; i < SplPosUS_QDS.size(); i++)
-        //    if (SplPosUS_QDS.at(i) != NULL)
-        //        gsl_spline_free(SplPosUS_QDS.at(i));
-        impl->SplPosUS_QDS.clear();
-
-        //for (unsigned int i = 0; i < SplAdvUS_QDS.size(); i++)
-        //    if (SplAdvUS_QDS.at(i) != NULL)
-        //        gsl_spline_free(SplAdvUS_QDS.at(i));
-        impl->SplAdvUS_QDS.clear();
-
-        impl->SplPosDS_QUS.clear();
-        impl->SplAdvDS_QUS.clear();
-
-        //for (unsigned int i = 0; i < SplPosVol.size(); i++)
-        //    if (SplPosVol.at(i) != NULL)
-        //        gsl_spline_free(SplPosVol.at(i));
-		impl->SplPosVol.clear();
-
-		impl->SplPosHf.clear();
-
-        //for (unsigned int i = 0; i < SplAdvVol.size(); i++)
-        //    if (SplAdvVol.at(i) != NULL)
-        //        gsl_spline_free(SplAdvVol.at(i));
-		impl->SplAdvVol.clear();
-
-		impl->SplAdvHf.clear();
+        impl->pos.clearSplines();
+        impl->adv.clearSplines();
 
         //for (unsigned int i = 0; i < SplPosCritUS_DS.size(); i++)
         //    if (SplPosCritUS_DS.at(i) != NULL)
@@ -213,7 +181,7 @@ namespace hpg
         //if (SplAdvCritUS_Q != NULL)
         //    gsl_spline_free(SplAdvCritUS_Q);
 
-        if (impl->posFlowCount || impl->advFlowCount)
+        if (impl->pos.count() || impl->adv.count())
             setupSplines();
     }
 
@@ -248,6 +216,16 @@ namespace hpg
         impl->nodeId = id;
     }
 
+    std::string Hpg::getSourceHash()
+    {
+        return impl->sourceHash;
+    }
+
+    void Hpg::setSourceHash(std::string hash)
+    {
+        impl->sourceHash = hash;
+    }
+
     bool Hpg::isUsInvertValid()
     {
         return impl->usInvertValid;
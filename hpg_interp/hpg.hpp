@@ -51,6 +51,9 @@
 #ifndef HPG_HPP___________________________20040831173030__
 #define HPG_HPP___________________________20040831173030__
 
+#include <string>
+#include <vector>
+
 #include "../api.h"
 
 #include "point.h"
@@ -60,6 +63,7 @@
 // Begin wrapping code in the HPG namespace
 namespace hpg
 {
+    struct CurveHints;
 
     /**
     * A class for reading, writing, and interpolating HPGs.
@@ -69,6 +73,16 @@ namespace hpg
     *
     * Interpolation splines (functions) are created when the file
     * is loaded.
+    *
+    * Thread safety: the Query* functions are const and reentrant.  They
+    * return their status rather than setting the error code, and write
+    * nothing in the Hpg (lazy splines are built once, under a lock), so
+    * any number of threads may query the same Hpg at once.  This holds as
+    * long as no thread changes the Hpg at the same time: loading,
+    * AddCurve, Compile, SetLazySplines and the setters must not run
+    * alongside queries.  The Interp* functions keep lookup hints and the
+    * error code in the Hpg, so they are only for use by one thread at a
+    * time.
     */
     class Hpg
     {
@@ -89,6 +103,36 @@ namespace hpg
         * @return true if successful, false otherwise
         */
         bool SaveToFile(const std::string& path, bool append = false);
+        /** Load only the header attributes of a HPG (e.g. its source hash),
+        * without reading the curves of a text HPG.  Replaces any curves
+        * already loaded.
+        * @param file HPG file to load as string
+        * @return true if successful, false otherwise
+        */
+        bool LoadHeaderFromFile(const std::string& path);
+        /** Load a HPG saved by SaveBinary.  The file is mapped and the curves
+        * and spline coefficients are copied out as they are, so nothing is
+        * parsed and the splines aren't set up again (with lazy splines the
+        * stored ones are dropped instead).  Replaces any curves already
+        * loaded.
+        * @param file          binary HPG file to load as string
+        * @param setupSplines  set up the splines if the file has none
+        * @return true if successful, false otherwise
+        */
+        bool LoadBinary(const std::string& path, bool splineSetup = true);
+        /** Save a HPG, including its spline coefficients, in the binary
+        * format read by LoadBinary.
+        * @param file binary HPG file to save as string
+        * @return true if successful, false otherwise
+        */
+        bool SaveBinary(const std::string& path);
+        // The same as LoadBinary, for a binary HPG that is already in memory
+        // (e.g. part of a larger file).  The data must be 8-byte aligned.
+        bool LoadBinaryData(const void* data, size_t size, bool splineSetup = true);
+        // The same as SaveBinary, into memory.
+        bool SaveBinaryData(std::vector<char>& data);
+        // Say if the file is a binary HPG (starts with the binary magic number).
+        static bool IsBinaryFile(const std::string& path);
 
         // ACCESSOR FUNCTIONS
 
@@ -99,13 +143,120 @@ namespace hpg
         // Determine if curve is mild-slope.
         //bool IsMildAt(unsigned int curve);
         // Add a curve to the HPG. Automatically determines if pos or adverse.
-        void AddCurve(double flow, hpgvec& curve, point crit);
+        // If fullHf >= 0, the pipe is full past the last point of the curve
+        // and the upstream there is the downstream plus fullHf.
+        void AddCurve(double flow, hpgvec& curve, point crit, double fullHf = -1.0);
 
         // INTERPOLATION FUNCTIONS
 
+        /** Interpolate several values for a (flow, downstream) pair at once.
+        * The bracketing curves and the region of the HPG are only found once,
+        * so this is cheaper than calling InterpUpstreamHead, InterpVolume and
+        * InterpHf separately.
+        * @param flow        flow
+        * @param downstream  downstream head
+        * @param result      receives the values selected by 'what'
+        * @param what        InterpFlag bits of the values to compute
+        * @return S_OK if successful, an error code otherwise
+        */
+        int Interp(double flow, double downstream, InterpResult& result, unsigned int what = InterpFlag_All);
+        /** The same as Interp, also giving the partial derivatives of the
+        * values with respect to the flow and the downstream head.  These are
+        * exact for the interpolation (which is piecewise linear), worked
+        * out from the spline slopes and the blend between the curves, and
+        * cost very little on top of the values.  The lookup table of a
+        * compiled HPG isn't used.
+        * @param slopes  receives the derivatives of the values selected by 'what'
+        */
+        int Interp(double flow, double downstream, InterpResult& result, InterpSlopes& slopes, unsigned int what = InterpFlag_All);
         int InterpUpstreamHead(double flow, double downstream, double& result);
 		int InterpVolume(double flow, double downstream, double& volume);
 		int InterpHf(double flow, double downstream, double& value);
+
+        /** Interpolate a batch of (flow, downstream) pairs.  This gives the
+        * same values as calling Interp for each pair, including from the
+        * lookup table of a compiled HPG, but is several times faster for
+        * large batches.
+        * @param flow        array of n flows
+        * @param downstream  array of n downstream heads
+        * @param results     array of n results
+        * @param status      array of n statuses, one for each pair (may be NULL)
+        * @param n           number of pairs
+        * @param what        InterpFlag bits of the values to compute
+        * @return S_OK if every pair succeeded, else the error code of the first failed pair
+        */
+        int InterpBatch(const double* flow, const double* downstream, InterpResult* results, int* status, size_t n, unsigned int what = InterpFlag_All);
+        int InterpUpstreamHeadBatch(const double* flow, const double* downstream, double* result, int* status, size_t n);
+        int InterpVolumeBatch(const double* flow, const double* downstream, double* result, int* status, size_t n);
+        int InterpHfBatch(const double* flow, const double* downstream, double* result, int* status, size_t n);
+
+        /** The same as Interp, but safe to call from several threads at once
+        * (see the class notes).  The error code of the Hpg is left alone, so
+        * the status returned is the only report of an error, and no lookup
+        * hints are kept, so a run of nearby queries from one thread is a
+        * little slower than with Interp.  The values are exactly the same.
+        * @param flow        flow
+        * @param downstream  downstream head
+        * @param result      receives the values selected by 'what'
+        * @param what        InterpFlag bits of the values to compute
+        * @return S_OK if successful, an error code otherwise
+        */
+        int Query(double flow, double downstream, InterpResult& result, unsigned int what = InterpFlag_All) const;
+        int Query(double flow, double downstream, InterpResult& result, InterpSlopes& slopes, unsigned int what = InterpFlag_All) const;
+        int QueryUpstreamHead(double flow, double downstream, double& result) const;
+        int QueryVolume(double flow, double downstream, double& volume) const;
+        int QueryHf(double flow, double downstream, double& value) const;
+        // The same as InterpBatch, but safe to call from several threads at once.
+        int QueryBatch(const double* flow, const double* downstream, InterpResult* results, int* status, size_t n, unsigned int what = InterpFlag_All) const;
+
+        /** Compile the HPG into a lookup table that Interp, Query and the
+        * batch functions (and the InterpUpstreamHead, InterpVolume and
+        * InterpHf wrappers) then use instead of the splines wherever the
+        * table is within the error bounds of the splines.  The table
+        * resolution is chosen to meet the bounds.  Only the queries for
+        * derivatives always use the splines.
+        * @param maxHeadError    largest allowed upstream head and hf error
+        * @param maxVolumeError  largest allowed volume error, as a fraction of
+        *                        the largest volume between the bracketing curves
+        * @return S_OK if successful, an error code otherwise
+        */
+        int Compile(double maxHeadError, double maxVolumeError = 0.001);
+        // Say if Compile has been called since the HPG was loaded.
+        bool IsCompiled();
+        // Get the achieved error and size of the table.  Returns false if the HPG isn't compiled.
+        bool getCompileStats(CompileStats& stats);
+
+        /** Make the HPG smaller by removing the points that the lines between
+        * their neighbours reproduce, then the curves that blending the
+        * curves either side of them reproduces, for as long as Query stays
+        * within the tolerances of what it gave before.  Half of the
+        * tolerances go to the points and the rest to the curves.  The first
+        * and last curves, and the first and last points of each curve, are
+        * always kept.  Flows that aren't in order are left alone.  Drops the
+        * lookup table of a compiled HPG and clears the source hash, since
+        * the HPG is no longer what its reach and settings create.
+        * @param maxHeadError    largest allowed upstream head and hf change
+        * @param maxVolumeError  largest allowed volume change, as a fraction of
+        *                        the largest volume between the bracketing curves
+        * @param stats           receives the sizes before and after and the
+        *                        largest changes measured (may be NULL)
+        * @return S_OK if successful, an error code otherwise
+        */
+        int Thin(double maxHeadError, double maxVolumeError = 0.001, ThinStats* stats = NULL);
+
+        /** Build the splines of each curve the first time the curve is
+        * interpolated, instead of for every curve when the HPG is loaded.
+        * Loading is then cheaper, and only the curves bracketing the flows
+        * actually seen take up memory for their splines.  This is kept for
+        * later loads, and applies straight away to the curves already
+        * loaded.  Compile builds the splines of every curve.
+        * @param lazy  true to build the splines on first use
+        */
+        void SetLazySplines(bool lazy);
+        // Say if the splines are built on first use.
+        bool IsLazySplines();
+        // Get the number of curves whose splines have been built so far.
+        void getSplineStats(SplineStats& stats);
         //int GetCritUpstream(double flow, double& result) = 0;
         //int GetCritDownstream(double flow, double& result) = 0;
         //int GetCritUpFromDown(double flow, double downstream, double& result);
@@ -147,6 +298,11 @@ namespace hpg
         void setMaxDepthFraction(double maxdepth);
         std::string getNodeId();
         void setNodeId(std::string id);
+        // A hash of the reach and settings the HPG was created from (see
+        // HpgCreator::getSourceHash), so that a HPG can be recreated only
+        // when they change.  Empty if unknown.
+        std::string getSourceHash();
+        void setSourceHash(std::string hash);
 
         // Returns -1 if the HPG is not versioned, otherwise returns > 0
         int getVersion();
@@ -155,20 +311,22 @@ namespace hpg
         class Impl;
         Impl* impl;
 
+        // Thin sets up a HPG for each bracket it checks (hpg_thin.cpp).
+        friend struct ThinBracket;
+
 
     private:
         //double PosFlowAt(unsigned int f);
         //double AdvFlowAt(unsigned int f);
 
-        // Determine if curve is steep-slope. negative = steep, positive = mild, 0 = error
-        bool isCurveSteep(unsigned int curve);
         //int GetLastPoint(double flow, point& result);
-        int findLowerBracketingCurve(double flow, unsigned int& index);
+        // The query helpers are const and return their status without
+        // setting the error code.  'hints' (NULL for none) are the lookup
+        // hints for the direction of the flow.
+        int findLowerBracketingCurve(double flow, unsigned int& index, CurveHints* hints) const;
         //int FindMatchingFlowIndex(double flow, unsigned int& index);
-        bool isValidFlow(double flow);
-		int isValidFlowExtended(double flow);
-        int getFirstPointOnCurve(double flow, unsigned int curve, point& result);
-        int getLastPointOnCurve(double flow, unsigned int curve, point& result);
+        bool isValidFlow(double flow, CurveHints* hints) const;
+		int isValidFlowExtended(double flow, CurveHints* hints) const;
         //hpgvec& GetPosCritical();
         //hpgvec& GetAdvCritical();
         int setupSplines();
@@ -180,11 +338,15 @@ namespace hpg
         bool loadHeader(std::ifstream& fh);
         //void PostLoadActions();
 
-        int standardInterpolation(unsigned int curve, double flow, double input, double& result, InterpValue interpAction = Interp_Upstream);
-        int standardExtrapolation(unsigned int curve, double flow, double downstream, double& result);
-        int interpolateSteepSpecial(unsigned int curve, double flow, double downstream, double& result);
-		double linearInterpQ(double flow, double f1, double f2, double y1, double y2);
-		double linearInterp(double x, double x1, double y1, double x2, double y2);
+        int interp(double flow, double downstream, InterpResult& result, unsigned int what, CurveHints* hints, InterpSlopes* slopes) const;
+        unsigned int bracketKey(double flow, unsigned int invalidKey) const;
+        int interpBatch(const double* flow, const double* downstream, size_t n, unsigned int what,
+            InterpResult* results, double* values, int* status) const;
+
+        int standardExtrapolation(unsigned int curve, double flow, double downstream, double& result, double* flowSlope = NULL) const;
+        int interpolateSteepSpecial(unsigned int curve, double flow, double downstream, double& result, CurveHints* hints, double* dsSlope = NULL) const;
+		double linearInterpQ(double flow, double f1, double f2, double y1, double y2) const;
+		double linearInterp(double x, double x1, double y1, double x2, double y2) const;
         int setupPosSplines();
         int setupAdvSplines();
         int setupCritPosSplines();
@@ -0,0 +1,506 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#pragma warning(disable : 4786) //disable warnings on identifier truncated to 255 chars
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "errors.hpp"
+#include "hpg.hpp"
+#include "impl.h"
+
+
+namespace hpg
+{
+    namespace
+    {
+        /*
+        * Layout of a binary HPG file (native byte order, checked on load):
+        *
+        *   BinaryHeader
+        *   node ID (nodeIdLength chars, padded)
+        *   source hash (sourceHashLength chars, padded)
+        *   BinarySection + arrays for the positive flow curves
+        *   BinarySection + arrays for the adverse flow curves
+        *
+        * Every array starts on an 8-byte boundary, so the file can be mapped
+        * and the arrays read straight out of the mapping.  The arrays of a
+        * section are, in order:
+        *
+        *   flows, critX, critY, critV, critHf, fullHf   [curves]
+        *   x, y, v, hf                                   [points]
+        *   slopeUs, slopeVol, slopeHf                    [points]   (splined only)
+        *   usKnots, usValues, usSlope                    [usKnots]  (splined only)
+        *   offsets                                       [curves+1]
+        *   usOffsets                                     [curves+1] (splined only)
+        *   valid                                         [points]
+        *   curveFlags, critValid                         [curves]
+        *
+        * Bump BINARY_VERSION whenever this changes; older files are then
+        * rejected and the text HPG is loaded instead.
+        */
+        const char BINARY_MAGIC[4] = { 'H', 'P', 'G', 'B' };
+        const unsigned int BINARY_VERSION = 3;
+        const unsigned int BINARY_BYTE_ORDER = 0x01020304;
+
+        /// Bits in BinaryHeader::validBits, one per optional header field.
+        enum BinaryValid
+        {
+            BinValid_DsInvert = 0x1,
+            BinValid_UsInvert = 0x2,
+            BinValid_DsStation = 0x4,
+            BinValid_UsStation = 0x8,
+            BinValid_Slope = 0x10,
+            BinValid_Length = 0x20,
+            BinValid_Roughness = 0x40,
+            BinValid_MaxDepth = 0x80,
+            BinValid_UnsteadyDepthPct = 0x100,
+        };
+
+        /// Bits in BinarySection::flags.
+        enum BinarySectionFlag
+        {
+            BinSection_Ascending = 0x1,
+            BinSection_Descending = 0x2,
+            BinSection_Splined = 0x4,   //< the spline coefficients are stored
+        };
+
+        struct BinaryHeader
+        {
+            char magic[4];
+            unsigned int formatVersion;
+            unsigned int byteOrder;
+            unsigned int headerSize;    //< sizeof(BinaryHeader), catches layout differences
+            unsigned long long fileSize;
+            int version;                //< HPG version (the text ver= field)
+            unsigned int validBits;     //< BinaryValid bits
+            unsigned int nodeIdLength;
+            unsigned int sourceHashLength;
+            double dsInvert;
+            double usInvert;
+            double dsStation;
+            double usStation;
+            double slope;
+            double length;
+            double roughness;
+            double maxDepth;
+            double unsteadyDepthPct;
+            double minPosFlow;
+            double maxPosFlow;
+            double minAdvFlow;
+            double maxAdvFlow;
+        };
+
+        struct BinarySection
+        {
+            unsigned int curves;
+            unsigned int points;
+            unsigned int usKnots;
+            unsigned int flags;         //< BinarySectionFlag bits
+        };
+
+        inline size_t padded(size_t size)
+        {
+            return (size + 7) & ~(size_t)7;
+        }
+
+        /// Appends 8-byte aligned blocks to a buffer.
+        class BinaryWriter
+        {
+        public:
+            std::vector<char> data;
+
+            void write(const void* p, size_t size)
+            {
+                size_t at = data.size();
+                data.resize(at + padded(size), 0);
+                if (size)
+                    memcpy(&data[at], p, size);
+            }
+
+            template<typename T>
+            void write(const std::vector<T>& v)
+            {
+                write(v.empty() ? NULL : &v[0], v.size() * sizeof(T));
+            }
+        };
+
+        /// Reads 8-byte aligned blocks out of a mapped file.  Any read past
+        /// the end fails and leaves 'ok' false.
+        class BinaryReader
+        {
+        public:
+            const char* data;
+            size_t size;
+            size_t at;
+            bool ok;
+
+            BinaryReader(const char* data, size_t size) : data(data), size(size), at(0), ok(true) { }
+
+            const char* read(size_t bytes)
+            {
+                if (!ok || bytes > size - at)
+                {
+                    ok = false;
+                    return NULL;
+                }
+                const char* p = data + at;
+                at += padded(bytes);
+                if (at > size)
+                    at = size;
+                return p;
+            }
+
+            template<typename T>
+            void read(std::vector<T>& v, size_t count)
+            {
+                const T* p = (const T*)read(count * sizeof(T));
+                if (p)
+                    v.assign(p, p + count);
+                else
+                    v.clear();
+            }
+        };
+
+        void writeSection(BinaryWriter& w, const CurveSet& c)
+        {
+            BinarySection s;
+            s.curves = c.count();
+            s.points = (unsigned int)c.x.size();
+            s.usKnots = (unsigned int)c.usKnots.size();
+            s.flags = (c.ascending ? BinSection_Ascending : 0) | (c.descending ? BinSection_Descending : 0);
+
+            // Only store the splines if they are set up for every curve that
+            // can have one (CurveSet::setupSplines sizes the slopes by point).
+            bool splined = c.slopeUs.size() == c.x.size() && c.usOffsets.size() == c.flows.size() + 1;
+            if (splined)
+                s.flags |= BinSection_Splined;
+
+            w.write(&s, sizeof(s));
+
+            w.write(c.flows);
+            w.write(c.critX);
+            w.write(c.critY);
+            w.write(c.critV);
+            w.write(c.critHf);
+            w.write(c.fullHf);
+            w.write(c.x);
+            w.write(c.y);
+            w.write(c.v);
+            w.write(c.hf);
+            if (splined)
+            {
+                w.write(c.slopeUs);
+                w.write(c.slopeVol);
+                w.write(c.slopeHf);
+                w.write(c.usKnots);
+                w.write(c.usValues);
+                w.write(c.usSlope);
+            }
+            w.write(c.offsets);
+            if (splined)
+                w.write(c.usOffsets);
+            w.write(c.valid);
+            w.write(c.curveFlags);
+            w.write(c.critValid);
+        }
+
+        /// Check that the offsets of a section start at 0, never decrease and
+        /// end at 'end', so that a corrupt file can't index out of bounds.
+        bool validOffsets(const std::vector<unsigned int>& offsets, unsigned int end)
+        {
+            if (offsets.empty() || offsets.front() != 0 || offsets.back() != end)
+                return false;
+            for (size_t i = 1; i < offsets.size(); i++)
+            {
+                if (offsets[i] < offsets[i - 1])
+                    return false;
+            }
+            return true;
+        }
+
+        bool readSection(BinaryReader& r, CurveSet& c, bool& splined)
+        {
+            const BinarySection* s = (const BinarySection*)r.read(sizeof(BinarySection));
+            if (s == NULL)
+                return false;
+
+            unsigned int curves = s->curves;
+            unsigned int points = s->points;
+            unsigned int usKnots = s->usKnots;
+            splined = (s->flags & BinSection_Splined) != 0;
+
+            c.clear();
+            r.read(c.flows, curves);
+            r.read(c.critX, curves);
+            r.read(c.critY, curves);
+            r.read(c.critV, curves);
+            r.read(c.critHf, curves);
+            r.read(c.fullHf, curves);
+            r.read(c.x, points);
+            r.read(c.y, points);
+            r.read(c.v, points);
+            r.read(c.hf, points);
+            if (splined)
+            {
+                r.read(c.slopeUs, points);
+                r.read(c.slopeVol, points);
+                r.read(c.slopeHf, points);
+                r.read(c.usKnots, usKnots);
+                r.read(c.usValues, usKnots);
+                r.read(c.usSlope, usKnots);
+            }
+            r.read(c.offsets, curves + 1);
+            if (splined)
+                r.read(c.usOffsets, curves + 1);
+            r.read(c.valid, points);
+            r.read(c.curveFlags, curves);
+            r.read(c.critValid, curves);
+
+            c.ascending = (s->flags & BinSection_Ascending) != 0;
+            c.descending = (s->flags & BinSection_Descending) != 0;
+
+            if (!r.ok || !validOffsets(c.offsets, points))
+                return false;
+            if (splined && !validOffsets(c.usOffsets, usKnots))
+                return false;
+
+            // Drop the splined bits if the coefficients weren't stored.
+            if (!splined)
+                c.clearSplines();
+
+            c.describeCurves();
+            return true;
+        }
+    }
+
+    bool Hpg::SaveBinaryData(std::vector<char>& data)
+    {
+        impl->errorCode = S_OK;
+
+        BinaryHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, BINARY_MAGIC, sizeof(h.magic));
+        h.formatVersion = BINARY_VERSION;
+        h.byteOrder = BINARY_BYTE_ORDER;
+        h.headerSize = sizeof(BinaryHeader);
+        h.version = impl->version;
+        h.validBits =
+            (impl->dsInvertValid ? BinValid_DsInvert : 0) |
+            (impl->usInvertValid ? BinValid_UsInvert : 0) |
+            (impl->dsStationValid ? BinValid_DsStation : 0) |
+            (impl->usStationValid ? BinValid_UsStation : 0) |
+            (impl->slopeValid ? BinValid_Slope : 0) |
+            (impl->lengthValid ? BinValid_Length : 0) |
+            (impl->roughnessValid ? BinValid_Roughness : 0) |
+            (impl->maxDepthValid ? BinValid_MaxDepth : 0) |
+            (impl->unsteadyDepthPctValid ? BinValid_UnsteadyDepthPct : 0);
+        h.nodeIdLength = (unsigned int)impl->nodeId.size();
+        h.sourceHashLength = (unsigned int)impl->sourceHash.size();
+        h.dsInvert = impl->dsInvert;
+        h.usInvert = impl->usInvert;
+        h.dsStation = impl->dsStation;
+        h.usStation = impl->usStation;
+        h.slope = impl->slope;
+        h.length = impl->length;
+        h.roughness = impl->roughness;
+        h.maxDepth = impl->maxDepth;
+        h.unsteadyDepthPct = impl->unsteadyDepthPct;
+        h.minPosFlow = impl->minPosFlow;
+        h.maxPosFlow = impl->maxPosFlow;
+        h.minAdvFlow = impl->minAdvFlow;
+        h.maxAdvFlow = impl->maxAdvFlow;
+
+        BinaryWriter w;
+        w.write(&h, sizeof(h));
+        w.write(impl->nodeId.data(), impl->nodeId.size());
+        w.write(impl->sourceHash.data(), impl->sourceHash.size());
+        writeSection(w, impl->pos);
+        writeSection(w, impl->adv);
+
+        // The size is only known at the end.
+        ((BinaryHeader*)&w.data[0])->fileSize = w.data.size();
+        data.swap(w.data);
+
+        return true;
+    }
+
+    bool Hpg::SaveBinary(const std::string& path)
+    {
+        std::vector<char> data;
+        if (!SaveBinaryData(data))
+            return false;
+
+        FILE* fh = fopen(path.c_str(), "wb");
+        if (fh == NULL)
+        {
+            impl->errorCode = err::FileWriteFailed;
+            return false;
+        }
+
+        bool ok = fwrite(&data[0], 1, data.size(), fh) == data.size();
+        ok = (fclose(fh) == 0) && ok;
+        if (!ok)
+        {
+            impl->errorCode = err::FileWriteFailed;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool Hpg::LoadBinary(const std::string& path, bool splineSetup)
+    {
+        using namespace boost::interprocess;
+
+        impl->errorCode = S_OK;
+
+        file_mapping file;
+        mapped_region region;
+        try
+        {
+            file_mapping(path.c_str(), read_only).swap(file);
+            mapped_region(file, read_only).swap(region);
+        }
+        catch (interprocess_exception&)
+        {
+            impl->errorCode = err::FileReadFailed;
+            return false;
+        }
+
+        return LoadBinaryData(region.get_address(), region.get_size(), splineSetup);
+    }
+
+    bool Hpg::LoadBinaryData(const void* data, size_t size, bool splineSetup)
+    {
+        impl->errorCode = S_OK;
+
+        BinaryReader r((const char*)data, size);
+
+        const BinaryHeader* h = (const BinaryHeader*)r.read(sizeof(BinaryHeader));
+        if (h == NULL || memcmp(h->magic, BINARY_MAGIC, sizeof(h->magic)) != 0 ||
+            h->formatVersion != BINARY_VERSION || h->byteOrder != BINARY_BYTE_ORDER ||
+            h->headerSize != sizeof(BinaryHeader) || h->fileSize != size)
+        {
+            impl->errorCode = err::InvalidFileFormat;
+            return false;
+        }
+
+        initialize();
+
+        impl->version = h->version;
+        impl->dsInvertValid = (h->validBits & BinValid_DsInvert) != 0;
+        impl->usInvertValid = (h->validBits & BinValid_UsInvert) != 0;
+        impl->dsStationValid = (h->validBits & BinValid_DsStation) != 0;
+        impl->usStationValid = (h->validBits & BinValid_UsStation) != 0;
+        impl->slopeValid = (h->validBits & BinValid_Slope) != 0;
+        impl->lengthValid = (h->validBits & BinValid_Length) != 0;
+        impl->roughnessValid = (h->validBits & BinValid_Roughness) != 0;
+        impl->maxDepthValid = (h->validBits & BinValid_MaxDepth) != 0;
+        impl->unsteadyDepthPctValid = (h->validBits & BinValid_UnsteadyDepthPct) != 0;
+        impl->dsInvert = h->dsInvert;
+        impl->usInvert = h->usInvert;
+        impl->dsStation = h->dsStation;
+        impl->usStation = h->usStation;
+        impl->slope = h->slope;
+        impl->length = h->length;
+        impl->roughness = h->roughness;
+        impl->maxDepth = h->maxDepth;
+        impl->unsteadyDepthPct = h->unsteadyDepthPct;
+        impl->minPosFlow = h->minPosFlow;
+        impl->maxPosFlow = h->maxPosFlow;
+        impl->minAdvFlow = h->minAdvFlow;
+        impl->maxAdvFlow = h->maxAdvFlow;
+
+        const char* nodeId = r.read(h->nodeIdLength);
+        if (nodeId)
+            impl->nodeId.assign(nodeId, h->nodeIdLength);
+        const char* sourceHash = r.read(h->sourceHashLength);
+        if (sourceHash)
+            impl->sourceHash.assign(sourceHash, h->sourceHashLength);
+
+        bool posSplined = false, advSplined = false;
+        if (nodeId == NULL || sourceHash == NULL || !readSection(r, impl->pos, posSplined) || !readSection(r, impl->adv, advSplined))
+        {
+            initialize();
+            impl->errorCode = err::InvalidFileFormat;
+            return false;
+        }
+
+        // Files written before the splines were set up still load, the
+        // same as the text format.  Lazy splines drop the stored ones, so
+        // that only the curves used take up memory.
+        if (splineSetup && (impl->lazySplines || !(posSplined && advSplined)))
+        {
+            int status = S_OK;
+            if (HPGFAILURE(status = setupSplines()))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool Hpg::IsBinaryFile(const std::string& path)
+    {
+        FILE* fh = fopen(path.c_str(), "rb");
+        if (fh == NULL)
+            return false;
+
+        char magic[sizeof(BINARY_MAGIC)];
+        bool isBinary = fread(magic, 1, sizeof(magic), fh) == sizeof(magic) &&
+            memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0;
+        fclose(fh);
+
+        return isBinary;
+    }
+}
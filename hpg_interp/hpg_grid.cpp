@@ -0,0 +1,480 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#pragma warning(disable : 4786) //disable warnings on identifier truncated to 255 chars
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+#include "errors.hpp"
+#include "hpg.hpp"
+#include "impl.h"
+
+#if defined(_MSC_VER)
+#include <float.h>
+#define nextafter _nextafter
+#endif
+
+using namespace std;
+
+namespace hpg
+{
+    namespace
+    {
+        /// Number of blocks per bracket, and the fewest and most rows per
+        /// block.  The rows are doubled (less one) until the error bound is
+        /// met.
+        const unsigned int GRID_BLOCKS = 64;
+        const unsigned int GRID_MIN_ROWS = 3;
+        const unsigned int GRID_MAX_ROWS = 65;
+
+        /// The exact bracket values at one downstream, to check the table
+        /// against.
+        struct Sample
+        {
+            double ds;
+            double row[GRID_STRIDE];
+            bool knot;      //< the sample is at a knot
+            bool jump;      //< the values jump at the knot next to the sample
+        };
+
+        /// The block of the bracket that the downstream falls in.
+        /// Downstreams past either end are clamped to it.
+        unsigned int blockOf(const HpgGrid::Bracket& b, double ds)
+        {
+            double u = (ds - b.lo) * b.invStep;
+            u = (u > 0.0) ? u : 0.0;
+            return (u < (double)(b.blocks - 1)) ? (unsigned int)u : b.blocks - 1;
+        }
+
+        /// The cell of the block that the downstream falls in, and the
+        /// fraction of the way across the cell in 'w'.  Downstreams past
+        /// either end are clamped to it; past the ends of a bracket the
+        /// values don't change with the downstream.
+        unsigned int cellOf(const HpgGrid::Block& b, double ds, double& w)
+        {
+            double last = (double)(b.rows - 1);
+            double u = (ds - b.lo) * b.invStep;
+            u = (u > 0.0) ? u : 0.0;
+            u = (u < last) ? u : last;
+            unsigned int j = (unsigned int)u;
+            j = (j < b.rows - 2) ? j : b.rows - 2;
+            w = u - (double)j;
+            return j;
+        }
+
+        /// Order samples by downstream.
+        bool sampleLess(const Sample& a, const Sample& b)
+        {
+            return a.ds < b.ds;
+        }
+
+        /// Interpolate the bracket at the downstream, at the middle flow qa
+        /// and the top flow qb, and from those get the table columns at
+        /// either end of the bracket.
+        bool sampleRow(Hpg& hpg, double qa, double qb, double ds, double* row)
+        {
+            InterpResult ra, rb;
+            if (HPGFAILURE(hpg.Interp(qa, ds, ra)) || HPGFAILURE(hpg.Interp(qb, ds, rb)))
+                return false;
+
+            row[0] = 2.0 * ra.upstream - rb.upstream;
+            row[1] = rb.upstream;
+            row[2] = 2.0 * ra.volume - rb.volume;
+            row[3] = rb.volume;
+            row[4] = 2.0 * ra.hf - rb.hf;
+            row[5] = rb.hf;
+            return true;
+        }
+
+        /// Largest head (upstream and hf) and relative volume differences
+        /// between two rows.
+        void rowError(const double* a, const double* b, double volScale, double& head, double& vol)
+        {
+            head = max(max(fabs(a[0] - b[0]), fabs(a[1] - b[1])), max(fabs(a[4] - b[4]), fabs(a[5] - b[5])));
+            vol = max(fabs(a[2] - b[2]), fabs(a[3] - b[3])) / volScale;
+        }
+
+        /// The bounds and the exact values to check a bracket against.
+        struct BracketCheck
+        {
+            double qa;
+            double qb;
+            double maxHeadError;
+            double maxVolumeError;
+            double volScale;
+            vector<Sample> samples;
+        };
+
+        /// Tabulate the samples [s0, s1) of a bracket in block 'b', whose
+        /// rows span [lo, hi].  Returns false if the bracket can't be
+        /// interpolated.
+        bool compileBlock(Hpg& hpg, const BracketCheck& check, unsigned int s0, unsigned int s1,
+            double lo, double hi, HpgGrid& grid, HpgGrid::Block& b)
+        {
+            vector<double> table;
+            vector<double> headErr;
+            vector<double> volErr;
+            vector<unsigned char> jump;
+            vector<unsigned int> knots;
+            b.lo = lo;
+            for (unsigned int rows = GRID_MIN_ROWS; ; rows = 2 * rows - 1)
+            {
+                double step = (hi - lo) / (rows - 1);
+                b.rows = rows;
+                b.invStep = 1.0 / step;
+
+                table.resize(rows * GRID_STRIDE);
+                for (unsigned int r = 0; r < rows; r++)
+                {
+                    if (!sampleRow(hpg, check.qa, check.qb, lo + r * step, &table[r * GRID_STRIDE]))
+                        return false;
+                }
+
+                // The error of each cell, found the same way as the lookup.
+                headErr.assign(rows - 1, 0.0);
+                volErr.assign(rows - 1, 0.0);
+                jump.assign(rows - 1, 0);
+                knots.assign(rows - 1, 0);
+                for (unsigned int i = s0; i < s1; i++)
+                {
+                    const Sample& s = check.samples[i];
+                    double w;
+                    unsigned int j = cellOf(b, s.ds, w);
+                    const double* r0 = &table[j * GRID_STRIDE];
+                    const double* r1 = r0 + GRID_STRIDE;
+                    double approx[GRID_STRIDE];
+                    for (unsigned int v = 0; v < GRID_STRIDE; v++)
+                        approx[v] = r0[v] + w * (r1[v] - r0[v]);
+
+                    double head, vol;
+                    rowError(approx, s.row, check.volScale, head, vol);
+                    headErr[j] = max(headErr[j], head);
+                    volErr[j] = max(volErr[j], vol);
+                    jump[j] |= s.jump;
+                    if (s.knot)
+                        knots[j]++;
+                }
+
+                // More rows can't help a cell whose only knot is a jump.
+                bool refine = false;
+                for (unsigned int j = 0; j < rows - 1 && !refine; j++)
+                    refine = (!jump[j] || knots[j] > 1) && (headErr[j] > check.maxHeadError || volErr[j] > check.maxVolumeError);
+
+                if (!refine || rows >= GRID_MAX_ROWS)
+                    break;
+            }
+
+            b.offset = (unsigned int)grid.exact.size();
+            grid.values.insert(grid.values.end(), table.begin(), table.end());
+            for (unsigned int j = 0; j < b.rows - 1; j++)
+            {
+                bool exact = headErr[j] > check.maxHeadError || volErr[j] > check.maxVolumeError;
+                grid.exact.push_back(exact ? 1 : 0);
+                grid.stats.cells++;
+                if (exact)
+                    grid.stats.exactCells++;
+                else
+                {
+                    grid.stats.maxHeadError = max(grid.stats.maxHeadError, headErr[j]);
+                    grid.stats.maxVolumeError = max(grid.stats.maxVolumeError, volErr[j]);
+                }
+            }
+            // The last row doesn't start a cell.
+            grid.exact.push_back(1);
+
+            return true;
+        }
+
+        /// Tabulate the bracket between curves k and k+1.  Between the knots
+        /// of the two curves the interpolated values are linear in the
+        /// downstream (the HPG regions change at knots too), so the error of
+        /// the table over a cell is largest at a knot inside it or at either
+        /// side of one.  These are all checked, which makes the bound exact
+        /// rather than estimated.  Returns false if the bracket can't be
+        /// interpolated, leaving it to the splines.
+        bool compileBracket(Hpg& hpg, const CurveSet& c, unsigned int k, double maxHeadError, double maxVolumeError,
+            HpgGrid& grid, HpgGrid::Bracket& b)
+        {
+            BracketCheck check;
+            double f1 = c.flows[k];
+            double f2 = c.flows[k + 1];
+            check.qa = 0.5 * (f1 + f2);
+            check.qb = f2;
+            check.maxHeadError = maxHeadError;
+            check.maxVolumeError = maxVolumeError;
+            if (c.curveSize(k) == 0 || c.curveSize(k + 1) == 0 || (check.qa >= 0.0) != (check.qb >= 0.0))
+                return false;
+
+            // The knots of both curves.  Below the lowest and above the
+            // highest the values don't change with the downstream.
+            vector<double> knots(c.x.begin() + c.firstIndex(k), c.x.begin() + c.lastIndex(k) + 1);
+            knots.insert(knots.end(), c.x.begin() + c.firstIndex(k + 1), c.x.begin() + c.lastIndex(k + 1) + 1);
+            sort(knots.begin(), knots.end());
+            knots.erase(unique(knots.begin(), knots.end()), knots.end());
+
+            // Sample either side of each knot, where the values may jump.
+            // Between the knots, linearInterpQ takes the absolute difference
+            // of the curves, which bends where the curves cross, so sample
+            // the crossings too.
+            vector<Sample>& samples = check.samples;
+            Sample s = Sample();
+            double prev[3];
+            CurveHints hints;
+            for (unsigned int i = 0; i < knots.size(); i++)
+            {
+                double cur[3];
+                double us2, vol2, hf2;
+                c.evalDsSplines(k, knots[i], cur[0], cur[1], cur[2], &hints);
+                c.evalDsSplines(k + 1, knots[i], us2, vol2, hf2, &hints);
+                cur[0] -= us2;
+                cur[1] -= vol2;
+                cur[2] -= hf2;
+                for (unsigned int v = 0; i > 0 && v < 3; v++)
+                {
+                    if ((prev[v] < 0.0 && cur[v] > 0.0) || (prev[v] > 0.0 && cur[v] < 0.0))
+                    {
+                        s.ds = knots[i - 1] + (knots[i] - knots[i - 1]) * prev[v] / (prev[v] - cur[v]);
+                        samples.push_back(s);
+                    }
+                }
+                copy(cur, cur + 3, prev);
+
+                s.ds = nextafter(knots[i], -HUGE_VAL);
+                samples.push_back(s);
+                s.ds = knots[i];
+                s.knot = true;
+                samples.push_back(s);
+                s.ds = nextafter(knots[i], HUGE_VAL);
+                s.knot = false;
+                samples.push_back(s);
+            }
+            sort(samples.begin(), samples.end(), sampleLess);
+
+            check.volScale = 0.0;
+            for (unsigned int i = 0; i < samples.size(); i++)
+            {
+                if (!sampleRow(hpg, check.qa, check.qb, samples[i].ds, samples[i].row))
+                    return false;
+                check.volScale = max(check.volScale, max(fabs(samples[i].row[2]), fabs(samples[i].row[3])));
+            }
+            if (check.volScale <= 0.0)
+                check.volScale = 1.0;
+
+            // Anything more than rounding across a knot is a jump.
+            for (unsigned int i = 1; i + 1 < samples.size(); i++)
+            {
+                if (!samples[i].knot)
+                    continue;
+                double head1, vol1, head2, vol2;
+                rowError(samples[i - 1].row, samples[i].row, check.volScale, head1, vol1);
+                rowError(samples[i].row, samples[i + 1].row, check.volScale, head2, vol2);
+                if (max(head1, head2) > 1e-3 * maxHeadError || max(vol1, vol2) > 1e-3 * maxVolumeError)
+                    samples[i - 1].jump = samples[i].jump = samples[i + 1].jump = true;
+            }
+
+            // Leave some room past either end so the cells at the ends don't
+            // straddle the first or last knot.
+            double pad = (knots.back() - knots.front()) / 64.0;
+            if (pad <= 0.0)
+                pad = 1.0;
+            double lo = knots.front() - pad;
+            double hi = knots.back() + pad;
+            double step = (hi - lo) / GRID_BLOCKS;
+
+            b.lo = lo;
+            b.hi = HUGE_VAL;
+            if (c.desc[k].flags & c.desc[k + 1].flags & Desc_Surcharged)
+                b.hi = knots.back();
+            b.invStep = 1.0 / step;
+            b.invWidth = 1.0 / fabs(f2 - f1);
+            b.blocks = GRID_BLOCKS;
+            b.first = (unsigned int)grid.blocks.size();
+            grid.blocks.resize(b.first + GRID_BLOCKS);
+
+            // The samples are in order, so each block has a run of them.
+            unsigned int s0 = 0;
+            for (unsigned int i = 0; i < GRID_BLOCKS; i++)
+            {
+                unsigned int s1 = s0;
+                while (s1 < samples.size() && blockOf(b, samples[s1].ds) == i)
+                    s1++;
+
+                double blockHi = (i + 1 == GRID_BLOCKS) ? hi : lo + (i + 1) * step;
+                if (!compileBlock(hpg, check, s0, s1, lo + i * step, blockHi, grid, grid.blocks[b.first + i]))
+                    return false;
+                s0 = s1;
+            }
+
+            return true;
+        }
+
+        /// Tabulate every bracket of one flow direction.  Only ordered flows
+        /// are tabulated.
+        void compileDirection(Hpg& hpg, const CurveSet& c, bool adverse, double maxHeadError, double maxVolumeError,
+            HpgGrid& grid, HpgGrid::Direction& dir)
+        {
+            unsigned int n = c.count();
+            if (n < 2 || !(adverse ? c.descending : c.ascending))
+                return;
+
+            dir.flows.resize(n);
+            for (unsigned int i = 0; i < n; i++)
+                dir.flows[i] = adverse ? -c.flows[i] : c.flows[i];
+
+            dir.brackets.resize(n - 1);
+            for (unsigned int k = 0; k + 1 < n; k++)
+            {
+                HpgGrid::Bracket& b = dir.brackets[k];
+                if (!compileBracket(hpg, c, k, maxHeadError, maxVolumeError, grid, b))
+                    b.blocks = 0;
+            }
+        }
+    }
+
+    HpgGrid::HpgGrid()
+    {
+        stats.maxHeadError = 0.0;
+        stats.maxVolumeError = 0.0;
+        stats.cells = 0;
+        stats.exactCells = 0;
+        stats.memory = 0;
+    }
+
+    bool HpgGrid::lookup(double flow, double downstream, InterpResult& result, unsigned int what) const
+    {
+        const Direction& d = (flow >= 0.0) ? pos : adv;
+        double q = (flow >= 0.0) ? flow : -flow;
+        unsigned int n = (unsigned int)d.flows.size();
+        if (n < 2 || !(q > d.flows[0]) || q > d.flows[n - 1] || downstream != downstream)
+            return false;
+
+        // The last curve below the flow.
+        const double* f = &d.flows[0];
+        const double* base = f;
+        for (unsigned int m = n; m > 1; )
+        {
+            unsigned int half = m / 2;
+            base = (base[half] < q) ? base + half : base;
+            m -= half;
+        }
+        unsigned int k = (unsigned int)(base - f);
+
+        // Past the curves of a full pipe the values aren't flat; the closed
+        // form answers those.
+        const Bracket& b = d.brackets[k];
+        if (b.blocks == 0 || downstream > b.hi)
+            return false;
+
+        const Block& block = blocks[b.first + blockOf(b, downstream)];
+        double w;
+        unsigned int row = block.offset + cellOf(block, downstream, w);
+        if (exact[row])
+            return false;
+
+        // Linear along the downstream within each column, then linear in
+        // the flow between the columns.
+        double t = (q - f[k]) * b.invWidth;
+        const double* r0 = &values[row * GRID_STRIDE];
+        const double* r1 = r0 + GRID_STRIDE;
+        double c[GRID_STRIDE];
+        for (unsigned int v = 0; v < GRID_STRIDE; v++)
+            c[v] = r0[v] + w * (r1[v] - r0[v]);
+
+        if (what & InterpFlag_Upstream)
+            result.upstream = c[0] + t * (c[1] - c[0]);
+        if (what & InterpFlag_Volume)
+            result.volume = c[2] + t * (c[3] - c[2]);
+        if (what & InterpFlag_Hf)
+            result.hf = c[4] + t * (c[5] - c[4]);
+        return true;
+    }
+
+    size_t HpgGrid::memory() const
+    {
+        return sizeof(HpgGrid) +
+            values.size() * sizeof(double) +
+            exact.size() * sizeof(unsigned char) +
+            blocks.size() * sizeof(Block) +
+            (pos.flows.size() + adv.flows.size()) * sizeof(double) +
+            (pos.brackets.size() + adv.brackets.size()) * sizeof(Bracket);
+    }
+
+    /// Compile the HPG into a lookup table.  The table is built from Interp
+    /// itself, so it is checked against exactly what it replaces.
+    int Hpg::Compile(double maxHeadError, double maxVolumeError)
+    {
+        impl->errorCode = S_OK;
+        impl->grid.reset();
+
+        if (!(maxHeadError > 0.0) || !(maxVolumeError > 0.0))
+            return (impl->errorCode = err::InvalidParam);
+
+        shared_ptr<HpgGrid> grid(new HpgGrid());
+        compileDirection(*this, impl->pos, false, maxHeadError, maxVolumeError, *grid, grid->pos);
+        compileDirection(*this, impl->adv, true, maxHeadError, maxVolumeError, *grid, grid->adv);
+        grid->stats.memory = grid->memory();
+
+        impl->grid = grid;
+        impl->errorCode = S_OK;
+        return S_OK;
+    }
+
+    bool Hpg::IsCompiled()
+    {
+        return impl->grid != NULL;
+    }
+
+    bool Hpg::getCompileStats(CompileStats& stats)
+    {
+        if (impl->grid == NULL)
+            return false;
+        stats = impl->grid->stats;
+        return true;
+    }
+}
@@ -0,0 +1,128 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#ifndef __HPG_GRID_H_______________________20161020101530__
+#define __HPG_GRID_H_______________________20161020101530__
+
+#include <vector>
+
+#include "types.h"
+
+
+namespace hpg
+{
+    /// Doubles per table row: the lower and upper bracket columns of the
+    /// upstream, volume and hf.
+    const unsigned int GRID_STRIDE = 6;
+
+    /**
+    * A compiled HPG: the interpolated values resampled onto a table, so a
+    * query is a table lookup instead of the region checks and spline
+    * evaluations of Hpg::Interp.  Built by Hpg::Compile.
+    *
+    * Between two neighbouring curves the interpolation is linear in the
+    * flow, so the flow axis of the table is the curve flows themselves and
+    * each pair of curves (bracket) has two columns: the values at either
+    * flow.  Along the downstream axis each bracket is split into evenly
+    * spaced blocks, and each block has its own evenly spaced rows, as many
+    * as it needs to meet the error bound.  Both steps are found without a
+    * search.  Cells that can't meet the bound (those across a jump between
+    * HPG regions) are marked exact and left to the splines.
+    */
+    class HpgGrid
+    {
+    public:
+        /// The rows of one block.
+        struct Block
+        {
+            double lo;              //< downstream of the first row
+            double invStep;         //< 1 / row spacing
+            unsigned int rows;      //< number of rows
+            unsigned int offset;    //< first row in 'values' and 'exact'
+        };
+
+        /// The blocks of one bracket.
+        struct Bracket
+        {
+            double lo;              //< downstream of the first block
+            double hi;              //< last downstream tabulated, past which the pipe is full
+            double invStep;         //< 1 / block spacing
+            double invWidth;        //< 1 / (flow2 - flow1)
+            unsigned int blocks;    //< number of blocks, 0 if the bracket isn't tabulated
+            unsigned int first;     //< first block in 'blocks'
+        };
+
+        /// The brackets of one flow direction.  Adverse flows are negated
+        /// so that both directions are ascending.
+        struct Direction
+        {
+            std::vector<double> flows;
+            std::vector<Bracket> brackets;
+        };
+
+        Direction pos;
+        Direction adv;
+        std::vector<Block> blocks;
+        std::vector<double> values;         //< GRID_STRIDE doubles per row
+        std::vector<unsigned char> exact;   //< per row: the cell starting at the row is left to the splines
+        CompileStats stats;
+
+        HpgGrid();
+
+        /// Look up the values selected by 'what'.  Returns false if the
+        /// query isn't covered by the table, in which case the splines
+        /// must be used.
+        bool lookup(double flow, double downstream, InterpResult& result, unsigned int what) const;
+
+        /// Bytes used by the table.
+        size_t memory() const;
+    };
+}
+
+
+#endif//__HPG_GRID_H_______________________20161020101530__
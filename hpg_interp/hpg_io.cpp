@@ -70,6 +70,10 @@ namespace hpg
         impl->errorCode = S_OK;
         int status = S_OK;
 
+        // Binary HPGs can be given anywhere a text one can.
+        if (IsBinaryFile(file))
+            return LoadBinary(file, splineSetup);
+
         ifstream fh(file);
         if (! fh.is_open())
         {
@@ -99,6 +103,7 @@ namespace hpg
         // temporary storage
         hpgvec values;
         double curFlow;
+        double curFullHf = -1.0;
         int lineCount = 1;
 
         // Iterate through the file
@@ -126,13 +131,17 @@ namespace hpg
                     // list at the end of the discharge block.
                     if (lineCount > 2)
                     {
-                        AddCurve(curFlow, values, values.front());
+                        AddCurve(curFlow, values, values.front(), curFullHf);
                         // Erase so we can start over
                         values.clear();
                     }
 
                     // Extract the actual discharge and add it to the discharges array.
                     curFlow = atof(line.substr(2).c_str());
+
+                    // The friction loss of a full pipe may follow the discharge.
+                    size_t fullAt = line.find("full_hf=");
+                    curFullHf = (fullAt == string::npos) ? -1.0 : atof(line.substr(fullAt + 8).c_str());
                 }
             }
             else if (line.length())
@@ -166,7 +175,7 @@ namespace hpg
         // Add the last read curve (doesn't get added in the previous
         // loop, since the last line will never be a 'Q=' line.
         if (values.size())
-            AddCurve(curFlow, values, values.front());
+            AddCurve(curFlow, values, values.front(), curFullHf);
         values.clear();
 
         fh.close();
@@ -185,6 +194,26 @@ namespace hpg
         return true;
     }
 
+    bool Hpg::LoadHeaderFromFile(const std::string& file)
+    {
+        impl->errorCode = S_OK;
+
+        if (IsBinaryFile(file))
+            return LoadBinary(file, false);
+
+        std::ifstream fh(file);
+        if (! fh.is_open())
+        {
+            impl->errorCode = err::FileReadFailed;
+            return false;
+        }
+        else if (fh.eof())
+            return false;
+
+        initialize();
+        return this->loadHeader(fh);
+    }
+
     bool Hpg::loadHeader(std::ifstream& fh)
     {
         using namespace std;
@@ -213,6 +242,10 @@ namespace hpg
                 {
                     impl->nodeId = kv.at(1);
                 }
+                else if (kv.at(0) == "src_hash")
+                {
+                    impl->sourceHash = kv.at(1);
+                }
                 else if (kv.at(0) == "ver")
                 {
                     impl->version = atoi(kv.at(1).c_str());
@@ -274,6 +307,28 @@ namespace hpg
         return true;
     }
 
+    /// Write the curves of one flow direction in the text HPG format.
+    static void saveCurves(FILE* fh, const CurveSet& c)
+    {
+        for (unsigned int i = 0; i < c.count(); i++)
+        {
+            if (c.fullHf[i] >= 0.0)
+                fprintf(fh, "Q=%.1f\tfull_hf=%.12f\n", c.flows[i], c.fullHf[i]);
+            else
+                fprintf(fh, "Q=%.1f\n", c.flows[i]);
+
+            for (unsigned int j = c.firstIndex(i); j < c.offsets[i + 1]; j++)
+            {
+                if (c.valid[j] & Valid_Hf)
+                    fprintf(fh, "%.6f\t%.6f\t%.6f\t%.12f\n", c.x[j], c.y[j], c.v[j], c.hf[j]);
+                else
+                    fprintf(fh, "%.6f\t%.6f\t%.6f\n", c.x[j], c.y[j], c.v[j]);
+            }
+
+            fprintf(fh, "\n\n");
+        }
+    }
+
     bool Hpg::SaveToFile(const std::string& file, bool append)
     {
         impl->errorCode = S_OK;
@@ -306,44 +361,8 @@ namespace hpg
         }
 
         // Print out the curves to the file
-        for (unsigned int i = 0; i < impl->posFlows.size(); i++)
-        {
-            fprintf(fh, "Q=%.1f\n", impl->posFlows[i]);
-
-            hpgvec vec = impl->posValues[i];
-            for (unsigned int j = 0; j < vec.size(); j++)
-			{
-				if (vec[j].hf_valid)
-				{
-	                fprintf(fh, "%.6f\t%.6f\t%.6f\t%.12f\n", vec[j].x, vec[j].y, vec[j].v, vec[j].hf);
-				}
-				else 
-				{
-					fprintf(fh, "%.6f\t%.6f\t%.6f\n", vec[j].x, vec[j].y, vec[j].v);
-				}
-			}
-
-            fprintf(fh, "\n\n");
-		}
-        for (unsigned int i = 0; i < impl->advFlows.size(); i++)
-        {
-            fprintf(fh, "Q=%.1f\n", impl->advFlows[i]);
-
-            hpgvec vec = impl->advValues[i];
-            for (unsigned int j = 0; j < vec.size(); j++)
-			{
-				if (vec[j].hf_valid)
-				{
-	                fprintf(fh, "%.6f\t%.6f\t%.6f\t%.12f\n", vec[j].x, vec[j].y, vec[j].v, vec[j].hf);
-				}
-				else 
-				{
-					fprintf(fh, "%.6f\t%.6f\t%.6f\n", vec[j].x, vec[j].y, vec[j].v);
-				}
-			}
-
-            fprintf(fh, "\n\n");
-        }
+        saveCurves(fh, impl->pos);
+        saveCurves(fh, impl->adv);
 
         //
         // Flush and close the filehandle.
@@ -363,6 +382,9 @@ namespace hpg
 
         header << "nid=" << impl->nodeId << " ";
 
+        if (! impl->sourceHash.empty())
+            header << "src_hash=" << impl->sourceHash << " ";
+
         if (impl->dsInvertValid)
             header << "ds_invert=" << impl->dsInvert << " ";
         else
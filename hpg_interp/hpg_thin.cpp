@@ -0,0 +1,437 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+#pragma warning(disable : 4786) //disable warnings on identifier truncated to 255 chars
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+#include "errors.hpp"
+#include "hpg.hpp"
+#include "impl.h"
+
+using namespace std;
+
+namespace hpg
+{
+    namespace
+    {
+        /// One curve of the thinned HPG.
+        struct ThinCurve
+        {
+            double flow;
+            hpgvec points;
+            point crit;
+            double fullHf;
+            bool thinned;       //< points have been removed
+        };
+    }
+
+    /// Sets up a HPG of just the two curves of a bracket.
+    struct ThinBracket
+    {
+        static int build(Hpg& bracket, const ThinCurve& lo, const ThinCurve& hi)
+        {
+            hpgvec points = lo.points;
+            bracket.AddCurve(lo.flow, points, lo.crit, lo.fullHf);
+            points = hi.points;
+            bracket.AddCurve(hi.flow, points, hi.crit, hi.fullHf);
+            return bracket.setupSplines();
+        }
+    };
+
+    namespace
+    {
+        /// Fewest points a curve is thinned to; Interp won't use a curve
+        /// with fewer.
+        const unsigned int THIN_MIN_POINTS = 4;
+
+        /// Smallest share of the tolerances that a curve is thinned to
+        /// before it is left as it was.
+        const double THIN_MIN_SHARE = 0.01;
+
+        /// Most curves that one bracket of the thinned HPG may replace.
+        /// This bounds the cost of checking a bracket.
+        const unsigned int THIN_MAX_RUN = 32;
+
+        /// Most downstream knots sampled per bracket (the samples are these
+        /// and the midpoints between them).
+        const unsigned int THIN_MAX_KNOTS = 200;
+
+        ThinCurve curveOf(const CurveSet& c, unsigned int i)
+        {
+            ThinCurve curve;
+            curve.flow = c.flows[i];
+            for (unsigned int j = c.firstIndex(i); j <= c.lastIndex(i); j++)
+                curve.points.push_back(c.pointAt(j));
+            curve.crit = c.critAt(i);
+            curve.fullHf = c.fullHf[i];
+            curve.thinned = false;
+            return curve;
+        }
+
+        /// Say if the chord from point k to point m of the curve is within
+        /// the tolerances of every point in between.  The curve splines are
+        /// linear between the points, so this bounds the error everywhere
+        /// on [x_k, x_m].
+        bool chordFits(const hpgvec& p, unsigned int k, unsigned int m, double headTol, double volTol)
+        {
+            double width = p[m].x - p[k].x;
+            for (unsigned int j = k + 1; j < m; j++)
+            {
+                double w = (p[j].x - p[k].x) / width;
+                if (fabs(p[k].y + w * (p[m].y - p[k].y) - p[j].y) > headTol)
+                    return false;
+                if (p[0].v_valid && fabs(p[k].v + w * (p[m].v - p[k].v) - p[j].v) > volTol)
+                    return false;
+                if (p[0].hf_valid && fabs(p[k].hf + w * (p[m].hf - p[k].hf) - p[j].hf) > headTol)
+                    return false;
+            }
+            return true;
+        }
+
+        /// Drop the points of a curve that the chords between the points
+        /// kept reproduce within the tolerances.  The first and last points
+        /// are always kept, so the critical point and the start of the
+        /// full-pipe region don't move.  Curves whose downstream values
+        /// don't rise, or whose points don't all have the same values, are
+        /// left alone.
+        void thinCurve(ThinCurve& curve, double headTol, double volTol)
+        {
+            const hpgvec& p = curve.points;
+            unsigned int n = (unsigned int)p.size();
+            if (n <= THIN_MIN_POINTS)
+                return;
+            for (unsigned int j = 0; j < n; j++)
+            {
+                if (!p[j].x_valid || !p[j].y_valid || p[j].v_valid != p[0].v_valid || p[j].hf_valid != p[0].hf_valid)
+                    return;
+                if (j > 0 && !(p[j].x > p[j - 1].x))
+                    return;
+            }
+
+            // Extend each chord as far as it fits.
+            vector<unsigned int> keep(1, 0);
+            for (unsigned int k = 0; k + 1 < n; )
+            {
+                unsigned int m = k + 1;
+                while (m + 1 < n && chordFits(p, k, m + 1, headTol, volTol))
+                    m++;
+                keep.push_back(m);
+                k = m;
+            }
+
+            // Put back evenly spaced points up to the fewest allowed.
+            unsigned int extra[] = { n / 3, 2 * n / 3, n / 2, 1, n - 2 };
+            for (unsigned int e = 0; e < 5 && keep.size() < THIN_MIN_POINTS; e++)
+            {
+                if (find(keep.begin(), keep.end(), extra[e]) == keep.end())
+                    keep.insert(upper_bound(keep.begin(), keep.end(), extra[e]), extra[e]);
+            }
+            if (keep.size() == n)
+                return;
+
+            hpgvec points;
+            for (unsigned int j = 0; j < keep.size(); j++)
+                points.push_back(p[keep[j]]);
+            curve.points.swap(points);
+            curve.thinned = true;
+        }
+
+        /// Largest volume magnitude on a curve, to scale the volume
+        /// tolerance by.
+        double volumeScale(const ThinCurve& curve)
+        {
+            double scale = 0.0;
+            for (unsigned int j = 0; j < curve.points.size(); j++)
+                scale = max(scale, fabs(curve.points[j].v));
+            return (scale > 0.0) ? scale : 1.0;
+        }
+
+        /// Differences between the original HPG and a thinned bracket.
+        struct BracketError
+        {
+            double head;            //< upstream head and hf
+            double volume;          //< relative to the largest volume of the bracket
+            unsigned int samples;
+        };
+
+        /// Compare the original HPG with the bracket between the thinned
+        /// curves lo and hi, over the flows of original curves first to last
+        /// (and three between each pair) and the downstream knots of those curves
+        /// (and the midpoints between them, and some past either end).  The
+        /// values between two curves only depend on those two curves, so a
+        /// HPG of just the two answers for the bracket exactly as the whole
+        /// thinned HPG would.  Returns false if a query fails on one and
+        /// not on the other.
+        bool compareBracket(const Hpg& original, const CurveSet& c, const ThinCurve& lo, const ThinCurve& hi,
+            unsigned int first, unsigned int last, BracketError& error)
+        {
+            error.head = 0.0;
+            error.volume = 0.0;
+            error.samples = 0;
+
+            Hpg bracket;
+            if (HPGFAILURE(ThinBracket::build(bracket, lo, hi)))
+                return false;
+
+            // The flow of the bottom curve belongs to the bracket below it,
+            // except for the first curve.
+            vector<double> flows;
+            for (unsigned int i = first; i <= last; i++)
+            {
+                if (i > first || first == 0)
+                    flows.push_back(c.flows[i]);
+                if (i < last)
+                {
+                    for (int f = 1; f < 4; f++)
+                        flows.push_back(c.flows[i] + 0.25 * f * (c.flows[i + 1] - c.flows[i]));
+                }
+            }
+
+            vector<double> knots;
+            for (unsigned int j = c.firstIndex(first); j <= c.lastIndex(last); j++)
+                knots.push_back(c.x[j]);
+            sort(knots.begin(), knots.end());
+            knots.erase(unique(knots.begin(), knots.end()), knots.end());
+            if (knots.size() > THIN_MAX_KNOTS)
+            {
+                vector<double> fewer;
+                for (unsigned int j = 0; j < THIN_MAX_KNOTS; j++)
+                    fewer.push_back(knots[(size_t)j * (knots.size() - 1) / (THIN_MAX_KNOTS - 1)]);
+                knots.swap(fewer);
+            }
+
+            vector<double> downstreams;
+            double range = knots.back() - knots.front();
+            if (range <= 0.0)
+                range = 1.0;
+            downstreams.push_back(knots.front() - 0.25 * range);
+            downstreams.push_back(knots.front() - 0.05 * range);
+            for (unsigned int j = 0; j < knots.size(); j++)
+            {
+                downstreams.push_back(knots[j]);
+                if (j + 1 < knots.size())
+                    downstreams.push_back(0.5 * (knots[j] + knots[j + 1]));
+            }
+            downstreams.push_back(knots.back() + 0.05 * range);
+            downstreams.push_back(knots.back() + 0.5 * range);
+
+            double volScale = 0.0;
+            double worstVolume = 0.0;
+            for (unsigned int i = 0; i < flows.size(); i++)
+            {
+                for (unsigned int j = 0; j < downstreams.size(); j++)
+                {
+                    InterpResult a, b;
+                    int statusA = original.Query(flows[i], downstreams[j], a);
+                    int statusB = bracket.Query(flows[i], downstreams[j], b);
+                    if ((statusA != S_OK) != (statusB != S_OK))
+                        return false;
+                    if (statusA != S_OK)
+                        continue;
+
+                    error.head = max(error.head, max(fabs(a.upstream - b.upstream), fabs(a.hf - b.hf)));
+                    worstVolume = max(worstVolume, fabs(a.volume - b.volume));
+                    volScale = max(volScale, fabs(a.volume));
+                    error.samples++;
+                }
+            }
+            error.volume = worstVolume / ((volScale > 0.0) ? volScale : 1.0);
+            return true;
+        }
+
+        bool withinTolerance(const BracketError& error, double headTol, double volTol)
+        {
+            return error.head <= headTol && error.volume <= volTol;
+        }
+
+        /// Thin the curves of one flow direction into 'out'.  Only ordered
+        /// flows are thinned; otherwise the curves are copied as they are.
+        void thinDirection(const Hpg& hpg, const CurveSet& c, bool adverse, double maxHeadError, double maxVolumeError,
+            vector<ThinCurve>& out, ThinStats& stats)
+        {
+            unsigned int n = c.count();
+            vector<ThinCurve> curves;
+            for (unsigned int i = 0; i < n; i++)
+                curves.push_back(curveOf(c, i));
+
+            if (n < 2 || !(adverse ? c.descending : c.ascending))
+            {
+                out.insert(out.end(), curves.begin(), curves.end());
+                return;
+            }
+
+            // Thin the points of each curve to half of the tolerances.  The
+            // blend between two curves can magnify the changes (where the
+            // curves cross), so any bracket that then misses half of the
+            // tolerances has both of its curves thinned again to a quarter
+            // of what they had, or put back as they were after a few tries.
+            // That changes the bracket below too, so it is checked again.
+            vector<ThinCurve> thinned = curves;
+            vector<double> share(n, 0.5);
+            for (unsigned int i = 0; i < n; i++)
+                thinCurve(thinned[i], share[i] * maxHeadError, share[i] * maxVolumeError * volumeScale(curves[i]));
+            for (unsigned int k = 0; k + 1 < n; )
+            {
+                BracketError error;
+                bool unchanged = !thinned[k].thinned && !thinned[k + 1].thinned;
+                if (unchanged ||
+                    (compareBracket(hpg, c, thinned[k], thinned[k + 1], k, k + 1, error) &&
+                     withinTolerance(error, 0.5 * maxHeadError, 0.5 * maxVolumeError)))
+                {
+                    k++;
+                    continue;
+                }
+                for (unsigned int i = k; i <= k + 1; i++)
+                {
+                    if (!thinned[i].thinned)
+                        continue;
+                    share[i] *= 0.25;
+                    thinned[i] = curves[i];
+                    if (share[i] > THIN_MIN_SHARE)
+                        thinCurve(thinned[i], share[i] * maxHeadError, share[i] * maxVolumeError * volumeScale(curves[i]));
+                }
+                k = (k > 0) ? k - 1 : 0;
+            }
+
+            // Drop each curve that blending the curves either side of it
+            // reproduces within the whole tolerances.  The bracket kept
+            // grows until the next curve can't be dropped.
+            vector<bool> keep(n, true);
+            unsigned int lo = 0;
+            for (unsigned int i = 1; i + 1 < n; i++)
+            {
+                BracketError error;
+                if (i + 1 - lo <= THIN_MAX_RUN &&
+                    compareBracket(hpg, c, thinned[lo], thinned[i + 1], lo, i + 1, error) &&
+                    withinTolerance(error, maxHeadError, maxVolumeError))
+                    keep[i] = false;
+                else
+                    lo = i;
+            }
+
+            // Measure what is left against the original.
+            lo = 0;
+            for (unsigned int i = 1; i < n; i++)
+            {
+                if (!keep[i])
+                    continue;
+                BracketError error;
+                if (compareBracket(hpg, c, thinned[lo], thinned[i], lo, i, error))
+                {
+                    stats.maxHeadError = max(stats.maxHeadError, error.head);
+                    stats.maxVolumeError = max(stats.maxVolumeError, error.volume);
+                    stats.samples += error.samples;
+                }
+                lo = i;
+            }
+
+            for (unsigned int i = 0; i < n; i++)
+            {
+                if (keep[i])
+                    out.push_back(thinned[i]);
+            }
+        }
+    }
+
+    /// Thin the HPG.  Every bracket of the thinned HPG is checked against
+    /// Query on the original, so the tolerances hold for what the HPG
+    /// actually answers rather than only for the points.
+    int Hpg::Thin(double maxHeadError, double maxVolumeError, ThinStats* stats)
+    {
+        impl->errorCode = S_OK;
+
+        if (!(maxHeadError > 0.0) || !(maxVolumeError > 0.0))
+            return (impl->errorCode = err::InvalidParam);
+
+        ThinStats result;
+        result.curvesBefore = impl->pos.count() + impl->adv.count();
+        result.pointsBefore = (unsigned int)(impl->pos.x.size() + impl->adv.x.size());
+        result.maxHeadError = 0.0;
+        result.maxVolumeError = 0.0;
+        result.samples = 0;
+
+        if (result.curvesBefore > 0)
+        {
+            // The original is queried to check the thinned curves against.
+            if (!impl->pos.isLazy() && !impl->adv.isLazy() && impl->pos.builtCount() == 0 && impl->adv.builtCount() == 0)
+            {
+                if (HPGFAILURE(setupSplines()))
+                    return impl->errorCode;
+            }
+
+            vector<ThinCurve> curves;
+            thinDirection(*this, impl->pos, false, maxHeadError, maxVolumeError, curves, result);
+            thinDirection(*this, impl->adv, true, maxHeadError, maxVolumeError, curves, result);
+
+            // Replace the curves.  This also drops the lookup table.
+            impl->pos.clear();
+            impl->adv.clear();
+            impl->minPosFlow = 1000000.0;
+            impl->maxPosFlow = 0.0;
+            impl->maxAdvFlow = 0.0;
+            impl->minAdvFlow = -1000000.0;
+            for (unsigned int i = 0; i < curves.size(); i++)
+                AddCurve(curves[i].flow, curves[i].points, curves[i].crit, curves[i].fullHf);
+            if (HPGFAILURE(setupSplines()))
+                return impl->errorCode;
+
+            // The curves are no longer what the reach and settings of the
+            // source hash create, so the HPG mustn't pass for them.
+            impl->sourceHash.clear();
+        }
+
+        result.curvesAfter = impl->pos.count() + impl->adv.count();
+        result.pointsAfter = (unsigned int)(impl->pos.x.size() + impl->adv.x.size());
+        if (stats)
+            *stats = result;
+
+        impl->errorCode = S_OK;
+        return S_OK;
+    }
+}
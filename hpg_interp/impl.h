@@ -48,9 +48,12 @@
 
 
 #include <deque>
+#include <memory>
 
 #include "hpg.hpp"
 #include "spline.h"
+#include "curve_set.h"
+#include "hpg_grid.h"
 
 
 namespace hpg
@@ -58,29 +61,16 @@ namespace hpg
     class Hpg::Impl
     {
     public:
-        unsigned int posFlowCount;            //< number of positive flows in HPG
-        unsigned int advFlowCount;            //< number of adverse flows in HPG
-        std::deque<double> posFlows;  //< list of flows in HPG
-        std::deque<double> advFlows;  //< list of flows in HPG
-        std::deque<hpgvec> posValues; //< list of vectors of HP curves
-        std::deque<hpgvec> advValues; //< list of vectors of HP curves
-        hpgvec posCritical;           //< critical line for positive flow
-        hpgvec advCritical;           //< critical line for adverse flow
+        CurveSet pos;                 //< positive flow curves and their splines
+        CurveSet adv;                 //< adverse flow curves and their splines
+        CurveHints posHints;          //< lookup hints of the Interp* functions for positive flows
+        CurveHints advHints;          //< lookup hints of the Interp* functions for adverse flows
         //hpgvec ZeroFlowLine;          //< zero-flow line (for backwater effects)
         //hpgvec NormFlowLine;          //< normal-flow line
         double minPosFlow;            //< minimum positive flow in HPG
         double maxPosFlow;            //< maximum positive flow in HPG
         double minAdvFlow;            //< minimum adverse flow in HPG
         double maxAdvFlow;            //< maximum adverse flow in HPG
-        // Splines are stored here.
-        std::deque<Spline> SplPosUS_QDS;       //< spline for US = F(Q, DS) for positive flow
-        std::deque<Spline> SplAdvUS_QDS;       //< spline for US = F(Q, DS) for adverse flow
-        std::deque<Spline> SplPosDS_QUS;       //< spline for US = F(Q, DS) for positive flow
-        std::deque<Spline> SplAdvDS_QUS;       //< spline for US = F(Q, DS) for adverse flow
-        std::deque<Spline> SplPosVol;          //< spline for Volume = F(Q, DS) for positive flow
-        std::deque<Spline> SplAdvVol;          //< spline for Volume = F(Q, DS) for adverse flow
-		std::deque<Spline> SplPosHf;
-		std::deque<Spline> SplAdvHf;
         Spline SplPosCritUS_Q;   //< spline for Q = F_crit(US) for positive flow
         Spline SplAdvCritUS_Q;   //< spline for Q = F_crit(US) for adverse flow
         Spline SplPosCritDS_Q;   //< spline for Q = F_crit(DS) for positive flow
@@ -88,9 +78,12 @@ namespace hpg
         std::deque<Spline>SplPosCritUS_DS;     //< spline for DS = F_crit(US) for positive flow
         std::deque<point> SplPosCritUS_DS_ranges;   //< range of flows for each of the splines in SplPosCritUS_DS
         Spline SplAdvCritUS_DS;  //< spline for DS = F_crit(US) for adverse flow
+        std::shared_ptr<const HpgGrid> grid;  //< lookup table set up by Compile, or NULL
         int errorCode;
+        bool lazySplines;             //< build the curve splines on first use
 
         std::string nodeId; /**< the Tunnel ID */
+        std::string sourceHash; /**< hash of what the HPG was created from, or empty */
         double	dsInvert; /**< downstream channel bottom elevation - used for HPG header */
         bool	dsInvertValid;
         double	usInvert; /**< upstream channel bottom elevation */
@@ -133,17 +126,14 @@ namespace hpg
             this->maxDepth = copy->maxDepth;
             this->unsteadyDepthPct = copy->unsteadyDepthPct;
             this->nodeId = copy->nodeId;
+            this->sourceHash = copy->sourceHash;
 
-            // Copy all of the primitives and STL arrays.
-            this->advFlowCount = copy->advFlowCount;
-            this->posFlowCount = copy->posFlowCount;
-            this->advFlows = copy->advFlows;
-            this->posFlows = copy->posFlows;
-            this->advValues = copy->advValues;
-            this->posValues = copy->posValues;
-            this->posCritical = copy->posCritical;
-            this->advCritical = copy->advCritical;
+            // Copy all of the primitives and curve arrays.
+            this->pos = copy->pos;
+            this->adv = copy->adv;
+            this->grid = copy->grid;
             this->errorCode = copy->errorCode;
+            this->lazySplines = copy->lazySplines;
             this->minPosFlow = copy->minPosFlow;
             this->maxPosFlow = copy->maxPosFlow;
             this->minAdvFlow = copy->minAdvFlow;
@@ -0,0 +1,354 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#pragma warning(disable : 4786) //disable warnings on identifier truncated to 255 chars
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+#include "errors.hpp"
+#include "hpg.hpp"
+#include "impl.h"
+
+using namespace std;
+
+namespace hpg
+{
+    namespace
+    {
+        /// The values that are the same for every query that falls between
+        /// the same pair of curves.
+        struct Bracket
+        {
+            bool valid;
+            bool adverse;
+            unsigned int curve;     //< the lower bracketing curve
+            bool steepC1;
+            bool steepC2;
+            double flow1;
+            double flow2;
+            const CurveDesc* d1;    //< descriptors of the two curves
+            const CurveDesc* d2;
+        };
+
+        /// Number of queries that InterpBatch works on at a time.
+        const unsigned int BATCH_BLOCK = 64;
+    }
+
+    /// Get the lower bracketing curve of the flow as a key to group the
+    /// queries by: the curve index for positive flows, the number of
+    /// positive curves plus the curve index for adverse flows, or
+    /// 'invalidKey' if the flow is out of range.  This applies the same
+    /// flow checks as findLowerBracketingCurve/isValidFlowExtended except
+    /// for the per-curve checks, which are done once per bracket.
+    unsigned int Hpg::bracketKey(double flow, unsigned int invalidKey) const
+    {
+        const CurveSet& c = (flow >= 0.0) ? impl->pos : impl->adv;
+        int index;
+        if (flow >= 0.0)
+        {
+            if (flow > impl->maxPosFlow || flow < impl->minPosFlow)
+                return invalidKey;
+            index = c.searchBracket(flow, false);
+        }
+        else
+        {
+            if (flow < impl->maxAdvFlow || flow > impl->minAdvFlow)
+                return invalidKey;
+            index = c.searchBracket(flow, true);
+        }
+
+        if (index == -1 && fabs(flow - c.flows.at(0)) < 0.0001)
+            index = 0;
+        if (index < 0)
+            return invalidKey;
+
+        return (flow >= 0.0) ? (unsigned int)index : impl->pos.count() + (unsigned int)index;
+    }
+
+    /// Interpolate a batch of queries.  The work is done in blocks of
+    /// queries, one step at a time for the whole block: look the queries up
+    /// in the table of a compiled HPG, then for the rest find the brackets
+    /// (pairs of bracketing curves), find the spline segments, evaluate.
+    /// The searches of the different queries in a step don't depend on
+    /// each other and don't branch on the data, so the processor overlaps
+    /// them instead of stalling on each one in turn.  The curve checks,
+    /// first and last points and steepness of each bracket are looked up
+    /// once, the first time that the bracket is used.
+    /// The results are exactly the same as calling Interp on each query,
+    /// whether the HPG is compiled or not.
+    /// The values selected by 'what' for query i are written to
+    /// results[i], or if 'results' is NULL, the one value selected is
+    /// written to values[i].  Like interp, this only reads the Hpg and
+    /// returns the status of the first query that failed rather than
+    /// setting the error code.
+    int Hpg::interpBatch(const double* flow, const double* downstream, size_t n, unsigned int what,
+        InterpResult* results, double* values, int* status) const
+    {
+        const CurveSet& pos = impl->pos;
+        const CurveSet& adv = impl->adv;
+        unsigned int invalidKey = pos.count() + adv.count();
+
+        // Index into 'brackets' for each key, -1 until the bracket is used.
+        std::vector<int> slots(invalidKey + 1, -1);
+        std::vector<Bracket> brackets;
+
+        unsigned int keys[BATCH_BLOCK];
+        unsigned int seg1[BATCH_BLOCK];
+        unsigned int seg2[BATCH_BLOCK];
+        bool inGrid[BATCH_BLOCK];
+        InterpResult gridResults[BATCH_BLOCK];
+        const HpgGrid* grid = impl->grid.get();
+
+        int failure = S_OK;
+
+        for (size_t first = 0; first < n; first += BATCH_BLOCK)
+        {
+            unsigned int m = (unsigned int)std::min((size_t)BATCH_BLOCK, n - first);
+            const double* q = flow + first;
+            const double* ds = downstream + first;
+
+            // As in interp, the table of a compiled HPG answers the queries
+            // it covers.  They skip the other steps.
+            for (unsigned int j = 0; j < m; j++)
+                inGrid[j] = (grid != NULL && grid->lookup(q[j], ds[j], gridResults[j], what));
+
+            // Find the bracket of each query.
+            for (unsigned int j = 0; j < m; j++)
+                keys[j] = inGrid[j] ? invalidKey : bracketKey(q[j], invalidKey);
+
+            // Set up the brackets that haven't been used yet.  These are the
+            // checks done by findLowerBracketingCurve and isValidFlowExtended.
+            for (unsigned int j = 0; j < m; j++)
+            {
+                unsigned int k = keys[j];
+                if (slots[k] >= 0)
+                    continue;
+
+                Bracket nb;
+                nb.adverse = (k >= pos.count());
+                nb.curve = nb.adverse ? k - pos.count() : k;
+                const CurveSet& c = nb.adverse ? adv : pos;
+                unsigned int curve = nb.curve;
+                nb.valid = (k != invalidKey) && curve + 1 < c.count() &&
+                    c.splineSize(curve, Spl_US_DS) != 0 && c.splineSize(curve + 1, Spl_US_DS) != 0 &&
+                    c.curveSize(curve) >= 4 && c.curveSize(curve + 1) >= 4;
+                nb.steepC1 = nb.steepC2 = false;
+                if (nb.valid)
+                {
+                    nb.flow1 = c.flows[curve];
+                    nb.flow2 = c.flows[curve + 1];
+                    nb.d1 = &c.desc[curve];
+                    nb.d2 = &c.desc[curve + 1];
+                    // The steepness only matters for the upstream value, and
+                    // is only used for positive flows.
+                    if ((what & InterpFlag_Upstream) && !nb.adverse)
+                    {
+                        nb.steepC1 = (nb.d1->flags & Desc_Steep) != 0;
+                        nb.steepC2 = (nb.d2->flags & Desc_Steep) != 0;
+                    }
+                }
+                slots[k] = (int)brackets.size();
+                brackets.push_back(nb);
+            }
+
+            // Find the segments of the bracketing curves that the
+            // downstream values fall in.
+            for (unsigned int j = 0; j < m; j++)
+            {
+                const Bracket& b = brackets[slots[keys[j]]];
+                if (b.valid && !inGrid[j])
+                {
+                    const CurveSet& c = b.adverse ? adv : pos;
+                    seg1[j] = c.dsSegment(b.curve, ds[j]);
+                    seg2[j] = c.dsSegment(b.curve + 1, ds[j]);
+                }
+            }
+
+            // Evaluate.
+            for (unsigned int j = 0; j < m; j++)
+            {
+                const Bracket& b = brackets[slots[keys[j]]];
+                const CurveSet& c = b.adverse ? adv : pos;
+                bool transitional = (b.steepC1 != b.steepC2);
+                bool wantUpstream = (what & InterpFlag_Upstream) && !transitional;
+                double qj = q[j];
+                double dsj = ds[j];
+                InterpResult r;
+                int s = S_OK;
+
+                if (inGrid[j])
+                    r = gridResults[j];
+
+                else if (!b.valid)
+                    s = err::InvalidFlow;
+
+                // The steep special interpolation is rare; leave it to the
+                // single query.
+                else if (wantUpstream && b.steepC1 && dsj >= b.d1->firstX && dsj < b.d2->firstX)
+                {
+                    s = interp(qj, dsj, r, what, NULL, NULL);
+                }
+
+                else
+                {
+                    if (transitional)
+                        r.upstream = (b.d1->firstY + b.d2->firstY) / 2.;
+
+                    // Below the first point on the upper or lower curve.
+                    if (dsj < b.d1->firstX || dsj < b.d2->firstX)
+                    {
+                        if (wantUpstream)
+                            r.upstream = linearInterp(qj, b.flow1, b.d1->firstY, b.flow2, b.d2->firstY);
+                        if (what & InterpFlag_Volume)
+                            r.volume = linearInterpQ(qj, b.flow1, b.flow2, b.d1->firstV, b.d2->firstV);
+                        if (what & InterpFlag_Hf)
+                            r.hf = linearInterpQ(qj, b.flow1, b.flow2, b.d1->firstHf, b.d2->firstHf);
+                    }
+
+                    // Past the last point on the lower curve, unless both
+                    // curves go on to a full pipe.  This is what
+                    // standardExtrapolation computes.
+                    else if (dsj > b.d1->lastX && !(b.d1->flags & b.d2->flags & Desc_Surcharged))
+                    {
+                        double value = linearInterpQ(qj, b.flow1, b.flow2, b.d1->lastY, b.d2->lastY);
+                        if (wantUpstream)
+                            r.upstream = value;
+                        if (what & InterpFlag_Volume)
+                            r.volume = value;
+                        if (what & InterpFlag_Hf)
+                            r.hf = value;
+                    }
+
+                    // On the curves, or past them once the pipe is full.
+                    else
+                    {
+                        double us1, vol1, hf1;
+                        double us2, vol2, hf2;
+                        c.evalDsSegment(b.curve, seg1[j], dsj, us1, vol1, hf1);
+                        c.evalDsSegment(b.curve + 1, seg2[j], dsj, us2, vol2, hf2);
+
+                        if (wantUpstream)
+                            r.upstream = linearInterpQ(qj, b.flow1, b.flow2, us1, us2);
+                        if (what & InterpFlag_Volume)
+                            r.volume = linearInterpQ(qj, b.flow1, b.flow2, vol1, vol2);
+                        if (what & InterpFlag_Hf)
+                            r.hf = linearInterpQ(qj, b.flow1, b.flow2, hf1, hf2);
+                    }
+                }
+
+                size_t i = first + j;
+                if (!HPGFAILURE(s))
+                {
+                    if (results)
+                    {
+                        InterpResult& out = results[i];
+                        if (what & InterpFlag_Upstream)
+                            out.upstream = r.upstream;
+                        if (what & InterpFlag_Volume)
+                            out.volume = r.volume;
+                        if (what & InterpFlag_Hf)
+                            out.hf = r.hf;
+                    }
+                    else if (what & InterpFlag_Upstream)
+                        values[i] = r.upstream;
+                    else if (what & InterpFlag_Volume)
+                        values[i] = r.volume;
+                    else
+                        values[i] = r.hf;
+                }
+                else if (!HPGFAILURE(failure))
+                    failure = s;
+
+                if (status)
+                    status[i] = s;
+            }
+        }
+
+        // Report the error of the first query that failed.
+        return failure;
+    }
+
+    /// Interpolate the values selected by 'what' for a batch of (flow,
+    /// downstream) pairs.
+    int Hpg::InterpBatch(const double* flow, const double* downstream, InterpResult* results, int* status, size_t n, unsigned int what)
+    {
+        impl->errorCode = QueryBatch(flow, downstream, results, status, n, what);
+        return impl->errorCode;
+    }
+
+    /// Get the upstream values for a batch of (flow, downstream) pairs.
+    int Hpg::InterpUpstreamHeadBatch(const double* flow, const double* downstream, double* result, int* status, size_t n)
+    {
+        impl->errorCode = interpBatch(flow, downstream, n, InterpFlag_Upstream, NULL, result, status);
+        return impl->errorCode;
+    }
+
+    /// Get the volumes for a batch of (flow, downstream) pairs.
+    int Hpg::InterpVolumeBatch(const double* flow, const double* downstream, double* result, int* status, size_t n)
+    {
+        impl->errorCode = interpBatch(flow, downstream, n, InterpFlag_Volume, NULL, result, status);
+        return impl->errorCode;
+    }
+
+    /// Get the hf friction values for a batch of (flow, downstream) pairs.
+    int Hpg::InterpHfBatch(const double* flow, const double* downstream, double* result, int* status, size_t n)
+    {
+        impl->errorCode = interpBatch(flow, downstream, n, InterpFlag_Hf, NULL, result, status);
+        return impl->errorCode;
+    }
+
+    /// The same as InterpBatch, without setting the error code, so that any
+    /// number of threads can query at once.
+    int Hpg::QueryBatch(const double* flow, const double* downstream, InterpResult* results, int* status, size_t n, unsigned int what) const
+    {
+        if (n == 0)
+            return S_OK;
+        return interpBatch(flow, downstream, n, what, results, NULL, status);
+    }
+}
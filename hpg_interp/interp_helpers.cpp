@@ -60,42 +60,43 @@ namespace hpg
 	/// requested flow.  Returns the status of the request.
 	/// If an invalid flow is input, the output value is .
 	///
-	int Hpg::findLowerBracketingCurve(double flow, unsigned int& index)
+	int Hpg::findLowerBracketingCurve(double flow, unsigned int& index, CurveHints* hints) const
 	{
-		impl->errorCode = S_OK;
         index = 0;
 
 		// If the requested flow to bracket is out of the
-		// flow range, return an invalid index and set the
-		// error code.
-		if (! isValidFlow(flow))
-			// We want to assign the error code as well as return it.
-			return (impl->errorCode = err::InvalidFlow);
+		// flow range, return an invalid index.
+		if (! isValidFlow(flow, hints))
+			return err::InvalidFlow;
 
 		// We do different things depending on the direction of the flow.
 		if (flow >= 0.0)
 		{
+			const CurveSet& c = impl->pos;
+
 			// Look for the flow immediately less than the given input flow.
-			for (unsigned int i = 0; i < impl->posFlows.size() && impl->posFlows.at(i) < flow; i++)
-				index = i;
+			int found = c.lowerBracket(flow, false, hints);
+			if (found > 0)
+				index = found;
 
 			// Check for null splines, in which case we can't interpolate.
 			// If we have a null spline, we return an error.
-			if (impl->SplPosUS_QDS.at(index).size() == 0 || impl->SplPosUS_QDS.at(index+1).size() == 0)
-				// We want to assign the error code as well as return it.
-				return (impl->errorCode = err::InvalidFlow);
+			if (index + 1 >= c.count() || c.splineSize(index, Spl_US_DS) == 0 || c.splineSize(index + 1, Spl_US_DS) == 0)
+				return err::InvalidFlow;
 		}
 		else
 		{
+			const CurveSet& c = impl->adv;
+
 			// Look for the flow immediately less than the given input flow.
-			for (unsigned int i = 0; i < impl->advFlows.size() && impl->advFlows.at(i) > flow; i++)
-				index = i;
+			int found = c.lowerBracket(flow, true, hints);
+			if (found > 0)
+				index = found;
 
 			// Check for null splines, in which case we can't interpolate.
 			// If we have a null spline, we return an error.
-			if (impl->SplAdvUS_QDS.at(index).size() == 0 || impl->SplAdvUS_QDS.at(index+1).size() == 0)
-				// We want to assign the error code as well as return it.
-				return (impl->errorCode = err::InvalidFlow);
+			if (index + 1 >= c.count() || c.splineSize(index, Spl_US_DS) == 0 || c.splineSize(index + 1, Spl_US_DS) == 0)
+				return err::InvalidFlow;
 		}
 
 		return S_OK;
@@ -161,10 +162,10 @@ namespace hpg
 	/// Say if the given flow is in the valid range for this HPG.
 	/// true = OK, false = invalid.
 	///
-	bool Hpg::isValidFlow(double flow)
+	bool Hpg::isValidFlow(double flow, CurveHints* hints) const
 	{
 		bool ok = false;
-		if (isValidFlowExtended(flow) == 0)
+		if (isValidFlowExtended(flow, hints) == 0)
 			ok = true;
 		return ok;
 	}
@@ -173,7 +174,7 @@ namespace hpg
 	/// Say if the given flow is in the valid range for this HPG.
 	/// 0 = OK, -1 = too low, +1 = too high.
 	///
-	int Hpg::isValidFlowExtended(double flow)
+	int Hpg::isValidFlowExtended(double flow, CurveHints* hints) const
 	{
 		int ok = 0;
 		if (flow >= 0.0)
@@ -185,19 +186,20 @@ namespace hpg
 			else
 			{
 				ok = 0;
-				int index = -1;
+				const CurveSet& c = impl->pos;
 				// Look for the flow immediately less than the given input flow.
-				for (int i = 0; i < (int)impl->posFlows.size() && impl->posFlows.at(i) < flow; i++)
-					index = i;
+				int index = c.lowerBracket(flow, false, hints);
 
-                if (index == -1 && fabs(flow - impl->posFlows.at(0)) < 0.0001)
+                if (index == -1 && fabs(flow - c.flows.at(0)) < 0.0001)
                 {
                     index = 0;
                 }
 
 				// Check for null splines, in which case we can't interpolate.
 				// If we have a null spline, we return an error.
-				if (index < 0 || impl->SplPosUS_QDS.at(index).size() == 0 || impl->SplPosUS_QDS.at(index+1).size() == 0 || impl->posValues.at(index).size() < 4 || impl->posValues.at(index+1).size() < 4)
+				if (index < 0 || index + 1 >= (int)c.count() ||
+                    c.splineSize(index, Spl_US_DS) == 0 || c.splineSize(index + 1, Spl_US_DS) == 0 ||
+                    c.curveSize(index) < 4 || c.curveSize(index + 1) < 4)
 					// We want to assign the error code as well as return it.
 					ok = -1;
 			}
@@ -211,19 +213,20 @@ namespace hpg
 			else
 			{
 				ok = 0;
-				int index = -1;
+				const CurveSet& c = impl->adv;
 				// Look for the flow immediately less than the given input flow.
-				for (int i = 0; i < (int)impl->advFlows.size() && impl->advFlows.at(i) > flow; i++)
-					index = i;
+				int index = c.lowerBracket(flow, true, hints);
 
-                if (index == -1 && fabs(flow - impl->advFlows.at(0)) < 0.0001)
+                if (index == -1 && fabs(flow - c.flows.at(0)) < 0.0001)
                 {
                     index = 0;
                 }
 
 				// Check for null splines, in which case we can't interpolate.
 				// If we have a null spline, we return an error.
-				if (index < 0 || impl->SplAdvUS_QDS.at(index).size() == 0 || impl->SplAdvUS_QDS.at(index+1).size() == 0 || impl->advValues.at(index).size() < 4 || impl->advValues.at(index+1).size() < 4)
+				if (index < 0 || index + 1 >= (int)c.count() ||
+                    c.splineSize(index, Spl_US_DS) == 0 || c.splineSize(index + 1, Spl_US_DS) == 0 ||
+                    c.curveSize(index) < 4 || c.curveSize(index + 1) < 4)
 					// We want to assign the error code as well as return it.
 					ok = -1;
 			}
@@ -294,54 +297,4 @@ namespace hpg
 	//	return S_OK;
 	//}
 
-	///
-	/// Get the first point on the curve with the given index.
-	///
-	int Hpg::getFirstPointOnCurve(double flow, unsigned int curve, point& result)
-	{
-		impl->errorCode = S_OK;
-
-		if (flow >= 0.0) // Is a positive flow
-		{
-			if (curve >= impl->posFlowCount)
-				// We want to assign the error code as well as return it.
-				return (impl->errorCode = err::InvalidParam);
-			result = impl->posValues.at(curve).at(0);
-		}
-		else
-		{
-			if (curve >= impl->advFlowCount)
-				// We want to assign the error code as well as return it.
-				return (impl->errorCode = err::InvalidParam);
-			result = impl->advValues.at(curve).at(0);
-		}
-
-		return S_OK;
-	}
-
-	///
-	/// Get the first point on the curve with the given index.
-	///
-	int Hpg::getLastPointOnCurve(double flow, unsigned int curve, point& result)
-	{
-		impl->errorCode = S_OK;
-
-		if (flow >= 0.0) // Is a positive flow
-		{
-			if (curve >= impl->posFlowCount)
-				// We want to assign the error code as well as return it.
-				return (impl->errorCode = err::InvalidParam);
-			result = impl->posValues.at(curve).back();
-		}
-		else
-		{
-			if (curve >= impl->advFlowCount)
-				// We want to assign the error code as well as return it.
-				return (impl->errorCode = err::InvalidParam);
-			result = impl->advValues.at(curve).back();
-		}
-
-		return S_OK;
-	}
-
 }
@@ -56,199 +56,244 @@ using namespace std;
 
 namespace hpg
 {
-
-    /// Get the upstream value given the downstream value and the flow.
-    /// This will select the proper interpolation/extrapolation routine
-    /// and perform the interpolation/extrapolation.
-    int Hpg::InterpUpstreamHead(double flow, double downstream, double& result)
+    namespace
     {
-        impl->errorCode = S_OK;
-
-        // Get the Q_lower flow index
-        unsigned int curve;
-        int status = S_OK;
-        if (HPGFAILURE(status = findLowerBracketingCurve(flow, curve)))
+        /// The regions of the HPG between two curves that a query can fall in.
+        enum HpgRegion
         {
-            impl->errorCode = status;
-            return impl->errorCode;
-        }
+            Region_Below,       //< below the first point of either curve
+            Region_Past,        //< past the last point of the lower curve
+            Region_On,          //< on the curves, or past them once the pipe is full
+        };
 
-        // Get the first point on the Q_lower curve
-        point c1firstp;
-        if (HPGFAILURE(status = getFirstPointOnCurve(flow, curve, c1firstp)))
+        /// The derivative of Hpg::linearInterpQ with respect to the flow.
+        double linearInterpQFlowSlope(double f1, double f2, double y1, double y2)
         {
-            impl->errorCode = status;
-            return impl->errorCode;
+            return fabs(y1 - y2) / (f2 - f1);
         }
 
-        // Get the first point on the Q_upper curve
-        point c2firstp;
-        if (HPGFAILURE(status = getFirstPointOnCurve(flow, curve + 1, c2firstp)))
+        /// The derivative of Hpg::linearInterpQ with respect to something
+        /// that y1 and y2 depend on, given their derivatives dy1 and dy2.
+        double linearInterpQSlope(double flow, double f1, double f2, double y1, double y2, double dy1, double dy2)
         {
-            impl->errorCode = status;
-            return impl->errorCode;
+            double factor = (flow - f1) / (f2 - f1);
+            double sign = (y1 > y2) ? 1.0 : ((y1 < y2) ? -1.0 : 0.0);
+            return dy1 + factor * sign * (dy1 - dy2);
         }
+    }
 
-        // Get the last point on the Q_lower curve. This is used to determine
-        // if we need to perform extrapolation or interpolation.
-        point lastp;
-        if (HPGFAILURE(status = getLastPointOnCurve(flow, curve, lastp)))
-        {
-            impl->errorCode = status;
-            return impl->errorCode;
-        }
+    /// Interpolate the values selected by 'what' for the given flow and
+    /// downstream value.  The bracketing curves, their end points and the
+    /// region of the HPG that the downstream falls in are found once and
+    /// shared by all of the values.  This is the query behind both Interp
+    /// and Query: it only reads the Hpg, and returns its status rather than
+    /// setting the error code.  'hints' are the lookup hints for the
+    /// direction of the flow, or NULL to search without any.  The
+    /// derivatives of the values are also worked out if 'slopes' isn't NULL.
+    int Hpg::interp(double flow, double downstream, InterpResult& result, unsigned int what, CurveHints* hints, InterpSlopes* slopes) const
+    {
+        // If the HPG is compiled, the table answers most queries.  It has no
+        // derivatives.
+        if (impl->grid != NULL && slopes == NULL && impl->grid->lookup(flow, downstream, result, what))
+            return S_OK;
 
-        // steepness from isCurveSteep: negative = steep, positive = mild, 0 = error
+        // Get the Q_lower flow index
+        unsigned int curve;
+        int status = S_OK;
+        if (HPGFAILURE(status = findLowerBracketingCurve(flow, curve, hints)))
+            return status;
+
+        // Everything else that is needed about the bracketing curves was
+        // worked out when they were added.
+        const CurveSet& c = (flow >= 0.0) ? impl->pos : impl->adv;
+        const CurveDesc& d1 = c.desc[curve];
+        const CurveDesc& d2 = c.desc[curve + 1];
+        double flow1 = c.flows[curve];
+        double flow2 = c.flows[curve + 1];
+
+        // The steepness of the curves only matters for the upstream value.
+        // Make sure that the flow is positive before using the steepness.
         bool steepC1 = false;
         bool steepC2 = false;
-
-        // Make sure that the flow is positive before computing the steepness.
-        if (flow >= 0.0)
+        if ((what & InterpFlag_Upstream) && flow >= 0.0)
         {
-            steepC1 = isCurveSteep(curve);
-            steepC2 = isCurveSteep(curve + 1);
+            steepC1 = (d1.flags & Desc_Steep) != 0;
+            steepC2 = (d2.flags & Desc_Steep) != 0;
         }
 
-        // This tests to see if Q_lower is steep.
-        if (steepC1)
+        // If one of Q_lower and Q_upper is steep and the other is mild, then
+        // we are in a transitional region and the upstream is the average of
+        // the first points.
+        bool transitional = (steepC1 != steepC2);
+        bool wantUpstream = (what & InterpFlag_Upstream) && !transitional;
+        if (transitional)
         {
-            // If Q_lower and Q_upper are steep, then we do steep interpolation.
-            if (steepC2)
-            {
-                double upstream;
-
-                // If our downstream point is less than the downstream critical
-                // value for our flow, then we use the upstream critical value
-                // for the result.
-                if (downstream < c1firstp.x)
-                {
-                    double flow1, flow2;
-                    if (flow >= 0.0)
-                    {
-                        flow1 = impl->posFlows.at(curve);
-                        flow2 = impl->posFlows.at(curve + 1);
-                    }
-                    else
-                    {
-                        flow1 = impl->advFlows.at(curve);
-                        flow2 = impl->advFlows.at(curve + 1);
-                    }
-                    upstream = linearInterp(flow, flow1, c1firstp.y, flow2, c2firstp.y);
-                }
+            result.upstream = (d1.firstY + d2.firstY) / 2.;
+            if (slopes)
+                slopes->dUsdQ = slopes->dUsdDs = 0.0;
+        }
 
-                // Else, if our downstream is less than the first point (critical)
-                // on the Q_upper curve, then we do a special type of interpolation.
-                else if (downstream < c2firstp.x)
-                {
-                    if (HPGFAILURE(status = interpolateSteepSpecial(curve, flow, downstream, upstream)))
-                    {
-                        impl->errorCode = status;
-                        return impl->errorCode;
-                    }
-                }
+        // Find the region of the HPG that the downstream falls in.  The
+        // comparisons are all made up front, so there is one branch on the
+        // region rather than a chain of them.  If both curves end where the
+        // pipe becomes full, the curves carry on past their ends in closed
+        // form, so there is no extrapolation.
+        bool below = (downstream < d1.firstX) | (downstream < d2.firstX);
+        bool past = (downstream > d1.lastX) & ((d1.flags & d2.flags & Desc_Surcharged) == 0);
+        HpgRegion region = below ? Region_Below : (past ? Region_Past : Region_On);
 
-                // Else, if we are more than the last downstream point on the curve,
-                // then we extrapolate.
-                else if (downstream > lastp.x)
+        switch (region)
+        {
+        // If our downstream is less than the first point on the upper or lower
+        // bounding curve, then interpolate between the first points.
+        case Region_Below:
+            if (wantUpstream)
+            {
+                // If both curves are steep and our downstream is between the
+                // first points of the curves, then we do a special type of
+                // interpolation.  Otherwise we use the upstream critical value.
+                if (steepC1 && downstream >= d1.firstX)
                 {
-                    if (HPGFAILURE(status = standardExtrapolation(curve, flow, downstream, upstream)))
+                    double dsSlope;
+                    if (HPGFAILURE(status = interpolateSteepSpecial(curve, flow, downstream, result.upstream, hints, &dsSlope)))
+                        return status;
+                    if (slopes)
                     {
-                        impl->errorCode = status;
-                        return impl->errorCode;
+                        slopes->dUsdQ = 0.0;
+                        slopes->dUsdDs = dsSlope;
                     }
                 }
-
-                // Otherwise, we do standard interpolation.
                 else
                 {
-                    if (HPGFAILURE(status = standardInterpolation(curve, flow, downstream, upstream, InterpValue::Interp_Upstream)))
+                    result.upstream = linearInterp(flow, flow1, d1.firstY, flow2, d2.firstY);
+                    if (slopes)
                     {
-                        impl->errorCode = status;
-                        return impl->errorCode;
+                        slopes->dUsdQ = (d2.firstY - d1.firstY) / (flow2 - flow1);
+                        slopes->dUsdDs = 0.0;
                     }
                 }
+            }
 
-                // Save the result.
-                result = upstream;
-
-            }//end if (steepC2)
-
-            // Else, if Q_lower is steep and Q_upper is mild, then we are
-            // in a transitional region.
-            else
+            if (what & InterpFlag_Volume)
+                result.volume = linearInterpQ(flow, flow1, flow2, d1.firstV, d2.firstV);
+            if (what & InterpFlag_Hf)
+                result.hf = linearInterpQ(flow, flow1, flow2, d1.firstHf, d2.firstHf);
+            if (slopes)
             {
-                double upstream = (c1firstp.y + c2firstp.y) / 2.;
-                result = upstream;
-            }//end else
-        }//end if (steepC1)
+                slopes->dVoldQ = linearInterpQFlowSlope(flow1, flow2, d1.firstV, d2.firstV);
+                slopes->dHfdQ = linearInterpQFlowSlope(flow1, flow2, d1.firstHf, d2.firstHf);
+                slopes->dVoldDs = slopes->dHfdDs = 0.0;
+            }
+            break;
 
-        // If the matching if conditional is false, then this means
-        // our Q_lower curve is mild.
-        else
-        {
-            // If Q_lower is mild and Q_upper is steep, then we are in
-            // a transitional region.
-            if (steepC2)
-            {
-                double upstream;
-                upstream = (c1firstp.y + c2firstp.y) / 2.;
-                result = upstream;
-            }//end if (steepC2)
-
-            // Else, if Q_lower and Q_upper are mild, then we do mild
-            // interpolation.
-            else
+        // If our downstream more than the downstream point for the last
+        // point on the curve, then we do extrapolation instead of interpolation.
+        // The extrapolation is the same for all of the values.
+        case Region_Past:
+            if (wantUpstream || (what & (InterpFlag_Volume | InterpFlag_Hf)))
             {
-                double upstream;
-
-                // If our downstream is less than the first point downstream, then
-                // use the upstream critical depth for the given flow.
-                // If our downstream is less than the first point on the upper
-                // bounding curve, then use the upstream critical depth.
-                if (downstream < c1firstp.x || downstream < c2firstp.x)
+                double value, flowSlope;
+                if (HPGFAILURE(status = standardExtrapolation(curve, flow, downstream, value, &flowSlope)))
+                    return status;
+
+                if (wantUpstream)
+                    result.upstream = value;
+                if (what & InterpFlag_Volume)
+                    result.volume = value;
+                if (what & InterpFlag_Hf)
+                    result.hf = value;
+                if (slopes)
                 {
-                    double flow1, flow2;
-                    if (flow >= 0.0)
+                    if (wantUpstream)
                     {
-                        flow1 = impl->posFlows.at(curve);
-                        flow2 = impl->posFlows.at(curve + 1);
+                        slopes->dUsdQ = flowSlope;
+                        slopes->dUsdDs = 0.0;
                     }
-                    else
-                    {
-                        flow1 = impl->advFlows.at(curve);
-                        flow2 = impl->advFlows.at(curve + 1);
-                    }
-                    upstream = linearInterp(flow, flow1, c1firstp.y, flow2, c2firstp.y);
+                    slopes->dVoldQ = slopes->dHfdQ = flowSlope;
+                    slopes->dVoldDs = slopes->dHfdDs = 0.0;
                 }
+            }
+            break;
 
-                // If our downstream more than the downstream point for the last
-                // point on the curve, then we do extrapolation instead of interpolation.
-                else if (downstream > lastp.x)
+        // Else, we are on the curves and we do our standard interpolation,
+        // evaluating all of the splines of each curve in one go (or the
+        // full-pipe closed form past the end of a curve).
+        case Region_On:
+            {
+                double us1, vol1, hf1;
+                double us2, vol2, hf2;
+                double s1[3], s2[3];
+                c.evalDsSplines(curve, downstream, us1, vol1, hf1, hints, slopes ? s1 : NULL);
+                c.evalDsSplines(curve + 1, downstream, us2, vol2, hf2, hints, slopes ? s2 : NULL);
+
+                if (wantUpstream)
+                    result.upstream = linearInterpQ(flow, flow1, flow2, us1, us2);
+                if (what & InterpFlag_Volume)
+                    result.volume = linearInterpQ(flow, flow1, flow2, vol1, vol2);
+                if (what & InterpFlag_Hf)
+                    result.hf = linearInterpQ(flow, flow1, flow2, hf1, hf2);
+
+                if (slopes)
                 {
-                    if (HPGFAILURE(status = standardExtrapolation(curve, flow, downstream, upstream)))
+                    if (wantUpstream)
                     {
-                        impl->errorCode = status;
-                        return impl->errorCode;
+                        slopes->dUsdQ = linearInterpQFlowSlope(flow1, flow2, us1, us2);
+                        slopes->dUsdDs = linearInterpQSlope(flow, flow1, flow2, us1, us2, s1[0], s2[0]);
                     }
+                    slopes->dVoldQ = linearInterpQFlowSlope(flow1, flow2, vol1, vol2);
+                    slopes->dVoldDs = linearInterpQSlope(flow, flow1, flow2, vol1, vol2, s1[1], s2[1]);
+                    slopes->dHfdQ = linearInterpQFlowSlope(flow1, flow2, hf1, hf2);
+                    slopes->dHfdDs = linearInterpQSlope(flow, flow1, flow2, hf1, hf2, s1[2], s2[2]);
                 }
+            }
+            break;
+        }
 
-                // Else, we are on the curve and we do our standard interpolation.
-                else
-                {
-                    if (HPGFAILURE(status = standardInterpolation(curve, flow, downstream, upstream, InterpValue::Interp_Upstream)))
-                    {
-                        impl->errorCode = status;
-                        return impl->errorCode;
-                    }
-                }
+        return S_OK;
+    }
 
-                result = upstream;
-            }//end else
-        }//end else
+    /// Interpolate the values selected by 'what' for the given flow and
+    /// downstream value, using the lookup hints kept in the Hpg and setting
+    /// its error code.
+    int Hpg::Interp(double flow, double downstream, InterpResult& result, unsigned int what)
+    {
+        CurveHints* hints = (flow >= 0.0) ? &impl->posHints : &impl->advHints;
+        impl->errorCode = interp(flow, downstream, result, what, hints, NULL);
+        return impl->errorCode;
+    }
 
-        return S_OK;
+    /// The same as Interp, also giving the partial derivatives of the values.
+    int Hpg::Interp(double flow, double downstream, InterpResult& result, InterpSlopes& slopes, unsigned int what)
+    {
+        CurveHints* hints = (flow >= 0.0) ? &impl->posHints : &impl->advHints;
+        impl->errorCode = interp(flow, downstream, result, what, hints, &slopes);
+        return impl->errorCode;
+    }
+
+    /// The same as Interp, without the lookup hints or the error code, so
+    /// that any number of threads can query at once.
+    int Hpg::Query(double flow, double downstream, InterpResult& result, unsigned int what) const
+    {
+        return interp(flow, downstream, result, what, NULL, NULL);
     }
 
+    /// The same as Query, also giving the partial derivatives of the values.
+    int Hpg::Query(double flow, double downstream, InterpResult& result, InterpSlopes& slopes, unsigned int what) const
+    {
+        return interp(flow, downstream, result, what, NULL, &slopes);
+    }
+
+    /// Get the upstream value given the downstream value and the flow.
+    /// This will select the proper interpolation/extrapolation routine
+    /// and perform the interpolation/extrapolation.
+    int Hpg::InterpUpstreamHead(double flow, double downstream, double& result)
+    {
+        InterpResult values;
+        int status = Interp(flow, downstream, values, InterpFlag_Upstream);
+        if (!HPGFAILURE(status))
+            result = values.upstream;
+        return status;
+    }
     //int Hpg::GetDownstreamExactFlow(double flow, double upstream, double& result)
     //{
     //    if (fabs(flow) < 0.00001)
@@ -292,174 +337,57 @@ namespace hpg
     //    return S_OK;
     //}
 
-    /// Get the upstream value given the downstream value and the flow.
-    /// This will select the proper interpolation/extrapolation routine
-    /// and perform the interpolation/extrapolation.
+    /// Get the volume given the downstream value and the flow.
     int Hpg::InterpVolume(double flow, double downstream, double& result)
     {
-        impl->errorCode = S_OK;
-
-        // Get the Q_lower flow index
-        unsigned int curve;
-        int status = S_OK;
-        if (HPGFAILURE(status = findLowerBracketingCurve(flow, curve)))
-        {
-            impl->errorCode = status;
-            return impl->errorCode;
-        }
-
-        // Get the first point on the Q_lower curve
-        point c1firstp;
-        if (HPGFAILURE(status = getFirstPointOnCurve(flow, curve, c1firstp)))
-        {
-            impl->errorCode = status;
-            return impl->errorCode;
-        }
-
-        // Get the first point on the Q_upper curve
-        point c2firstp;
-        if (HPGFAILURE(status = getFirstPointOnCurve(flow, curve+1, c2firstp)))
-        {
-            impl->errorCode = status;
-            return impl->errorCode;
-        }
-
-        // Get the last point on the Q_lower curve. This is used to determine
-        // if we need to perform extrapolation or interpolation.
-        point lastp;
-        if (HPGFAILURE(status = getLastPointOnCurve(flow, curve, lastp)))
-        {
-            impl->errorCode = status;
-            return impl->errorCode;
-        }
-
-        // If our downstream is less than the first point on the upper and lower
-		// bounding curves, then interpolate between the volumes.
-        if (downstream < c1firstp.x || downstream < c2firstp.x)
-        {
-			double f1, f2;
-			if (flow >= 0.0)
-			{
-				f1 = impl->posFlows.at(curve);
-				f2 = impl->posFlows.at(curve+1);
-			}
-			else
-			{
-				f1 = impl->advFlows.at(curve);
-				f2 = impl->advFlows.at(curve+1);
-			}
-
-			result = linearInterpQ(flow, f1, f2, c1firstp.v, c2firstp.v);
-			return S_OK;
-        }
-
-        // If our downstream more than the downstream point for the last
-        // point on the curve, then we do extrapolation instead of interpolation.
-        else if (downstream > lastp.x)
-        {
-            if (HPGFAILURE(status = standardExtrapolation(curve, flow, downstream, result)))
-            {
-                impl->errorCode = status;
-                return impl->errorCode;
-            }
-        }
-
-        // Else, we are on the curve and we do our standard interpolation.
-        else
-        {
-            if (HPGFAILURE(status = standardInterpolation(curve, flow, downstream, result, InterpValue::Interp_Volume))) // true for volumes
-            {
-                impl->errorCode = status;
-                return impl->errorCode;
-            }
-        }
-
-		return S_OK;
+        InterpResult values;
+        int status = Interp(flow, downstream, values, InterpFlag_Volume);
+        if (!HPGFAILURE(status))
+            result = values.volume;
+        return status;
     }
 
     /// Get the upstream hf friction value given the downstream depth and the flow.
-    /// This will select the proper interpolation/extrapolation routine
-    /// and perform the interpolation/extrapolation.
     int Hpg::InterpHf(double flow, double downstream, double& result)
     {
-        impl->errorCode = S_OK;
-
-        // Get the Q_lower flow index
-        unsigned int curve;
-        int status = S_OK;
-        if (HPGFAILURE(status = findLowerBracketingCurve(flow, curve)))
-        {
-            impl->errorCode = status;
-            return impl->errorCode;
-        }
-
-        // Get the first point on the Q_lower curve
-        point c1firstp;
-        if (HPGFAILURE(status = getFirstPointOnCurve(flow, curve, c1firstp)))
-        {
-            impl->errorCode = status;
-            return impl->errorCode;
-        }
-
-        // Get the first point on the Q_upper curve
-        point c2firstp;
-        if (HPGFAILURE(status = getFirstPointOnCurve(flow, curve+1, c2firstp)))
-        {
-            impl->errorCode = status;
-            return impl->errorCode;
-        }
-
-        // Get the last point on the Q_lower curve. This is used to determine
-        // if we need to perform extrapolation or interpolation.
-        point lastp;
-        if (HPGFAILURE(status = getLastPointOnCurve(flow, curve, lastp)))
-        {
-            impl->errorCode = status;
-            return impl->errorCode;
-        }
-
-        // If our downstream is less than the first point on the upper and lower
-		// bounding curves, then interpolate between the hf.
-        if (downstream < c1firstp.x || downstream < c2firstp.x)
-        {
-			double f1, f2;
-			if (flow >= 0.0)
-			{
-				f1 = impl->posFlows.at(curve);
-				f2 = impl->posFlows.at(curve+1);
-			}
-			else
-			{
-				f1 = impl->advFlows.at(curve);
-				f2 = impl->advFlows.at(curve+1);
-			}
-
-			result = linearInterpQ(flow, f1, f2, c1firstp.hf, c2firstp.hf);
-			return S_OK;
-        }
+        InterpResult values;
+        int status = Interp(flow, downstream, values, InterpFlag_Hf);
+        if (!HPGFAILURE(status))
+            result = values.hf;
+        return status;
+    }
 
-        // If our downstream more than the downstream point for the last
-        // point on the curve, then we do extrapolation instead of interpolation.
-        else if (downstream > lastp.x)
-        {
-            if (HPGFAILURE(status = standardExtrapolation(curve, flow, downstream, result)))
-            {
-                impl->errorCode = status;
-                return impl->errorCode;
-            }
-        }
+    /// Get the upstream value given the downstream value and the flow.
+    /// Safe to call from several threads at once.
+    int Hpg::QueryUpstreamHead(double flow, double downstream, double& result) const
+    {
+        InterpResult values;
+        int status = Query(flow, downstream, values, InterpFlag_Upstream);
+        if (!HPGFAILURE(status))
+            result = values.upstream;
+        return status;
+    }
 
-        // Else, we are on the curve and we do our standard interpolation.
-        else
-        {
-            if (HPGFAILURE(status = standardInterpolation(curve, flow, downstream, result, InterpValue::Interp_Hf)))
-            {
-                impl->errorCode = status;
-                return impl->errorCode;
-            }
-        }
+    /// Get the volume given the downstream value and the flow.  Safe to
+    /// call from several threads at once.
+    int Hpg::QueryVolume(double flow, double downstream, double& result) const
+    {
+        InterpResult values;
+        int status = Query(flow, downstream, values, InterpFlag_Volume);
+        if (!HPGFAILURE(status))
+            result = values.volume;
+        return status;
+    }
 
-		return S_OK;
+    /// Get the upstream hf friction value given the downstream depth and
+    /// the flow.  Safe to call from several threads at once.
+    int Hpg::QueryHf(double flow, double downstream, double& result) const
+    {
+        InterpResult values;
+        int status = Query(flow, downstream, values, InterpFlag_Hf);
+        if (!HPGFAILURE(status))
+            result = values.hf;
+        return status;
     }
 
     ///// Get the upstream value on the critical line for the given flow.
@@ -772,94 +700,7 @@ namespace hpg
     //}
 
 
-    /// Do standard linear interpolation.  This is used for both
-    /// mild, steep, and adverse slope curves.
-    int Hpg::standardInterpolation(unsigned int curve, double flow, double input, double& result, InterpValue interpAction)
-    {
-        impl->errorCode = S_OK;
-        int status = S_OK;
-
-		double flow1, flow2;
-		double upstream1, upstream2;
-
-        if (flow >= 0.0)
-		{
-			flow1 = impl->posFlows.at(curve);
-			flow2 = impl->posFlows.at(curve + 1);
-		}
-        else
-		{
-			flow1 = impl->advFlows.at(curve);
-			flow2 = impl->advFlows.at(curve + 1);
-		}
-
-		if (interpAction == InterpValue::Interp_Hf)
-		{
-			if (flow >= 0.0)
-			{
-				upstream1 = impl->SplPosHf.at(curve)(input);
-				upstream2 = impl->SplPosHf.at(curve+1)(input);
-			}
-			else
-			{
-				upstream1 = impl->SplAdvHf.at(curve)(input);
-				upstream2 = impl->SplAdvHf.at(curve+1)(input);
-			}
-		}
-		else if (interpAction == InterpValue::Interp_Volume)
-		{
-			if (flow >= 0.0)
-			{
-				upstream1 = impl->SplPosVol.at(curve)(input);
-				upstream2 = impl->SplPosVol.at(curve+1)(input);
-			}
-			else
-			{
-				upstream1 = impl->SplAdvVol.at(curve)(input);
-				upstream2 = impl->SplAdvVol.at(curve+1)(input);
-			}
-		}
-		else if (interpAction == InterpValue::Interp_Upstream)
-		{
-			if (flow >= 0.0)
-			{
-                //if (input >= impl->dsInvert + impl->maxDepth)
-                //{
-                //}
-                //else
-                //{
-                    upstream1 = impl->SplPosUS_QDS.at(curve)(input);
-                    upstream2 = impl->SplPosUS_QDS.at(curve + 1)(input);
-                //}
-			}
-			else
-			{
-				upstream1 = impl->SplAdvUS_QDS.at(curve)(input);
-				upstream2 = impl->SplAdvUS_QDS.at(curve+1)(input);
-			}
-		}
-		else if (interpAction == InterpValue::Interp_Downstream)
-		{
-			if (flow >= 0.0)
-			{
-				upstream1 = impl->SplPosDS_QUS.at(curve)(input);
-				upstream2 = impl->SplPosDS_QUS.at(curve+1)(input);
-			}
-			else
-			{
-				upstream1 = impl->SplAdvDS_QUS.at(curve)(input);
-				upstream2 = impl->SplAdvDS_QUS.at(curve+1)(input);
-			}
-		}
-
-        // Interpolate linearly between the two curves.
-        result = linearInterpQ(flow, flow1, flow2, upstream1, upstream2);
-
-        return S_OK;
-    }
-
-
-	double Hpg::linearInterpQ(double flow, double f1, double f2, double y1, double y2)
+	double Hpg::linearInterpQ(double flow, double f1, double f2, double y1, double y2) const
 	{
         // Compute the flow factor.  This is (flow - flow_c1)/(flow_c2 - flow_c1).
         double factor = (flow - f1) / (f2 - f1);
@@ -868,7 +709,7 @@ namespace hpg
 	}
 
 
-	double Hpg::linearInterp(double x, double x1, double y1, double x2, double y2)
+	double Hpg::linearInterp(double x, double x1, double y1, double x2, double y2) const
 	{
 		double m = (y2 - y1) / (x2 - x1);
 		return m * (x - x2) + y2;
@@ -878,9 +719,8 @@ namespace hpg
     /// Do interpolation in the steep region where the downstream
     /// is between the min downstream values for the curves bracketing
     /// the given flow.
-    int Hpg::interpolateSteepSpecial(unsigned int curve, double flow, double downstream, double& result)
+    int Hpg::interpolateSteepSpecial(unsigned int curve, double flow, double downstream, double& result, CurveHints* hints, double* dsSlope) const
     {
-        impl->errorCode = S_OK;
         int status = S_OK;
 
         /*
@@ -899,15 +739,16 @@ namespace hpg
         }
         */
 
-        point p1 = impl->posCritical.at(curve);
-        point p2 = impl->posCritical.at(curve+1);
+        const CurveDesc& p1 = impl->pos.desc[curve];
+        const CurveDesc& p2 = impl->pos.desc[curve+1];
 
         // Get the point on the c-line that corresponds to the input downstream depth.
         //double pointOnCline = (p2.y - critUp) / (p2.x - critDown) * (downstream - critDown) + critUp;
 
         // Linearly interpolate on the c-line between the first points on the lower
         // and upper bounding curves.
-        double yDonCline = (p2.y - p1.y) / (p2.x - p1.x) * (downstream - p1.x) + p1.y;
+        double clineSlope = (p2.critY - p1.critY) / (p2.critX - p1.critX);
+        double yDonCline = clineSlope * (downstream - p1.critX) + p1.critY;
 
         /*
           Another method, but I think it underestimates the value: -- NOO
@@ -919,21 +760,22 @@ namespace hpg
 
         // Evaluate the lower bounding spline at the downstream depth to get the
         // upstream depth on that spline.
-        double upstream;
+        double upstream, upstreamSlope;
         if (flow > 0.0)
-            upstream = impl->SplPosUS_QDS.at(curve)(downstream);
+            upstream = impl->pos.evalSpline(curve, Spl_US_DS, downstream, hints, &upstreamSlope);
+        else if (impl->adv.splineSize(curve, Spl_US_DS))
+            upstream = impl->adv.evalSpline(curve, Spl_US_DS, downstream, hints, &upstreamSlope);
         else
-            upstream = impl->SplAdvUS_QDS.at(curve)(downstream);
+            status = err::InvalidParam;
 
         if (status)
-        {
-            impl->errorCode = err::GenericInterpFailed;
-            return impl->errorCode;
-        }
+            return err::GenericInterpFailed;
 
         // Now say that the upstream point that we want is half-way between the
         // point on the c-line and the upstream value on the lower bounding curve.
         result = (upstream + yDonCline) * 0.5;
+        if (dsSlope)
+            *dsSlope = (upstreamSlope + clineSlope) * 0.5;
 
         return S_OK;
     }
@@ -942,39 +784,29 @@ namespace hpg
     /// Do standard extrapolation.  This extrapolates the HPG
     /// for the given flow to the downstream value and gets the
     /// upstream value.
-    int Hpg::standardExtrapolation(unsigned int curve, double flow, double downstream, double& result)
+    int Hpg::standardExtrapolation(unsigned int curve, double flow, double downstream, double& result, double* flowSlope) const
     {
-		int status = S_OK;
-
-		// Get the last point on the curves.
-		point lastp1;
-		if (HPGFAILURE(status = getLastPointOnCurve(flow, curve, lastp1)))
-		{
-			impl->errorCode = status;
-			return impl->errorCode;
-		}
-
-		point lastp2;
-		if (HPGFAILURE(status = getLastPointOnCurve(flow, curve+1, lastp2)))
-		{
-			impl->errorCode = status;
-			return impl->errorCode;
-		}
+		// Get the last points on the curves.
+		const CurveSet& c = (flow >= 0.0) ? impl->pos : impl->adv;
+		double last1 = c.desc[curve].lastY;
+		double last2 = c.desc[curve+1].lastY;
 
 		// Get the flows for each curve.
 		double f1, f2;
-		if (flow > 0.0)
+		if (flow >= 0.0)
 		{
-			f1 = impl->posFlows.at(curve);
-			f2 = impl->posFlows.at(curve+1);
+			f1 = impl->pos.flows.at(curve);
+			f2 = impl->pos.flows.at(curve+1);
 		}
 		else
 		{
-			f1 = impl->advFlows.at(curve);
-			f2 = impl->advFlows.at(curve+1);
+			f1 = impl->adv.flows.at(curve);
+			f2 = impl->adv.flows.at(curve+1);
 		}
 
-		result = linearInterpQ(flow, f1, f2, lastp1.y, lastp2.y);
+		result = linearInterpQ(flow, f1, f2, last1, last2);
+		if (flowSlope)
+			*flowSlope = linearInterpQFlowSlope(f1, f2, last1, last2);
 
 		return S_OK;
     }
@@ -71,6 +71,76 @@ namespace hpg
         Interp_Volume,
 		Interp_Hf,
     };
+
+    /// Bits selecting the quantities that Hpg::Interp computes.
+    enum InterpFlag
+    {
+        InterpFlag_Upstream = 0x1,
+        InterpFlag_Volume   = 0x2,
+        InterpFlag_Hf       = 0x4,
+        InterpFlag_All      = 0x7,
+    };
+
+    /// Values returned by Hpg::Interp.  Only the members selected by the
+    /// InterpFlag bits are set.
+    struct InterpResult
+    {
+        double upstream;
+        double volume;
+        double hf;
+    };
+
+    /// Partial derivatives of the values returned by Hpg::Interp with
+    /// respect to the flow (Q) and the downstream head (DS).  Only the
+    /// members of the values selected by the InterpFlag bits are set.  The
+    /// values are piecewise linear in DS between the knots of the curves
+    /// and in Q between the curves; at a knot or a curve the derivative is
+    /// the one on the side below it.
+    struct InterpSlopes
+    {
+        double dUsdQ;               //< d(upstream)/dQ
+        double dUsdDs;              //< d(upstream)/dDS
+        double dVoldQ;              //< d(volume)/dQ
+        double dVoldDs;             //< d(volume)/dDS
+        double dHfdQ;               //< d(hf)/dQ
+        double dHfdDs;              //< d(hf)/dDS
+    };
+
+    /// What Hpg::Compile achieved.  The errors are the largest differences
+    /// from the spline interpolation over the cells that the table answers;
+    /// the other cells are answered by the splines.
+    struct CompileStats
+    {
+        double maxHeadError;        //< upstream head and hf error
+        double maxVolumeError;      //< volume error, relative to the largest volume of each bracket
+        unsigned int cells;         //< number of table cells
+        unsigned int exactCells;    //< cells left to the splines
+        size_t memory;              //< bytes used by the table
+    };
+
+    /// What Hpg::Thin removed, and the largest differences from the HPG it
+    /// started with that it measured over the flows and downstreams of the
+    /// original curves (and between them).
+    struct ThinStats
+    {
+        unsigned int curvesBefore;
+        unsigned int curvesAfter;
+        unsigned int pointsBefore;
+        unsigned int pointsAfter;
+        double maxHeadError;        //< upstream head and hf error
+        double maxVolumeError;      //< volume error, relative to the largest volume of each bracket
+        unsigned int samples;       //< number of (flow, downstream) pairs compared
+    };
+
+    /// How many of the curves of a HPG have their splines built.  With lazy
+    /// splines (Hpg::SetLazySplines) a curve's splines are only built the
+    /// first time it is interpolated, so this grows with the flows seen.
+    struct SplineStats
+    {
+        unsigned int curves;        //< positive and adverse curves
+        unsigned int builtCurves;   //< curves whose splines have been built
+        size_t memory;              //< bytes used by the spline coefficients
+    };
 }
 
 
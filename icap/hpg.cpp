@@ -47,9 +47,13 @@
 
 #define _CRT_SECURE_NO_DEPRECATE
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstring>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <boost/filesystem.hpp>
 
 #include "../hpg_interp/hpg.hpp"
@@ -89,27 +93,84 @@ bool IcapHpg::allocate(int count_in)
 
 std::shared_ptr<hpg::Hpg> IcapHpg::getHpg(id_type linkId)
 {
-    if (m_list.count(linkId))
-        return m_list[linkId];
+    const LinkHpg* entry = findHpg(linkId);
+    if (entry != NULL)
+        return entry->hpg;
     else
         return NULL;
 }
 
-bool IcapHpg::loadHPG(id_type linkId, const std::string& path)
+
+const IcapHpg::LinkHpg* IcapHpg::findHpg(id_type linkId) const
 {
-    if (m_list.count(linkId))
-        return false;
+    auto it = m_list.find(linkId);
+    if (it == m_list.end() || it->second.hpg == NULL)
+        return NULL;
+    return &it->second;
+}
 
-	int errCode = 0;
-    //TODO:
-	hpg::Hpg* h = new hpg::Hpg();
-    if (!h->LoadFromFile(path))
-        return false;
-    else if (errCode = h->getErrorCode())
-        return false;
 
-	m_list.insert(std::make_pair(linkId, std::shared_ptr<hpg::Hpg>(h)));
-	return true;
+HpgSignature::HpgSignature(double diameter, double roughness, double length, double drop)
+{
+    this->diameter = (long long)floor(diameter * 1e6 + 0.5);
+    this->roughness = (long long)floor(roughness * 1e6 + 0.5);
+    this->length = (long long)floor(length * 1e6 + 0.5);
+    this->drop = (long long)floor(drop * 1e6 + 0.5);
+}
+
+
+HpgSignature HpgSignature::of(std::shared_ptr<geometry::Link> link)
+{
+    return HpgSignature(link->getMaxDepth(), link->getRoughness(), link->getLength(),
+        link->getUpstreamInvert() - link->getDownstreamInvert());
+}
+
+
+bool HpgSignature::operator<(const HpgSignature& other) const
+{
+    if (diameter != other.diameter)
+        return diameter < other.diameter;
+    if (roughness != other.roughness)
+        return roughness < other.roughness;
+    if (length != other.length)
+        return length < other.length;
+    return drop < other.drop;
+}
+
+
+bool HpgSignature::operator==(const HpgSignature& other) const
+{
+    return diameter == other.diameter && roughness == other.roughness && length == other.length && drop == other.drop;
+}
+
+std::shared_ptr<hpg::Hpg> IcapHpg::readHPG(const std::string& path, std::string& error, const std::string& textHash) const
+{
+    std::shared_ptr<hpg::Hpg> h(new hpg::Hpg());
+    h->SetLazySplines(m_options.lazySplines);
+    if (! h->LoadFromFile(path) || h->getErrorCode())
+    {
+        error = "Failed to load HPG.  File=" + path + ": " + h->getErrorMessage();
+        return NULL;
+    }
+
+    // The lookup table isn't part of the binary format, so the HPG is
+    // cached before it is compiled.
+    if (! textHash.empty())
+        m_diskCache.store(*h, textHash);
+
+    return compileHPG(h, path, error);
+}
+
+
+std::shared_ptr<hpg::Hpg> IcapHpg::compileHPG(std::shared_ptr<hpg::Hpg> h, const std::string& path, std::string& error) const
+{
+    if (m_options.compileError > 0.0 && HPGFAILURE(h->Compile(m_options.compileError, m_options.compileVolumeError)))
+    {
+        error = "Failed to compile HPG.  File=" + path + ": " + h->getErrorMessage();
+        return NULL;
+    }
+
+    return h;
 }
 
 //
@@ -195,15 +256,23 @@ bool IcapHpg::loadHPG(id_type linkId, const std::string& path)
 
 bool IcapHpg::getUpstream(id_type linkId, var_type dsHead, var_type flow, var_type& usHead)
 {
-    std::shared_ptr<hpg::Hpg> hpg = getHpg(linkId);
-    if (hpg == NULL)
+    hpg::InterpResult values;
+    if (m_cache.isEnabled() && m_cache.find(linkId, flow, dsHead, hpg::InterpFlag_Upstream, values))
+    {
+        usHead = values.upstream;
+        return true;
+    }
+
+    const LinkHpg* entry = findHpg(linkId);
+    if (entry == NULL)
     {
         setErrorMessage("Invalid HPG object");
         return false;
     }
+    hpg::Hpg* hpg = entry->hpg.get();
 
     double depth;
-    int errCode = hpg->InterpUpstreamHead(flow, dsHead, usHead);
+    int errCode = hpg->InterpUpstreamHead(flow, dsHead - entry->offset, usHead);
 
     if (HPGFAILURE(errCode))
     {
@@ -214,6 +283,9 @@ bool IcapHpg::getUpstream(id_type linkId, var_type dsHead, var_type flow, var_ty
     }
     else
     {
+        usHead += entry->offset;
+        values.upstream = usHead;
+        m_cache.insert(linkId, flow, dsHead, hpg::InterpFlag_Upstream, values);
         return true;
     }
 }
@@ -221,14 +293,22 @@ bool IcapHpg::getUpstream(id_type linkId, var_type dsHead, var_type flow, var_ty
 
 bool IcapHpg::getHf(id_type linkId, var_type dsHead, var_type flow, var_type& hf)
 {
-    std::shared_ptr<hpg::Hpg> hpg = getHpg(linkId);
-    if (hpg == NULL)
+    hpg::InterpResult values;
+    if (m_cache.isEnabled() && m_cache.find(linkId, flow, dsHead, hpg::InterpFlag_Hf, values))
+    {
+        hf = values.hf;
+        return true;
+    }
+
+    const LinkHpg* entry = findHpg(linkId);
+    if (entry == NULL)
     {
         setErrorMessage("Invalid HPG object");
         return false;
     }
+    hpg::Hpg* hpg = entry->hpg.get();
 
-    int errCode = hpg->InterpHf(flow, dsHead, hf);
+    int errCode = hpg->InterpHf(flow, dsHead - entry->offset, hf);
 
     if (HPGFAILURE(errCode))
     {
@@ -239,6 +319,8 @@ bool IcapHpg::getHf(id_type linkId, var_type dsHead, var_type flow, var_type& hf
     }
     else
     {
+        values.hf = hf;
+        m_cache.insert(linkId, flow, dsHead, hpg::InterpFlag_Hf, values);
         return true;
     }
 }
@@ -265,14 +347,22 @@ bool IcapHpg::getHf(id_type linkId, var_type dsHead, var_type flow, var_type& hf
 
 bool IcapHpg::getVolume(id_type linkId, var_type dsHead, var_type flow, var_type& volume)
 {
-    std::shared_ptr<hpg::Hpg> hpg = getHpg(linkId);
-    if (hpg == NULL)
+    hpg::InterpResult values;
+    if (m_cache.isEnabled() && m_cache.find(linkId, flow, dsHead, hpg::InterpFlag_Volume, values))
+    {
+        volume = values.volume;
+        return true;
+    }
+
+    const LinkHpg* entry = findHpg(linkId);
+    if (entry == NULL)
     {
         setErrorMessage("Invalid HPG object");
         return false;
     }
+    hpg::Hpg* hpg = entry->hpg.get();
 
-    int errCode = hpg->InterpVolume(flow, dsHead, volume);
+    int errCode = hpg->InterpVolume(flow, dsHead - entry->offset, volume);
 
     if (HPGFAILURE(errCode))
     {
@@ -281,8 +371,69 @@ bool IcapHpg::getVolume(id_type linkId, var_type dsHead, var_type flow, var_type
         setErrorMessage("hpg_getVolume failed: code=" + std::string(code) + " message=" + hpg->getErrorMessage());
         return false;
     }
-	else
-	    return true;
+    else
+    {
+        values.volume = volume;
+        m_cache.insert(linkId, flow, dsHead, hpg::InterpFlag_Volume, values);
+        return true;
+    }
+}
+
+
+bool IcapHpg::getValues(id_type linkId, var_type dsHead, var_type flow, hpg::InterpResult& values, unsigned int what)
+{
+    if (m_cache.isEnabled() && m_cache.find(linkId, flow, dsHead, what, values))
+        return true;
+
+    const LinkHpg* entry = findHpg(linkId);
+    if (entry == NULL)
+    {
+        setErrorMessage("Invalid HPG object");
+        return false;
+    }
+    hpg::Hpg* hpg = entry->hpg.get();
+
+    int errCode = hpg->Interp(flow, dsHead - entry->offset, values, what);
+
+    if (HPGFAILURE(errCode))
+    {
+        char code[20];
+        sprintf(code, "%d", errCode);
+        setErrorMessage("hpg_getValues failed: code=" + std::string(code) + " message=" + hpg->getErrorMessage());
+        return false;
+    }
+    else
+    {
+        if (what & hpg::InterpFlag_Upstream)
+            values.upstream += entry->offset;
+        m_cache.insert(linkId, flow, dsHead, what, values);
+        return true;
+    }
+}
+
+
+bool IcapHpg::getValues(id_type linkId, var_type dsHead, var_type flow, hpg::InterpResult& values, hpg::InterpSlopes& slopes, unsigned int what)
+{
+    const LinkHpg* entry = findHpg(linkId);
+    if (entry == NULL)
+    {
+        setErrorMessage("Invalid HPG object");
+        return false;
+    }
+    hpg::Hpg* hpg = entry->hpg.get();
+
+    int errCode = hpg->Interp(flow, dsHead - entry->offset, values, slopes, what);
+
+    if (HPGFAILURE(errCode))
+    {
+        char code[20];
+        sprintf(code, "%d", errCode);
+        setErrorMessage("hpg_getValues failed: code=" + std::string(code) + " message=" + hpg->getErrorMessage());
+        return false;
+    }
+    if (what & hpg::InterpFlag_Upstream)
+        values.upstream += entry->offset;
+    return true;
 }
 
 //
@@ -553,11 +704,24 @@ int IcapHpg::loadNextHpg(const std::string& path, geometry::LinkList* linkList)
     {
         if (! allocate(linkList->count()))
             return 1;
+        m_cache.configure(m_options.cache);
+        m_shared.clear();
+        m_shareStats = HpgShareStats();
+        if (! openDiskCache())
+            return 1;
+        if (HpgBundle::isBundle(path) && ! m_bundle.open(path))
+        {
+            setErrorMessage(m_bundle.getErrorMessage());
+            return 1;
+        }
     }
 
     m_currentHPG++;
     if (m_currentHPG >= linkList->count())
+    {
+        m_bundle.close();
         return -1; // < 0 means done
+    }
 
     std::shared_ptr<geometry::Link> link = linkList->get(m_currentHPG);
     if (link->getGeometryType() != xs::xstype::circular)
@@ -572,80 +736,422 @@ int IcapHpg::loadNextHpg(const std::string& path, geometry::LinkList* linkList)
 }
 
 
-bool IcapHpg::loadHpgs(const std::string& path, geometry::LinkList* linkList)
+void IcapHpg::setLoadOptions(const HpgLoadOptions& options)
+{
+    m_options = options;
+}
+
+
+bool IcapHpg::getCompileStats(id_type linkId, hpg::CompileStats& stats)
+{
+    std::shared_ptr<hpg::Hpg> hpg = getHpg(linkId);
+    if (hpg == NULL)
+        return false;
+
+    return hpg->getCompileStats(stats);
+}
+
+
+bool IcapHpg::getSplineStats(id_type linkId, hpg::SplineStats& stats)
+{
+    std::shared_ptr<hpg::Hpg> hpg = getHpg(linkId);
+    if (hpg == NULL)
+        return false;
+
+    hpg->getSplineStats(stats);
+    return true;
+}
+
+
+void IcapHpg::setCacheOptions(const HpgCacheOptions& options)
+{
+    m_cache.configure(options);
+}
+
+
+HpgCacheStats IcapHpg::getCacheStats() const
+{
+    return m_cache.getStats();
+}
+
+
+bool IcapHpg::getCacheStats(id_type linkId, HpgCacheStats& stats) const
+{
+    return m_cache.getStats(linkId, stats);
+}
+
+
+void IcapHpg::resetCacheStats()
+{
+    m_cache.resetStats();
+}
+
+
+HpgShareStats IcapHpg::getShareStats() const
+{
+    return m_shareStats;
+}
+
+
+HpgDiskCacheStats IcapHpg::getDiskCacheStats() const
+{
+    return m_diskCache.getStats();
+}
+
+
+bool IcapHpg::openDiskCache()
+{
+    if (m_options.diskCache.empty())
+    {
+        m_diskCache.close();
+        return true;
+    }
+
+    if (! m_diskCache.open(m_options.diskCache, m_options.diskCacheSize))
+    {
+        setErrorMessage(m_diskCache.getErrorMessage());
+        return false;
+    }
+
+    return true;
+}
+
+
+bool IcapHpg::loadHpgs(const std::string& path, geometry::LinkList* linkList, const HpgLoadOptions& options)
 {
+    m_options = options;
+    m_cache.configure(m_options.cache);
+
     bool result = allocate(linkList->count());
     if (! result)
         return false;
-    
-    bool ok = true;
+
+    if (! openDiskCache())
+        return false;
+
+    if (HpgBundle::isBundle(path) && ! m_bundle.open(path))
+    {
+        setErrorMessage(m_bundle.getErrorMessage());
+        return false;
+    }
+
+    m_shared.clear();
+    m_shareStats = HpgShareStats();
+
+    // We don't load the HPG if this isn't a conduit.
+    //TODO:
     int count = linkList->count();
+    std::vector<std::shared_ptr<geometry::Link>> links(count);
+    std::vector<int> owner(count, -1);
+    std::map<HpgSignature, int> firstWithSignature;
+    std::vector<std::pair<unsigned long long, int>> work;
     for (int i = 0; i < count; i++)
     {
-		printf("Loading HPG %d of %d...\n", i + 1, count);
-        // We don't load the HPG if this isn't a conduit.
-        //TODO:
-        auto link = linkList->get(i);
-        if (link->getGeometryType() != xs::xstype::circular)
-        {
-            m_list[i] = NULL;
+        links[i] = linkList->get(i);
+        if (links[i]->getGeometryType() != xs::xstype::circular)
             continue;
+
+        // Only the first link of each signature loads its HPG.
+        owner[i] = i;
+        if (options.shareIdentical)
+        {
+            auto first = firstWithSignature.insert(std::make_pair(HpgSignature::of(links[i]), i));
+            owner[i] = first.first->second;
+            if (owner[i] != i)
+                continue;
         }
 
-        if (! checkAndLoadHPG(link, path))
+        // Read a bundle in the order the HPGs are stored in.
+        int entry = m_bundle.isOpen() ? m_bundle.find(links[i]->getName()) : -1;
+        work.push_back(std::make_pair(entry < 0 ? 0 : m_bundle.offset(entry), i));
+    }
+    std::stable_sort(work.begin(), work.end());
+
+    // Each worker takes the next link off the work list.  Nothing is added
+    // to m_list until they have all finished, and the error that is
+    // reported is the one of the first failed link in the link list, so
+    // the result doesn't depend on the number of threads.
+    std::vector<std::shared_ptr<hpg::Hpg>> hpgs(count);
+    std::vector<std::string> errors(count);
+    std::atomic<int> next(0);
+    std::atomic<int> firstFailed(count);
+    std::mutex progressMutex;
+    int loaded = 0;
+
+    auto worker = [&]()
+    {
+        for (int w = next++; w < (int)work.size(); w = next++)
+        {
+            int i = work[w].second;
+            if (i < firstFailed)
+            {
+                hpgs[i] = readLinkHPG(links[i], path, errors[i]);
+                if (hpgs[i] == NULL)
+                {
+                    int failed = firstFailed;
+                    while (i < failed && ! firstFailed.compare_exchange_weak(failed, i))
+                        ;
+                }
+            }
+
+            if (options.progress)
+            {
+                std::lock_guard<std::mutex> lock(progressMutex);
+                options.progress(++loaded, (int)work.size());
+            }
+        }
+    };
+
+    unsigned int threads = options.threads;
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::min(threads, (unsigned int)work.size());
+
+    if (threads <= 1)
+    {
+        worker();
+    }
+    else
+    {
+        std::vector<std::thread> pool;
+        for (unsigned int t = 0; t < threads; t++)
+            pool.push_back(std::thread(worker));
+        for (unsigned int t = 0; t < threads; t++)
+            pool[t].join();
+    }
+
+    m_bundle.close();
+
+    if (firstFailed < count)
+    {
+        setErrorMessage(errors[firstFailed]);
+        return false;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (links[i]->getGeometryType() != xs::xstype::circular)
         {
-            ok = false;
-            break;
+            m_list[i] = LinkHpg();
+            continue;
         }
+
+        int o = owner[i];
+        double offset = (o == i ? 0.0 : links[i]->getDownstreamInvert() - links[o]->getDownstreamInvert());
+        m_list.insert(std::make_pair(links[i]->getId(), LinkHpg(hpgs[o], offset)));
+        m_shareStats.links++;
     }
+    m_shareStats.instances = (int)work.size();
+
+    for (auto it = firstWithSignature.begin(); it != firstWithSignature.end(); it++)
+        m_shared[it->first] = LinkHpg(hpgs[it->second], links[it->second]->getDownstreamInvert());
 
-    return ok;
+    return true;
 }
 
 
 bool IcapHpg::checkAndLoadHPG(std::shared_ptr<geometry::Link> link, const std::string& dir)
 {
+    // Share the HPG of an identical reach if one has been loaded.
+    if (m_options.shareIdentical)
+    {
+        auto found = m_shared.find(HpgSignature::of(link));
+        if (found != m_shared.end())
+        {
+            double offset = link->getDownstreamInvert() - found->second.offset;
+            m_list.insert(std::make_pair(link->getId(), LinkHpg(found->second.hpg, offset)));
+            m_shareStats.links++;
+            return true;
+        }
+    }
+
+    std::string error;
+    std::shared_ptr<hpg::Hpg> h = readLinkHPG(link, dir, error);
+    if (h == NULL)
+    {
+        setErrorMessage(error);
+        return false;
+    }
+
+    m_list.insert(std::make_pair(link->getId(), LinkHpg(h, 0.0)));
+    if (m_options.shareIdentical)
+        m_shared[HpgSignature::of(link)] = LinkHpg(h, link->getDownstreamInvert());
+    m_shareStats.links++;
+    m_shareStats.instances++;
+    return true;
+}
+
+
+std::shared_ptr<hpg::Hpg> IcapHpg::readLinkHPG(std::shared_ptr<geometry::Link> link, const std::string& dir, std::string& error) const
+{
+    namespace fs = boost::filesystem;
+
+    if (m_bundle.isOpen())
+    {
+        int entry = m_bundle.find(link->getName());
+        if (entry < 0)
+        {
+            error = "HPG not found in bundle.  Link=" + link->getName();
+            return NULL;
+        }
+
+        std::shared_ptr<hpg::Hpg> h(new hpg::Hpg());
+        h->SetLazySplines(m_options.lazySplines);
+        if (! m_bundle.load(entry, *h))
+        {
+            error = "Failed to load HPG.  Link=" + link->getName() + ": " + h->getErrorMessage();
+            return NULL;
+        }
+        else if (m_options.compileError > 0.0 && HPGFAILURE(h->Compile(m_options.compileError, m_options.compileVolumeError)))
+        {
+            error = "Failed to compile HPG.  Link=" + link->getName() + ": " + h->getErrorMessage();
+            return NULL;
+        }
+
+        return h;
+    }
+
     // Kludgy, I know, but HPG's can have two different file names:
     //   DT{ID}.txt  -- OR --   {ID}.txt
-    // This loop checks for the existence of both.
+    // This checks for the existence of both, and DT{ID}.txt is used if
+    // both exist.  Either may also have a binary copy (DT{ID}.hpgb or
+    // {ID}.hpgb, see convertHpgs).
     std::stringstream fileStream;
 
-    fileStream << "DT" << link->getName() << ".txt";
-    std::string file1 = fileStream.str();
+    fileStream << dir << "\\" << "DT" << link->getName() << ".txt";
+    std::string textPath = fileStream.str();
+    if (! fs::exists(textPath) && ! fs::exists(binaryHpgPath(textPath)))
+    {
+        fileStream.str("");
+        fileStream << dir << "\\" << link->getName() << ".txt";
+        textPath = fileStream.str();
+        if (! fs::exists(textPath) && ! fs::exists(binaryHpgPath(textPath)))
+        {
+            error = "HPG not found.  File=" + textPath;
+            return NULL;
+        }
+    }
 
-    fileStream.str("");
-    fileStream << link->getName() << ".txt";
-    std::string file2 = fileStream.str();
+    // Use the binary copy unless the text HPG has changed since it was
+    // converted.  If the copy doesn't load (e.g. it was written by an older
+    // version of the format) we fall back to the text HPG.
+    std::string binPath = binaryHpgPath(textPath);
+    bool textExists = fs::exists(textPath);
+    if (fs::exists(binPath) && (! textExists || fs::last_write_time(binPath) >= fs::last_write_time(textPath)))
+    {
+        std::shared_ptr<hpg::Hpg> h = readHPG(binPath, error);
+        if (h != NULL || ! textExists)
+            return h;
+    }
 
-    fileStream.str("");
-    fileStream << dir << "\\" << file1;
-    std::string hpgPath1 = fileStream.str();
+    // A text HPG made by HpgCreator has a source hash, which its binary
+    // copy in the disk cache is stored under, with the hash of its curves
+    // so that a HPG whose curves were changed since isn't mistaken for
+    // another.  Loading that copy skips parsing the text, and the first
+    // project to load a HPG adds it to the cache for the others.
+    std::string sourceHash, textHash;
+    if (m_diskCache.isOpen() && textExists)
+    {
+        hpg::Hpg header;
+        if (header.LoadHeaderFromFile(textPath))
+            sourceHash = header.getSourceHash();
+        if (! sourceHash.empty())
+            textHash = HpgDiskCache::textHash(textPath);
 
-    fileStream.str("");
-    fileStream << dir << "\\" << file2;
-    std::string hpgPath2 = fileStream.str();
+        std::shared_ptr<hpg::Hpg> h(new hpg::Hpg());
+        h->SetLazySplines(m_options.lazySplines);
+        if (! textHash.empty() && m_diskCache.load(sourceHash, textHash, *h))
+        {
+            h->setNodeId(header.getNodeId());
+            return compileHPG(h, textPath, error);
+        }
+    }
 
-    bool f1exists = boost::filesystem::exists(hpgPath1);
-    bool f2exists = boost::filesystem::exists(hpgPath2);
+    return readHPG(textPath, error, textHash);
+}
 
-    if (! f1exists && ! f2exists)
+
+std::string IcapHpg::binaryHpgPath(const std::string& textPath)
+{
+    return boost::filesystem::path(textPath).replace_extension(".hpgb").string();
+}
+
+
+int IcapHpg::convertHpgs(const std::string& dir)
+{
+    namespace fs = boost::filesystem;
+
+    if (! fs::is_directory(dir))
     {
-        setErrorMessage("HPG not found.  File=" + hpgPath2);
-        return false;
+        setErrorMessage("HPG directory not found.  Dir=" + dir);
+        return -1;
     }
 
-    else if (f1exists && ! loadHPG(link->getId(), hpgPath1))
+    int count = 0;
+    for (fs::directory_iterator it(dir); it != fs::directory_iterator(); it++)
     {
-        setErrorMessage("Failed to load HPG.  File=" + hpgPath1);
-        return false;
+        std::string path = it->path().string();
+        if (it->path().extension() != ".txt" || ! fs::is_regular_file(it->status()))
+            continue;
+
+        // Skip anything in the directory that isn't a HPG.
+        char magic[5] = { 0 };
+        FILE* fh = fopen(path.c_str(), "r");
+        if (fh == NULL)
+            continue;
+        size_t n = fread(magic, 1, 4, fh);
+        fclose(fh);
+        if (n < 3 || (strncmp(magic, "#HPG", 4) && strncmp(magic, "HPG", 3)))
+            continue;
+
+        hpg::Hpg h;
+        if (! h.LoadFromFile(path))
+        {
+            setErrorMessage("Failed to load HPG.  File=" + path + ": " + h.getErrorMessage());
+            return -1;
+        }
+
+        std::string binPath = binaryHpgPath(path);
+        if (! h.SaveBinary(binPath))
+        {
+            setErrorMessage("Failed to save HPG.  File=" + binPath + ": " + h.getErrorMessage());
+            return -1;
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+
+bool IcapHpg::saveBundle(const std::string& path, const std::vector<std::shared_ptr<geometry::Link>>& links)
+{
+    std::vector<std::string> names;
+    std::vector<std::shared_ptr<hpg::Hpg>> hpgs;
+    for (size_t i = 0; i < links.size(); i++)
+    {
+        const LinkHpg* entry = findHpg(links[i]->getId());
+        if (entry == NULL)
+            continue;
+
+        // The HPG of a shared link is at the inverts of another link.
+        if (entry->offset != 0.0)
+        {
+            setErrorMessage("Can't save the shared HPG of a link with a different invert.  Link=" + links[i]->getName());
+            return false;
+        }
+
+        names.push_back(links[i]->getName());
+        hpgs.push_back(entry->hpg);
     }
 
-    else if (f2exists && ! loadHPG(link->getId(), hpgPath2))
+    HpgBundle bundle;
+    if (! bundle.write(path, names, hpgs))
     {
-        setErrorMessage("Failed to load HPG.  File=" + hpgPath2);
+        setErrorMessage(bundle.getErrorMessage());
         return false;
     }
 
     return true;
 }
-
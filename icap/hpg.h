@@ -51,10 +51,14 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <functional>
 
 #include "../hpg_interp/hpg.hpp"
 #include "../util/parseable.h"
 #include "../geometry/link_list.h"
+#include "hpg_bundle.h"
+#include "hpg_cache.h"
+#include "hpg_disk_cache.h"
 
 
 #define HPG_ERROR -100
@@ -63,22 +67,144 @@
 #define HPG_PIPE_EMPTY -1
 
 
+/// Options for loading the HPGs.
+struct HpgLoadOptions
+{
+    /// If > 0, each HPG is compiled into a lookup table with this largest
+    /// upstream head error (see hpg::Hpg::Compile).
+    double compileError;
+    /// Largest volume error of the lookup tables, as a fraction.
+    double compileVolumeError;
+    /// Number of threads that load the HPGs, 0 for one per core.
+    unsigned int threads;
+    /// If set, this is called after each HPG is loaded with the number loaded
+    /// so far and the number to load.  It is called from the loading
+    /// threads, one call at a time.
+    std::function<void (int loaded, int count)> progress;
+    /// If set, the splines of each HPG curve are only built the first time
+    /// the curve is interpolated (see hpg::Hpg::SetLazySplines).
+    bool lazySplines;
+    /// The query cache to use with the loaded HPGs (off by default).
+    HpgCacheOptions cache;
+    /// If set, only one HPG is loaded for all of the reaches with the same
+    /// HpgSignature, and the others share it, with their heads offset by
+    /// the difference in invert.  This assumes that the HPGs of such
+    /// reaches only differ by the height of their inverts.
+    bool shareIdentical;
+    /// If set, HPGs that have a source hash are loaded from the HPG disk
+    /// cache in this directory, or added to it (see HpgDiskCache).
+    std::string diskCache;
+    /// Largest size of the disk cache in bytes, 0 for no limit.
+    unsigned long long diskCacheSize;
+
+    HpgLoadOptions() : compileError(0.0), compileVolumeError(0.001), threads(0), lazySplines(false), shareIdentical(false), diskCacheSize(0) { }
+};
+
+
+/// The hydraulic signature of a reach: its diameter, roughness, length and
+/// the drop from the upstream to the downstream invert.  The values are
+/// rounded to millionths, so that the round-off of the invert elevations
+/// doesn't tell identical reaches apart.
+struct HpgSignature
+{
+    long long diameter;
+    long long roughness;
+    long long length;
+    long long drop;
+
+    HpgSignature(double diameter, double roughness, double length, double drop);
+
+    /// The signature of the link's geometry.
+    static HpgSignature of(std::shared_ptr<geometry::Link> link);
+
+    bool operator<(const HpgSignature& other) const;
+    bool operator==(const HpgSignature& other) const;
+};
+
+
+/// How many HPGs were loaded for how many links, when identical reaches
+/// share them.
+struct HpgShareStats
+{
+    int links;          //< links with a HPG
+    int instances;      //< distinct HPGs loaded
+
+    HpgShareStats() : links(0), instances(0) { }
+
+    /// Links per HPG loaded.
+    double ratio() const { return instances > 0 ? (double)links / instances : 0.0; }
+};
+
+
 /// This class loads and keeps track of HPGs.
 class IcapHpg : public Parseable
 {
 protected:
-    std::map<id_type, std::shared_ptr<hpg::Hpg>> m_list;
+    /// The HPG of one link.  Links with the same HpgSignature can share a
+    /// HPG, which is then read-only; 'offset' is how far the inverts of the
+    /// link are above the inverts the HPG was made for.  It is taken off the
+    /// downstream head of a query and added to the upstream head it returns.
+    struct LinkHpg
+    {
+        std::shared_ptr<hpg::Hpg> hpg;
+        double offset;
+
+        LinkHpg() : offset(0.0) { }
+        LinkHpg(std::shared_ptr<hpg::Hpg> h, double off) : hpg(h), offset(off) { }
+    };
+
+    std::map<id_type, LinkHpg> m_list;
     
     int m_hpgCount;
 
+    HpgLoadOptions m_options;
+
+    /// The bundle that the HPGs are being loaded from, if any.
+    HpgBundle m_bundle;
+
+    /// The last queries of each link, if the cache is on.
+    HpgQueryCache m_cache;
+
+    /// The HPG loaded for each signature, and the downstream invert of the
+    /// link it was loaded for, if options.shareIdentical.
+    std::map<HpgSignature, LinkHpg> m_shared;
+
+    /// How many HPGs are shared.
+    HpgShareStats m_shareStats;
+
+    /// The disk cache, if options.diskCache is set.  It can be used from
+    /// several threads at once, including the const ones that read HPGs.
+    mutable HpgDiskCache m_diskCache;
+
+    /// Opens the disk cache of m_options, if any.
+    bool openDiskCache();
+
+    /// The entry of the link in m_list, or NULL.
+    const LinkHpg* findHpg(id_type linkId) const;
+
     //NormCritParams m_ncParams;
     //bool m_ncParamsInit;
 
 	/// Loads the HPG, if checks pass.
     bool checkAndLoadHPG(std::shared_ptr<geometry::Link> link, const std::string& dirPath);
 
-	/// Does the actual HPG loading.
-    bool loadHPG(id_type linkId, const std::string& path);
+    /// Reads the HPG of the link from m_bundle if it's open, else from the
+    /// directory (the binary copy if it is up to date, else the disk cache
+    /// copy of the text HPG, else the text HPG).  Returns NULL and sets
+    /// 'error' on failure.  This doesn't change the object, so it can be
+    /// called from several threads at once.
+    std::shared_ptr<hpg::Hpg> readLinkHPG(std::shared_ptr<geometry::Link> link, const std::string& dirPath, std::string& error) const;
+
+	/// Does the actual HPG loading.  If 'textHash' isn't empty, the HPG is
+    /// also added to the disk cache with it (see HpgDiskCache::textHash).
+    std::shared_ptr<hpg::Hpg> readHPG(const std::string& path, std::string& error, const std::string& textHash = "") const;
+
+    /// Compiles the HPG loaded from the path, if options.compileError is
+    /// set.  Returns NULL and sets 'error' on failure.
+    std::shared_ptr<hpg::Hpg> compileHPG(std::shared_ptr<hpg::Hpg> h, const std::string& path, std::string& error) const;
+
+    /// The path of the binary copy of a text HPG.
+    static std::string binaryHpgPath(const std::string& textPath);
 
     int m_currentHPG;
 
@@ -101,14 +227,66 @@ public:
 	/// Returns the volume in the system for the backwater curve with the downstream head and Q.
 	bool getVolume(id_type linkId, var_type dsHead, var_type flow, var_type& volume);
 
+    /// Returns the values selected by the hpg::InterpFlag bits in 'what'
+    /// for the given Q/downstream, with a single HPG query.
+    bool getValues(id_type linkId, var_type dsHead, var_type flow, hpg::InterpResult& values, unsigned int what = hpg::InterpFlag_All);
+
+    /// The same as getValues, also returning the partial derivatives of the
+    /// values with respect to Q and the downstream.  These queries don't use
+    /// the cache.
+    bool getValues(id_type linkId, var_type dsHead, var_type flow, hpg::InterpResult& values, hpg::InterpSlopes& slopes, unsigned int what = hpg::InterpFlag_All);
+
     //var_type getLowestFlow(int linkId, bool isAdverse);
     
-	/// Loads all of the HPGs.
-    bool loadHpgs(const std::string& path, geometry::LinkList* linkList);
+	/// Loads all of the HPGs, on options.threads threads.
+    bool loadHpgs(const std::string& path, geometry::LinkList* linkList, const HpgLoadOptions& options = HpgLoadOptions());
 
 	/// Loads one HPG and gets ready to load the next.
     int loadNextHpg(const std::string& path, geometry::LinkList* linkList);
 
+    /// Sets the options used by loadNextHpg.
+    void setLoadOptions(const HpgLoadOptions& options);
+
+    /// Saves a binary copy (*.hpgb) of every text HPG in the directory,
+    /// which loadHpgs then loads instead of the text HPG.  Returns the
+    /// number of HPGs converted, or -1 on error.
+    int convertHpgs(const std::string& dir);
+
+    /// Saves the loaded HPGs of the given links, in that order, to a single
+    /// bundle file (see HpgBundle) that loadHpgs can load instead of a
+    /// directory.  This fails if a link shares the HPG of a link with a
+    /// different invert.
+    bool saveBundle(const std::string& path, const std::vector<std::shared_ptr<geometry::Link>>& links);
+
+    /// Returns the achieved error and size of the lookup table of the HPG,
+    /// or false if it wasn't compiled.
+    bool getCompileStats(id_type linkId, hpg::CompileStats& stats);
+
+    /// Returns how many curves of the HPG have their splines built, or false
+    /// if the link has no HPG.
+    bool getSplineStats(id_type linkId, hpg::SplineStats& stats);
+
+    /// Sets up the cache of the last queries of each link (see
+    /// HpgQueryCache).  The cache is off by default.
+    void setCacheOptions(const HpgCacheOptions& options);
+
+    /// Returns the cache counters of every link.
+    HpgCacheStats getCacheStats() const;
+
+    /// Returns the cache counters of one link, or false if it hasn't been
+    /// queried.
+    bool getCacheStats(id_type linkId, HpgCacheStats& stats) const;
+
+    /// Zeroes the cache counters.
+    void resetCacheStats();
+
+    /// Returns how many HPGs the links share (see HpgLoadOptions::shareIdentical).
+    HpgShareStats getShareStats() const;
+
+    /// Returns what the disk cache did while the HPGs were loaded (see
+    /// HpgLoadOptions::diskCache).
+    HpgDiskCacheStats getDiskCacheStats() const;
+
     //bool IsValidFlow(int linkId, double flow);
     //bool CanInterpolate(int linkId, double dsDepth, double flow);
     //// 0 = ok, -1 = too small flow, +1 = too large flow
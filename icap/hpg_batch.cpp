@@ -0,0 +1,352 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+#include "../geometry/geometry.h"
+#include "hpg_batch.h"
+
+
+namespace
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    /// The HPG file of a link in the directory.  As in IcapHpg::readLinkHPG,
+    /// DT{name}.txt is used if it exists, else {name}.txt.
+    std::string hpgPath(const std::string& dir, const std::string& name)
+    {
+        namespace fs = boost::filesystem;
+
+        fs::path dtPath = fs::path(dir) / ("DT" + name + ".txt");
+        if (fs::exists(dtPath))
+            return dtPath.string();
+        return (fs::path(dir) / (name + ".txt")).string();
+    }
+
+    /// Say if the HPG at the path was created from the same source.
+    bool isUpToDate(const std::string& path, const std::string& sourceHash)
+    {
+        if (! boost::filesystem::exists(path))
+            return false;
+
+        hpg::Hpg h;
+        return h.LoadHeaderFromFile(path) && h.getSourceHash() == sourceHash;
+    }
+}
+
+
+HpgBatch::HpgBatch()
+{
+}
+
+
+HpgCreator& HpgBatch::creator()
+{
+    return m_creator;
+}
+
+
+bool HpgBatch::run(const std::string& inputFile, const std::string& dir, const HpgBatchOptions& options)
+{
+    // The geometry hands out shared pointers to itself while loading.
+    std::shared_ptr<geometry::Geometry> geom(new geometry::Geometry());
+    if (! geom->loadFromFile(inputFile, geometry::FileFormatSwmm5))
+    {
+        setErrorMessage("Unable to load geometry: " + geom->getErrorMessage());
+        return false;
+    }
+
+    return run(geom->getLinkList(), dir, options);
+}
+
+
+bool HpgBatch::run(geometry::LinkList* linkList, const std::string& dir, const HpgBatchOptions& options)
+{
+    namespace fs = boost::filesystem;
+
+    Clock::time_point runStart = Clock::now();
+
+    m_results.clear();
+    m_stats = HpgBatchStats();
+
+    boost::system::error_code ec;
+    fs::create_directories(dir, ec);
+    if (! fs::is_directory(dir))
+    {
+        setErrorMessage("Unable to create the HPG directory.  Dir=" + dir);
+        return false;
+    }
+
+    m_diskCache.close();
+    if (! options.diskCache.empty() && ! m_diskCache.open(options.diskCache, options.diskCacheSize))
+    {
+        setErrorMessage(m_diskCache.getErrorMessage());
+        return false;
+    }
+
+    // The reaches are set up here, so that the workers don't touch the links.
+    int count = linkList->count();
+    m_results.resize(count);
+    std::vector<xs::Reach> reaches(count);
+    std::vector<int> work;
+    for (int i = 0; i < count; i++)
+    {
+        std::shared_ptr<geometry::Link> link = linkList->get(i);
+        m_results[i].link = link->getName();
+        if (link->getGeometryType() != xs::xstype::circular)
+            continue;
+
+        reaches[i].setDsInvert(link->getDownstreamInvert());
+        reaches[i].setUsInvert(link->getUpstreamInvert());
+        reaches[i].setLength(link->getLength());
+        reaches[i].setRoughness(link->getRoughness());
+        reaches[i].setXs(link->getXs());
+        m_results[i].path = hpgPath(dir, link->getName());
+        work.push_back(i);
+    }
+
+    unsigned int threads = options.threads;
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned int workers = std::max(1u, std::min(threads, (unsigned int)work.size()));
+
+    // Threads that aren't needed for a link of their own help create the
+    // curves of the HPGs (e.g. when only a few links have changed).
+    HpgCreator settings = m_creator;
+    settings.setNumThreads(std::max(1u, threads / workers));
+
+    std::atomic<int> next(0);
+    std::mutex progressMutex;
+    int done = 0;
+
+    auto worker = [&]()
+    {
+        // Each worker has its own creator, since AutoCreateHpg keeps its
+        // error code in it.
+        HpgCreator creator = settings;
+
+        for (int w = next++; w < (int)work.size(); w = next++)
+        {
+            int i = work[w];
+            HpgBatchResult& result = m_results[i];
+            Clock::time_point start = Clock::now();
+
+            std::string sourceHash = creator.getSourceHash(reaches[i]);
+            if (! options.force && isUpToDate(result.path, sourceHash))
+            {
+                result.status = HpgBatch_UpToDate;
+            }
+            else
+            {
+                // Another project may have made a HPG from the same source.
+                std::shared_ptr<hpg::Hpg> h(new hpg::Hpg());
+                bool cached = m_diskCache.isOpen() && m_diskCache.load(sourceHash, "", *h);
+                if (! cached)
+                {
+                    h = creator.AutoCreateHpg(reaches[i]);
+                    if (h != NULL)
+                        m_diskCache.store(*h);
+                }
+
+                std::string tempPath = result.path + ".tmp";
+                result.status = HpgBatch_Failed;
+                if (h == NULL)
+                {
+                    result.error = "Failed to create HPG (error " + std::to_string(creator.getError()) + ")";
+                }
+                else if (! h->SaveToFile(tempPath))
+                {
+                    result.error = "Failed to save HPG.  File=" + tempPath + ": " + h->getErrorMessage();
+                }
+                else
+                {
+                    boost::system::error_code renameError;
+                    fs::rename(tempPath, result.path, renameError);
+                    if (renameError)
+                    {
+                        result.error = "Failed to save HPG.  File=" + result.path + ": " + renameError.message();
+                        fs::remove(tempPath, renameError);
+                    }
+                    else
+                    {
+                        result.status = cached ? HpgBatch_Cached : HpgBatch_Created;
+                    }
+                }
+            }
+
+            result.seconds = secondsSince(start);
+
+            if (options.progress)
+            {
+                std::lock_guard<std::mutex> lock(progressMutex);
+                options.progress(++done, (int)work.size());
+            }
+        }
+    };
+
+    if (workers <= 1)
+    {
+        worker();
+    }
+    else
+    {
+        std::vector<std::thread> pool;
+        for (unsigned int t = 0; t < workers; t++)
+            pool.push_back(std::thread(worker));
+        for (unsigned int t = 0; t < workers; t++)
+            pool[t].join();
+    }
+
+    int firstFailed = -1;
+    m_stats.links = count;
+    for (int i = 0; i < count; i++)
+    {
+        switch (m_results[i].status)
+        {
+        case HpgBatch_Created:
+            m_stats.created++;
+            m_stats.createSeconds += m_results[i].seconds;
+            break;
+        case HpgBatch_Cached:
+            m_stats.cached++;
+            break;
+        case HpgBatch_UpToDate:
+            m_stats.upToDate++;
+            break;
+        case HpgBatch_Failed:
+            m_stats.failed++;
+            if (firstFailed < 0)
+                firstFailed = i;
+            break;
+        default:
+            m_stats.noHpg++;
+            break;
+        }
+    }
+    m_stats.seconds = secondsSince(runStart);
+
+    if (firstFailed >= 0)
+    {
+        setErrorMessage(m_results[firstFailed].error + ".  Link=" + m_results[firstFailed].link);
+        return false;
+    }
+
+    return true;
+}
+
+
+const std::vector<HpgBatchResult>& HpgBatch::getResults() const
+{
+    return m_results;
+}
+
+
+HpgBatchStats HpgBatch::getStats() const
+{
+    return m_stats;
+}
+
+
+HpgDiskCacheStats HpgBatch::getDiskCacheStats() const
+{
+    return m_diskCache.getStats();
+}
+
+
+void HpgBatch::writeSummary(std::ostream& out, int slowest) const
+{
+    out << "Links: " << m_stats.links << std::endl
+        << "  HPGs created: " << m_stats.created << std::endl
+        << "  HPGs copied from the disk cache: " << m_stats.cached << std::endl
+        << "  HPGs up to date: " << m_stats.upToDate << std::endl
+        << "  HPGs failed: " << m_stats.failed << std::endl
+        << "  Links without a HPG: " << m_stats.noHpg << std::endl
+        << "Time: " << m_stats.seconds << " s (" << m_stats.createSeconds << " s creating HPGs";
+    if (m_stats.created > 0)
+        out << ", " << m_stats.createSeconds / m_stats.created << " s per HPG";
+    out << ")" << std::endl;
+
+    std::vector<const HpgBatchResult*> created;
+    for (size_t i = 0; i < m_results.size(); i++)
+    {
+        if (m_results[i].status == HpgBatch_Created)
+            created.push_back(&m_results[i]);
+    }
+
+    if (slowest > 0 && ! created.empty())
+    {
+        size_t n = std::min(created.size(), (size_t)slowest);
+        std::partial_sort(created.begin(), created.begin() + n, created.end(),
+            [](const HpgBatchResult* a, const HpgBatchResult* b) { return a->seconds > b->seconds; });
+
+        out << "Slowest:" << std::endl;
+        for (size_t i = 0; i < n; i++)
+            out << "  " << created[i]->link << ": " << created[i]->seconds << " s" << std::endl;
+    }
+
+    if (m_stats.failed > 0)
+    {
+        out << "Failed:" << std::endl;
+        for (size_t i = 0; i < m_results.size(); i++)
+        {
+            if (m_results[i].status == HpgBatch_Failed)
+                out << "  " << m_results[i].link << ": " << m_results[i].error << std::endl;
+        }
+    }
+}
@@ -0,0 +1,172 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+#ifndef __HPG_BATCH_H_______________________20161103094512__
+#define __HPG_BATCH_H_______________________20161103094512__
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../hpg_creation/hpg_creator.hpp"
+#include "../util/parseable.h"
+#include "../geometry/link_list.h"
+#include "hpg_disk_cache.h"
+
+
+/// Options for HpgBatch::run.
+struct HpgBatchOptions
+{
+    /// Number of threads that create the HPGs, 0 for one per core.
+    unsigned int threads;
+    /// If set, every HPG is created, even if it is up to date.
+    bool force;
+    /// If set, this is called after each link with the number of links done
+    /// so far and the number of links.  It is called from the creating
+    /// threads, one call at a time.
+    std::function<void (int done, int count)> progress;
+    /// If set, a HPG that is missing or out of date is copied from the HPG
+    /// disk cache in this directory if it is there, and a HPG that is
+    /// created is added to it (see HpgDiskCache).
+    std::string diskCache;
+    /// Largest size of the disk cache in bytes, 0 for no limit.
+    unsigned long long diskCacheSize;
+
+    HpgBatchOptions() : threads(0), force(false), diskCacheSize(0) { }
+};
+
+
+/// What HpgBatch::run did for a link.
+enum HpgBatchStatus
+{
+    HpgBatch_Created,       //< the HPG was missing or out of date, and was created
+    HpgBatch_Cached,        //< the HPG was missing or out of date, and was copied from the disk cache
+    HpgBatch_UpToDate,      //< the HPG has the source hash of the link, so it was kept
+    HpgBatch_Failed,        //< creating or saving the HPG failed
+    HpgBatch_NoHpg,         //< the link isn't circular, so it doesn't have a HPG
+};
+
+
+/// The outcome for one link.
+struct HpgBatchResult
+{
+    std::string link;
+    std::string path;       //< the HPG file
+    HpgBatchStatus status;
+    double seconds;         //< time spent on the link
+    std::string error;      //< why it failed
+
+    HpgBatchResult() : status(HpgBatch_NoHpg), seconds(0.0) { }
+};
+
+
+/// The totals of a HpgBatch::run.
+struct HpgBatchStats
+{
+    int links;
+    int created;
+    int cached;
+    int upToDate;
+    int failed;
+    int noHpg;
+    double seconds;         //< wall time of the run
+    double createSeconds;   //< time spent creating HPGs, summed over the threads
+
+    HpgBatchStats() : links(0), created(0), cached(0), upToDate(0), failed(0), noHpg(0), seconds(0.0), createSeconds(0.0) { }
+};
+
+
+/// Creates the HPGs of every conduit of a network.
+///
+/// Each HPG is saved to the HPG directory under the name that
+/// IcapHpg::loadHpgs looks for, with the source hash of its reach and of
+/// the creator settings (see HpgCreator::getSourceHash).  A HPG that
+/// already has the same hash is up to date and is kept, so rerunning after
+/// changing a few conduits only creates theirs.  A HPG that another project
+/// has already made can be copied from a disk cache.  The HPGs are created
+/// on a pool of threads, and each is written to a temporary file first so
+/// that an interrupted run doesn't leave a partial HPG that looks up to
+/// date.
+class HpgBatch : public Parseable
+{
+public:
+    HpgBatch();
+
+    /// The creator whose settings (units, number of curves, etc.) are used.
+    /// Its number of threads is set by run.
+    HpgCreator& creator();
+
+    /// Creates the missing and out of date HPGs of the conduits of a SWMM 5
+    /// input file.  Returns false if the file can't be read or a HPG
+    /// failed, with the error of the first failed link.
+    bool run(const std::string& inputFile, const std::string& dir, const HpgBatchOptions& options = HpgBatchOptions());
+
+    /// The same as above, for the links of a network already loaded.
+    bool run(geometry::LinkList* linkList, const std::string& dir, const HpgBatchOptions& options = HpgBatchOptions());
+
+    /// The outcome for each link of the last run, in link order.
+    const std::vector<HpgBatchResult>& getResults() const;
+
+    /// The totals of the last run.
+    HpgBatchStats getStats() const;
+
+    /// What the disk cache did in the last run.
+    HpgDiskCacheStats getDiskCacheStats() const;
+
+    /// Writes the totals, the slowest links and the failed links.
+    void writeSummary(std::ostream& out, int slowest = 10) const;
+
+private:
+    HpgCreator m_creator;
+    HpgDiskCache m_diskCache;
+    std::vector<HpgBatchResult> m_results;
+    HpgBatchStats m_stats;
+};
+
+
+#endif//__HPG_BATCH_H_______________________20161103094512__
@@ -0,0 +1,418 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <map>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "hpg_bundle.h"
+
+
+namespace
+{
+    /*
+    * Layout of a bundle (native byte order, checked on load):
+    *
+    *   BundleHeader
+    *   HPGs         binary HPG images, 8-byte aligned, in the order given to write
+    *   BundleBlob   [blobCount]
+    *   BundleEntry  [linkCount], sorted by link name
+    *   names        the link names and HPG node IDs
+    *
+    * The HPG images are stored with an empty node ID so that HPGs that
+    * only differ by node ID are shared; the node ID is kept in the entry.
+    */
+    const char BUNDLE_MAGIC[4] = { 'H', 'P', 'G', 'N' };
+    const unsigned int BUNDLE_VERSION = 1;
+    const unsigned int BUNDLE_BYTE_ORDER = 0x01020304;
+
+    struct BundleHeader
+    {
+        char magic[4];
+        unsigned int formatVersion;
+        unsigned int byteOrder;
+        unsigned int headerSize;
+        unsigned long long fileSize;
+        unsigned int linkCount;
+        unsigned int blobCount;
+        unsigned long long blobsOffset;
+        unsigned long long blobTableOffset;
+        unsigned long long entriesOffset;
+        unsigned long long namesOffset;
+    };
+
+    struct BundleBlob
+    {
+        unsigned long long offset;
+        unsigned long long size;
+        unsigned long long hash;
+    };
+
+    struct BundleEntry
+    {
+        unsigned int nameOffset;
+        unsigned int nameLength;
+        unsigned int nodeIdOffset;
+        unsigned int nodeIdLength;
+        unsigned int blob;
+        unsigned int reserved;
+    };
+
+    inline size_t padded(size_t size)
+    {
+        return (size + 7) & ~(size_t)7;
+    }
+
+    /// 64-bit FNV-1a hash.
+    unsigned long long hashBytes(const char* p, size_t size)
+    {
+        unsigned long long h = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; i++)
+        {
+            h ^= (unsigned char)p[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    void append(std::vector<char>& data, const void* p, size_t size)
+    {
+        size_t at = data.size();
+        data.resize(at + padded(size), 0);
+        if (size)
+            memcpy(&data[at], p, size);
+    }
+}
+
+
+struct HpgBundle::Mapping
+{
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    const char* data;
+    size_t size;
+    const BundleHeader* header;
+    const BundleBlob* blobs;
+    const BundleEntry* entries;
+    const char* names;
+    size_t namesSize;
+};
+
+
+HpgBundle::HpgBundle()
+{
+}
+
+HpgBundle::~HpgBundle()
+{
+}
+
+
+bool HpgBundle::isBundle(const std::string& path)
+{
+    FILE* fh = fopen(path.c_str(), "rb");
+    if (fh == NULL)
+        return false;
+
+    char magic[sizeof(BUNDLE_MAGIC)];
+    bool isBundle = fread(magic, 1, sizeof(magic), fh) == sizeof(magic) &&
+        memcmp(magic, BUNDLE_MAGIC, sizeof(magic)) == 0;
+    fclose(fh);
+
+    return isBundle;
+}
+
+
+bool HpgBundle::write(const std::string& path, const std::vector<std::string>& names, const std::vector<std::shared_ptr<hpg::Hpg>>& hpgs)
+{
+    if (names.size() != hpgs.size())
+    {
+        setErrorMessage("HPG bundle: one name is needed per HPG");
+        return false;
+    }
+
+    BundleHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BUNDLE_MAGIC, sizeof(h.magic));
+    h.formatVersion = BUNDLE_VERSION;
+    h.byteOrder = BUNDLE_BYTE_ORDER;
+    h.headerSize = sizeof(BundleHeader);
+    h.linkCount = (unsigned int)names.size();
+
+    std::vector<char> data;
+    append(data, &h, sizeof(h));
+    h.blobsOffset = data.size();
+
+    std::vector<BundleBlob> blobs;
+    std::vector<BundleEntry> entries(names.size());
+    std::string nameData;
+    std::multimap<unsigned long long, unsigned int> byHash;
+
+    for (size_t i = 0; i < hpgs.size(); i++)
+    {
+        // Save the HPG without its node ID, so that HPGs of identical
+        // conduits are identical.
+        std::vector<char> image;
+        std::string nodeId = hpgs[i]->getNodeId();
+        hpgs[i]->setNodeId("");
+        bool saved = hpgs[i]->SaveBinaryData(image);
+        hpgs[i]->setNodeId(nodeId);
+        if (! saved)
+        {
+            setErrorMessage("HPG bundle: failed to save the HPG of " + names[i] + ": " + hpgs[i]->getErrorMessage());
+            return false;
+        }
+
+        unsigned long long hash = hashBytes(&image[0], image.size());
+        unsigned int blob = (unsigned int)blobs.size();
+        auto range = byHash.equal_range(hash);
+        for (auto it = range.first; it != range.second; it++)
+        {
+            const BundleBlob& b = blobs[it->second];
+            if (b.size == image.size() && ! memcmp(&data[(size_t)b.offset], &image[0], image.size()))
+            {
+                blob = it->second;
+                break;
+            }
+        }
+
+        if (blob == blobs.size())
+        {
+            BundleBlob b;
+            b.offset = data.size();
+            b.size = image.size();
+            b.hash = hash;
+            blobs.push_back(b);
+            byHash.insert(std::make_pair(hash, blob));
+            append(data, &image[0], image.size());
+        }
+
+        BundleEntry& e = entries[i];
+        e.nameOffset = (unsigned int)nameData.size();
+        e.nameLength = (unsigned int)names[i].size();
+        nameData += names[i];
+        e.nodeIdOffset = (unsigned int)nameData.size();
+        e.nodeIdLength = (unsigned int)nodeId.size();
+        nameData += nodeId;
+        e.blob = blob;
+        e.reserved = 0;
+    }
+
+    // Sort the index by name for find.
+    std::sort(entries.begin(), entries.end(), [&](const BundleEntry& a, const BundleEntry& b) {
+        return nameData.compare(a.nameOffset, a.nameLength, nameData, b.nameOffset, b.nameLength) < 0;
+    });
+    for (size_t i = 1; i < entries.size(); i++)
+    {
+        if (! nameData.compare(entries[i - 1].nameOffset, entries[i - 1].nameLength, nameData, entries[i].nameOffset, entries[i].nameLength))
+        {
+            setErrorMessage("HPG bundle: duplicate link name " + nameData.substr(entries[i].nameOffset, entries[i].nameLength));
+            return false;
+        }
+    }
+
+    h.blobCount = (unsigned int)blobs.size();
+    h.blobTableOffset = data.size();
+    append(data, blobs.empty() ? NULL : &blobs[0], blobs.size() * sizeof(BundleBlob));
+    h.entriesOffset = data.size();
+    append(data, entries.empty() ? NULL : &entries[0], entries.size() * sizeof(BundleEntry));
+    h.namesOffset = data.size();
+    append(data, nameData.data(), nameData.size());
+    h.fileSize = data.size();
+    memcpy(&data[0], &h, sizeof(h));
+
+    FILE* fh = fopen(path.c_str(), "wb");
+    if (fh == NULL)
+    {
+        setErrorMessage("HPG bundle: unable to write " + path);
+        return false;
+    }
+
+    bool ok = fwrite(&data[0], 1, data.size(), fh) == data.size();
+    ok = (fclose(fh) == 0) && ok;
+    if (! ok)
+    {
+        setErrorMessage("HPG bundle: unable to write " + path);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool HpgBundle::open(const std::string& path)
+{
+    using namespace boost::interprocess;
+
+    close();
+
+    std::unique_ptr<Mapping> m(new Mapping());
+    try
+    {
+        file_mapping(path.c_str(), read_only).swap(m->file);
+        mapped_region(m->file, read_only).swap(m->region);
+    }
+    catch (interprocess_exception&)
+    {
+        setErrorMessage("HPG bundle: unable to read " + path);
+        return false;
+    }
+
+    m->data = (const char*)m->region.get_address();
+    m->size = m->region.get_size();
+    m->header = (const BundleHeader*)m->data;
+
+    // Check that the tables are all inside the file before using them.
+    const BundleHeader* h = m->header;
+    bool valid = m->size >= sizeof(BundleHeader) &&
+        ! memcmp(h->magic, BUNDLE_MAGIC, sizeof(h->magic)) &&
+        h->formatVersion == BUNDLE_VERSION &&
+        h->byteOrder == BUNDLE_BYTE_ORDER &&
+        h->headerSize == sizeof(BundleHeader) &&
+        h->fileSize == m->size &&
+        h->blobsOffset <= h->blobTableOffset &&
+        h->blobTableOffset <= h->entriesOffset &&
+        h->entriesOffset <= h->namesOffset &&
+        h->namesOffset <= m->size &&
+        (h->entriesOffset - h->blobTableOffset) / sizeof(BundleBlob) >= h->blobCount &&
+        (h->namesOffset - h->entriesOffset) / sizeof(BundleEntry) >= h->linkCount;
+    if (! valid)
+    {
+        setErrorMessage("HPG bundle: invalid or unsupported file " + path);
+        return false;
+    }
+
+    m->blobs = (const BundleBlob*)(m->data + h->blobTableOffset);
+    m->entries = (const BundleEntry*)(m->data + h->entriesOffset);
+    m->names = m->data + h->namesOffset;
+    m->namesSize = m->size - (size_t)h->namesOffset;
+
+    for (unsigned int i = 0; i < h->blobCount; i++)
+    {
+        const BundleBlob& b = m->blobs[i];
+        if (b.offset < h->blobsOffset || b.offset % 8 || b.size > h->blobTableOffset || b.offset > h->blobTableOffset - b.size)
+            valid = false;
+    }
+    for (unsigned int i = 0; i < h->linkCount; i++)
+    {
+        const BundleEntry& e = m->entries[i];
+        if (e.blob >= h->blobCount ||
+            e.nameOffset > m->namesSize || e.nameLength > m->namesSize - e.nameOffset ||
+            e.nodeIdOffset > m->namesSize || e.nodeIdLength > m->namesSize - e.nodeIdOffset)
+            valid = false;
+    }
+    if (! valid)
+    {
+        setErrorMessage("HPG bundle: invalid or unsupported file " + path);
+        return false;
+    }
+
+    m_map.swap(m);
+    return true;
+}
+
+
+void HpgBundle::close()
+{
+    m_map.reset();
+}
+
+
+bool HpgBundle::isOpen() const
+{
+    return m_map != NULL;
+}
+
+
+int HpgBundle::find(const std::string& name) const
+{
+    if (! m_map)
+        return -1;
+
+    // Binary search of the index.
+    int lo = 0, hi = (int)m_map->header->linkCount;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        const BundleEntry& e = m_map->entries[mid];
+        int cmp = name.compare(0, std::string::npos, m_map->names + e.nameOffset, e.nameLength);
+        if (cmp == 0)
+            return mid;
+        else if (cmp > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return -1;
+}
+
+
+unsigned long long HpgBundle::offset(int entry) const
+{
+    return m_map->blobs[m_map->entries[entry].blob].offset;
+}
+
+
+bool HpgBundle::load(int entry, hpg::Hpg& hpg) const
+{
+    const BundleEntry& e = m_map->entries[entry];
+    const BundleBlob& b = m_map->blobs[e.blob];
+
+    if (! hpg.LoadBinaryData(m_map->data + b.offset, (size_t)b.size))
+        return false;
+
+    hpg.setNodeId(std::string(m_map->names + e.nodeIdOffset, e.nodeIdLength));
+    return true;
+}
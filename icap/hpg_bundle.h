@@ -0,0 +1,101 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#ifndef __HPG_BUNDLE_H______________________20161024093512__
+#define __HPG_BUNDLE_H______________________20161024093512__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../hpg_interp/hpg.hpp"
+#include "../util/parseable.h"
+
+
+/// A single file holding the HPGs of every link of a network.
+///
+/// Each HPG is stored in the hpg::Hpg binary format.  Identical HPGs are
+/// only stored once, and they are laid out in the order they are given
+/// in (ICAP::PackHpgs uses the routing order).  The index is sorted by
+/// link name.
+class HpgBundle : public Parseable
+{
+public:
+    HpgBundle();
+    ~HpgBundle();
+
+    /// Say if the file is a HPG bundle.
+    static bool isBundle(const std::string& path);
+
+    /// Write a bundle of the given HPGs, one for each of the link names.
+    bool write(const std::string& path, const std::vector<std::string>& names, const std::vector<std::shared_ptr<hpg::Hpg>>& hpgs);
+
+    /// Map a bundle so that HPGs can be loaded from it.
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const;
+
+    /// Index of the named link in the bundle, or -1 if it has no HPG.
+    int find(const std::string& name) const;
+
+    /// Offset of the HPG of the given link (from find) in the file, so that
+    /// HPGs can be loaded in the order they are stored.
+    unsigned long long offset(int entry) const;
+
+    /// Load the HPG of the given link (from find).  On failure, the error
+    /// is in hpg.getErrorMessage().  This can be called from several
+    /// threads at once.
+    bool load(int entry, hpg::Hpg& hpg) const;
+
+private:
+    struct Mapping;
+    std::unique_ptr<Mapping> m_map;
+};
+
+
+#endif//__HPG_BUNDLE_H______________________20161024093512__
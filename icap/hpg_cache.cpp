@@ -0,0 +1,193 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#include <cmath>
+#include <cstring>
+
+#include "hpg_cache.h"
+
+
+HpgQueryCache::HpgQueryCache()
+{
+}
+
+
+void HpgQueryCache::configure(const HpgCacheOptions& options)
+{
+    m_options = options;
+    m_links.clear();
+}
+
+
+long long HpgQueryCache::cellKey(double value, double tolerance) const
+{
+    if (tolerance > 0.0)
+    {
+        double cell = floor(value / tolerance);
+        if (fabs(cell) < 9e18)
+            return (long long)cell;
+    }
+
+    // No tolerance (or a cell number too large for the key); only the
+    // same value matches.
+    long long bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+
+HpgQueryCache::Entry* HpgQueryCache::findEntry(LinkCache& link, long long flowKey, long long headKey)
+{
+    for (size_t i = 0; i < link.entries.size(); i++)
+    {
+        Entry& e = link.entries[i];
+        if (e.flowKey == flowKey && e.headKey == headKey)
+            return &e;
+    }
+    return NULL;
+}
+
+
+bool HpgQueryCache::find(id_type linkId, double flow, double dsHead, unsigned int what, hpg::InterpResult& values)
+{
+    if (m_options.size == 0)
+        return false;
+
+    LinkCache& link = m_links[linkId];
+    Entry* e = findEntry(link, cellKey(flow, m_options.flowTolerance), cellKey(dsHead, m_options.headTolerance));
+    if (e != NULL && (e->what & what) == what)
+    {
+        values = e->values;
+        link.stats.hits++;
+        return true;
+    }
+
+    link.stats.misses++;
+    return false;
+}
+
+
+void HpgQueryCache::insert(id_type linkId, double flow, double dsHead, unsigned int what, const hpg::InterpResult& values)
+{
+    if (m_options.size == 0)
+        return;
+
+    LinkCache& link = m_links[linkId];
+    long long flowKey = cellKey(flow, m_options.flowTolerance);
+    long long headKey = cellKey(dsHead, m_options.headTolerance);
+
+    // Add to the cell's entry if it only has some of the values, else
+    // take a free entry or the oldest one.
+    Entry* e = findEntry(link, flowKey, headKey);
+    if (e == NULL)
+    {
+        if (link.entries.size() < m_options.size)
+        {
+            link.entries.push_back(Entry());
+            e = &link.entries.back();
+        }
+        else
+        {
+            e = &link.entries[link.next];
+            link.next = (link.next + 1) % m_options.size;
+            link.stats.evictions++;
+        }
+        e->flowKey = flowKey;
+        e->headKey = headKey;
+        e->what = 0;
+    }
+
+    if (what & hpg::InterpFlag_Upstream)
+        e->values.upstream = values.upstream;
+    if (what & hpg::InterpFlag_Volume)
+        e->values.volume = values.volume;
+    if (what & hpg::InterpFlag_Hf)
+        e->values.hf = values.hf;
+    e->what |= what;
+}
+
+
+void HpgQueryCache::clear()
+{
+    for (auto iter = m_links.begin(); iter != m_links.end(); iter++)
+    {
+        iter->second.entries.clear();
+        iter->second.next = 0;
+    }
+}
+
+
+HpgCacheStats HpgQueryCache::getStats() const
+{
+    HpgCacheStats total;
+    for (auto iter = m_links.begin(); iter != m_links.end(); iter++)
+    {
+        total.hits += iter->second.stats.hits;
+        total.misses += iter->second.stats.misses;
+        total.evictions += iter->second.stats.evictions;
+    }
+    return total;
+}
+
+
+bool HpgQueryCache::getStats(id_type linkId, HpgCacheStats& stats) const
+{
+    auto iter = m_links.find(linkId);
+    if (iter == m_links.end())
+        return false;
+
+    stats = iter->second.stats;
+    return true;
+}
+
+
+void HpgQueryCache::resetStats()
+{
+    for (auto iter = m_links.begin(); iter != m_links.end(); iter++)
+        iter->second.stats = HpgCacheStats();
+}
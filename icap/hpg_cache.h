@@ -0,0 +1,153 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#ifndef __HPG_CACHE_H_______________________20161027101244__
+#define __HPG_CACHE_H_______________________20161027101244__
+
+#include <unordered_map>
+#include <vector>
+
+#include "../model/model.h"
+#include "../hpg_interp/types.h"
+
+
+/// Settings of the HPG query cache.
+struct HpgCacheOptions
+{
+    /// Number of queries remembered for each link, 0 to turn the cache off.
+    unsigned int size;
+    /// Width of the flow cells; 0 to only reuse a query for the same flow.
+    double flowTolerance;
+    /// Width of the downstream head cells; 0 to only reuse a query for the
+    /// same head.
+    double headTolerance;
+
+    HpgCacheOptions() : size(0), flowTolerance(0.0), headTolerance(0.0) { }
+};
+
+
+/// What the HPG query cache has done since it was last reset.
+struct HpgCacheStats
+{
+    unsigned long long hits;        //< queries answered from the cache
+    unsigned long long misses;      //< queries that went to the HPG
+    unsigned long long evictions;   //< remembered queries dropped to make room
+
+    HpgCacheStats() : hits(0), misses(0), evictions(0) { }
+};
+
+
+/// Remembers the last few HPG queries of each link, so that a link whose
+/// flow and downstream head barely change from one timestep to the next
+/// doesn't interpolate its HPG again.
+///
+/// The flows and heads are cut into cells of the given tolerances, and a
+/// query is answered with the results of an earlier query in the same
+/// cell.  The error is then at most the change of the HPG across a cell,
+/// e.g. flowTolerance * dUS/dQ + headTolerance * dUS/dDS for the upstream
+/// head.  With tolerances of 0 only exactly repeated queries are reused,
+/// and the results are the same as without the cache.
+///
+/// Each link keeps the last 'size' cells it was queried in; the oldest is
+/// dropped to make room for a new one.  This isn't thread-safe.
+class HpgQueryCache
+{
+public:
+    HpgQueryCache();
+
+    /// Change the settings.  This empties the cache and resets the counters.
+    void configure(const HpgCacheOptions& options);
+    const HpgCacheOptions& getOptions() const { return m_options; }
+    bool isEnabled() const { return m_options.size > 0; }
+
+    /// Look up the values selected by the hpg::InterpFlag bits in 'what'
+    /// for the given link, flow and downstream head.  Returns false if
+    /// they weren't all remembered.
+    bool find(id_type linkId, double flow, double dsHead, unsigned int what, hpg::InterpResult& values);
+
+    /// Remember the values selected by 'what' for a query that find
+    /// didn't answer.
+    void insert(id_type linkId, double flow, double dsHead, unsigned int what, const hpg::InterpResult& values);
+
+    /// Forget every query, e.g. when the HPGs are reloaded.  The counters
+    /// are kept.
+    void clear();
+
+    /// The counters of every link, or of one link (false if the link
+    /// hasn't been queried).
+    HpgCacheStats getStats() const;
+    bool getStats(id_type linkId, HpgCacheStats& stats) const;
+    void resetStats();
+
+private:
+    struct Entry
+    {
+        long long flowKey;
+        long long headKey;
+        unsigned int what;          //< InterpFlag bits of the values held
+        hpg::InterpResult values;
+    };
+
+    struct LinkCache
+    {
+        std::vector<Entry> entries; //< ring of the last cells, oldest at 'next' once full
+        unsigned int next;
+        HpgCacheStats stats;
+
+        LinkCache() : next(0) { }
+    };
+
+    HpgCacheOptions m_options;
+    std::unordered_map<id_type, LinkCache> m_links;
+
+    long long cellKey(double value, double tolerance) const;
+    Entry* findEntry(LinkCache& link, long long flowKey, long long headKey);
+};
+
+
+#endif//__HPG_CACHE_H_______________________20161027101244__
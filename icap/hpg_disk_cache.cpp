@@ -0,0 +1,330 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "hpg_disk_cache.h"
+
+
+namespace fs = boost::filesystem;
+
+
+namespace
+{
+    /// Temporary files older than this were left by a writer that didn't
+    /// finish, and are removed by trim.
+    const std::time_t STALE_TEMP_SECONDS = 24 * 60 * 60;
+
+    /// A source hash is only used as a file name if it can't name a file
+    /// outside of the cache.
+    bool isValidHash(const std::string& sourceHash)
+    {
+        if (sourceHash.empty())
+            return false;
+        for (size_t i = 0; i < sourceHash.size(); i++)
+        {
+            char c = sourceHash[i];
+            if (! ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')))
+                return false;
+        }
+        return true;
+    }
+
+    struct CachedHpg
+    {
+        fs::path path;
+        std::time_t used;
+        unsigned long long size;
+
+        bool operator<(const CachedHpg& other) const { return used < other.used; }
+    };
+}
+
+
+HpgDiskCache::HpgDiskCache()
+    : m_maxBytes(0), m_bytes(0), m_hits(0), m_misses(0), m_stores(0), m_evictions(0)
+{
+}
+
+
+HpgDiskCache::~HpgDiskCache()
+{
+}
+
+
+bool HpgDiskCache::open(const std::string& dir, unsigned long long maxBytes)
+{
+    close();
+
+    boost::system::error_code ec;
+    fs::create_directories(dir, ec);
+    if (! fs::is_directory(dir, ec))
+    {
+        setErrorMessage("Unable to create the HPG cache directory.  Dir=" + dir);
+        return false;
+    }
+
+    m_dir = dir;
+    m_maxBytes = maxBytes;
+
+    // This also finds the size of the cache.
+    trim();
+
+    return true;
+}
+
+
+void HpgDiskCache::close()
+{
+    m_dir.clear();
+    m_maxBytes = 0;
+    m_bytes = 0;
+    m_hits = 0;
+    m_misses = 0;
+    m_stores = 0;
+    m_evictions = 0;
+}
+
+
+bool HpgDiskCache::isOpen() const
+{
+    return ! m_dir.empty();
+}
+
+
+std::string HpgDiskCache::hpgPath(const std::string& key) const
+{
+    return (fs::path(m_dir) / (key + ".hpgb")).string();
+}
+
+
+std::string HpgDiskCache::textHash(const std::string& path)
+{
+    std::ifstream fh(path, std::ios::binary);
+    std::string header;
+    if (! fh.is_open() || ! std::getline(fh, header))
+        return "";
+
+    // 64-bit FNV-1a, the same as HpgCreator::getSourceHash.  Line endings
+    // don't count.
+    unsigned long long hash = 14695981039346656037ULL;
+    char buffer[65536];
+    while (fh.read(buffer, sizeof(buffer)) || fh.gcount() > 0)
+    {
+        std::streamsize count = fh.gcount();
+        for (std::streamsize i = 0; i < count; i++)
+        {
+            if (buffer[i] == '\r')
+                continue;
+            hash ^= (unsigned char)buffer[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    std::stringstream hex;
+    hex << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return hex.str();
+}
+
+
+bool HpgDiskCache::load(const std::string& sourceHash, const std::string& textHash, hpg::Hpg& hpg)
+{
+    if (! isOpen() || ! isValidHash(sourceHash) || (! textHash.empty() && ! isValidHash(textHash)))
+        return false;
+
+    // A HPG that doesn't load (e.g. it was written by an older version of
+    // the binary format) or that has another hash is the same as a missing
+    // one; storing the HPG again replaces it.
+    std::string path = hpgPath(sourceHash + textHash);
+    boost::system::error_code ec;
+    if (! fs::exists(path, ec) || ! hpg.LoadBinary(path) || hpg.getSourceHash() != sourceHash)
+    {
+        m_misses++;
+        return false;
+    }
+
+    // The modification time is when the HPG was last used.
+    fs::last_write_time(path, std::time(NULL), ec);
+
+    m_hits++;
+    return true;
+}
+
+
+bool HpgDiskCache::store(hpg::Hpg& hpg, const std::string& textHash)
+{
+    std::string sourceHash = hpg.getSourceHash();
+    if (! isOpen() || ! isValidHash(sourceHash) || (! textHash.empty() && ! isValidHash(textHash)))
+        return false;
+
+    // Each writer has its own temporary file, and the rename replaces the
+    // cached HPG in one step, so readers never see part of a HPG.
+    boost::system::error_code ec;
+    fs::path tempPath = fs::path(m_dir) / fs::unique_path("%%%%%%%%%%%%%%%%.tmp", ec);
+    if (ec)
+        return false;
+
+    // Cached HPGs are shared by links of any name, so they don't keep the
+    // node ID.
+    std::string nodeId = hpg.getNodeId();
+    hpg.setNodeId("");
+    bool saved = hpg.SaveBinary(tempPath.string());
+    hpg.setNodeId(nodeId);
+
+    unsigned long long size = saved ? fs::file_size(tempPath, ec) : 0;
+    if (saved && ! ec)
+        fs::rename(tempPath, hpgPath(sourceHash + textHash), ec);
+    if (! saved || ec)
+    {
+        fs::remove(tempPath, ec);
+        return false;
+    }
+
+    m_stores++;
+    if ((m_bytes += size) > m_maxBytes && m_maxBytes > 0)
+        trim();
+
+    return true;
+}
+
+
+int HpgDiskCache::trim()
+{
+    std::lock_guard<std::mutex> lock(m_trimMutex);
+
+    if (! isOpen())
+        return 0;
+
+    // Other processes can add and remove HPGs while the directory is read,
+    // so files that go missing are skipped.
+    std::vector<CachedHpg> hpgs;
+    unsigned long long total = 0;
+    std::time_t now = std::time(NULL);
+    boost::system::error_code ec;
+    for (fs::directory_iterator it(m_dir, ec), end; ! ec && it != end; it.increment(ec))
+    {
+        CachedHpg entry;
+        entry.path = it->path();
+        entry.used = fs::last_write_time(entry.path, ec);
+        if (ec)
+        {
+            ec.clear();
+            continue;
+        }
+
+        if (entry.path.extension() == ".tmp")
+        {
+            if (now - entry.used > STALE_TEMP_SECONDS)
+                fs::remove(entry.path, ec);
+            ec.clear();
+            continue;
+        }
+        else if (entry.path.extension() != ".hpgb")
+        {
+            continue;
+        }
+
+        entry.size = fs::file_size(entry.path, ec);
+        if (ec)
+        {
+            ec.clear();
+            continue;
+        }
+
+        hpgs.push_back(entry);
+        total += entry.size;
+    }
+
+    // Trim to 90% of the size, so that the next few stores don't each read
+    // the directory again.
+    int removed = 0;
+    if (m_maxBytes > 0 && total > m_maxBytes)
+    {
+        unsigned long long target = m_maxBytes / 10 * 9;
+        std::sort(hpgs.begin(), hpgs.end());
+        for (size_t i = 0; i < hpgs.size() && total > target; i++)
+        {
+            // A HPG that is being loaded can't be removed on Windows; it is
+            // in use, so it is kept.
+            if (fs::remove(hpgs[i].path, ec) && ! ec)
+            {
+                total -= hpgs[i].size;
+                removed++;
+            }
+            ec.clear();
+        }
+    }
+
+    m_bytes = total;
+    m_evictions += removed;
+    return removed;
+}
+
+
+unsigned long long HpgDiskCache::getSize() const
+{
+    return m_bytes;
+}
+
+
+HpgDiskCacheStats HpgDiskCache::getStats() const
+{
+    HpgDiskCacheStats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.stores = m_stores;
+    stats.evictions = m_evictions;
+    return stats;
+}
@@ -0,0 +1,142 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+
+#ifndef __HPG_DISK_CACHE_H__________________20161107101530__
+#define __HPG_DISK_CACHE_H__________________20161107101530__
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "../hpg_interp/hpg.hpp"
+#include "../util/parseable.h"
+
+
+/// What the HPG disk cache has done since it was opened.
+struct HpgDiskCacheStats
+{
+    unsigned long long hits;        //< HPGs loaded from the cache
+    unsigned long long misses;      //< HPGs that weren't in the cache
+    unsigned long long stores;      //< HPGs added to the cache
+    unsigned long long evictions;   //< HPGs removed to keep the cache under its size
+
+    HpgDiskCacheStats() : hits(0), misses(0), stores(0), evictions(0) { }
+};
+
+
+/// A directory of binary HPGs named by their source hash (see
+/// HpgCreator::getSourceHash), which the HPG directories of several
+/// projects can share.  A HPG made for a reach with the same geometry and
+/// creator settings as a cached one can be loaded from the cache instead
+/// of being created again.
+///
+/// A text HPG is only as good as its source hash if nobody changed its
+/// curves since it was created (e.g. thinned or edited them), so the HPGs
+/// loaded from text are cached under their source hash followed by the
+/// textHash of the file, apart from the HPGs that come straight from the
+/// creator.
+///
+/// Several threads and processes can use the same cache directory.  HPGs
+/// are written to a temporary file and renamed, so a HPG in the cache is
+/// always complete.  When the cache grows past its size, the HPGs that
+/// were least recently stored or loaded are removed.
+class HpgDiskCache : public Parseable
+{
+public:
+    HpgDiskCache();
+    ~HpgDiskCache();
+
+    /// Opens (and creates) the cache directory.  The cache is kept under
+    /// maxBytes, or isn't limited if it is 0.
+    bool open(const std::string& dir, unsigned long long maxBytes = 0);
+    void close();
+    bool isOpen() const;
+
+    /// Loads the HPG with the source hash, followed by the text hash it
+    /// was stored with if any.  Returns false if it isn't in the cache.
+    /// This can be called from several threads at once.
+    bool load(const std::string& sourceHash, const std::string& textHash, hpg::Hpg& hpg);
+
+    /// Adds the HPG to the cache under its source hash followed by the
+    /// text hash, and removes the least recently used HPGs if the cache is
+    /// then too big.  A HPG that can't be added isn't an error, it just
+    /// won't be found later.  This can be called from several threads at
+    /// once.
+    bool store(hpg::Hpg& hpg, const std::string& textHash = "");
+
+    /// A hash of the curves of the text HPG, i.e. of the file after its
+    /// header line, which has the node ID.  Empty if the file can't be
+    /// read.
+    static std::string textHash(const std::string& path);
+
+    /// Removes the least recently used HPGs until the cache is under its
+    /// size.  Returns the number of HPGs removed.
+    int trim();
+
+    /// Size of the HPGs in the cache, as of the last trim plus the HPGs
+    /// stored since.
+    unsigned long long getSize() const;
+
+    HpgDiskCacheStats getStats() const;
+
+private:
+    /// The file of the HPG with the key.
+    std::string hpgPath(const std::string& key) const;
+
+    std::string m_dir;
+    unsigned long long m_maxBytes;
+    std::atomic<unsigned long long> m_bytes;
+    std::atomic<unsigned long long> m_hits;
+    std::atomic<unsigned long long> m_misses;
+    std::atomic<unsigned long long> m_stores;
+    std::atomic<unsigned long long> m_evictions;
+    std::mutex m_trimMutex;
+};
+
+
+#endif//__HPG_DISK_CACHE_H__________________20161107101530__
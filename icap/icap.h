@@ -49,6 +49,7 @@
 #define __ICAP_H____________________________20080424150000__
 
 #include <string>
+#include <functional>
 
 #ifdef USE_EIGEN
 #include "../deps/Eigen/Dense"
@@ -186,6 +187,9 @@ private:
 	/// The path to the directory containing HPGs.
     std::string m_hpgPath;
 
+    /// Called as the HPGs are loaded (see HpgLoadOptions::progress).
+    std::function<void (int loaded, int count)> m_hpgLoadProgress;
+
     ///////////////////////////////////////////////////////////////////////////
     // ERROR AND DEBUGGING VARIABLES
 
@@ -209,6 +213,9 @@ private:
     /// Load all of the HPG's in the HPG list.
     bool loadHpgs(const std::string& hpgPath);
 
+    /// The HPG load options from the input file.
+    HpgLoadOptions getHpgLoadOptions();
+
 	/// Finds the first node (e.g. the downstream-most node) in the system.
     id_type findFirstNode(geometry::NodeType sinkNodeType);
 
@@ -283,6 +290,10 @@ private:
     /// Do a ponded routing for a link (ponded = no flow).
     bool pondedRouteLink(const id_type& linkIdx);
 
+    /// The links in the order steadyRoute visits them, followed by any links
+    /// that it doesn't reach.
+    std::vector<std::shared_ptr<geometry::Link>> getRoutingOrder();
+
 
     ///////////////////////////////////////////////////////////////////////////
     // NODE/LINK ATTRIBUTE ACCESS FUNCTIONS
@@ -345,6 +356,11 @@ public:
 	/// Initializes the logging engine with the specified severity level.
     void InitializeLog(loglevel::SeverityLevel level, std::string logFilePath);
 
+    /// Set a function that is called as each HPG is loaded by Open, with the
+    /// number loaded so far and the number to load.  It may be called from
+    /// several threads, but only one call at a time.
+    void SetHpgLoadProgress(std::function<void (int loaded, int count)> progress);
+
     /// This opens the input file, loads everything, and opens the SWMM engine.
     bool Open(const std::string& inputFile, const std::string& outputFile, const std::string& reportFile, bool loadhpgs);
 
@@ -373,6 +389,26 @@ public:
 	/// Compute the total volume curve F_vt and save it to a file for use by someone else.
 	void SaveTotalVolumeCurve(const std::string& file);
 
+    /// Save the loaded HPGs to a single bundle file, in routing order.  The
+    /// bundle can then be given as the hpg_path instead of the directory.
+    bool PackHpgs(const std::string& bundlePath);
+
+    /// Returns the hit, miss and eviction counts of the HPG query cache (set
+    /// up by the hpg_cache_size and hpg_cache_*_tolerance options) for every
+    /// link, since the HPGs were loaded or ResetHpgCacheStats was called.
+    HpgCacheStats GetHpgCacheStats();
+
+    /// The same for one link.  Returns false if the link doesn't exist or
+    /// hasn't been queried.
+    bool GetHpgCacheStats(const std::string& linkId, HpgCacheStats& stats);
+
+    /// Zero the HPG query cache counters, e.g. at the start of an event.
+    void ResetHpgCacheStats();
+
+    /// Change the HPG query cache settings of the loaded HPGs.  This empties
+    /// the cache and zeroes its counters.
+    void SetHpgCacheOptions(const HpgCacheOptions& options);
+
 	/// Returns the index/ID of the downstream-most node.
     const id_type& GetReservoirNodeIndex();
 
@@ -71,6 +71,33 @@ int main(int argc, char** argv)
     using namespace std;
     srand( (unsigned int)time(NULL) );
 
+    // Convert a directory of text HPGs to the binary format, and stop.
+    if (argc == 3 && ! strcmp(argv[1], "-hpgb"))
+    {
+        IcapHpg hpgs;
+        int count = hpgs.convertHpgs(argv[2]);
+        if (count < 0)
+        {
+            printf("ERROR: %s\n", hpgs.getErrorMessage().c_str());
+            return 1;
+        }
+        printf("Converted %d HPGs.\n", count);
+        return 0;
+    }
+
+    // Pack the HPGs of a model into a single bundle file, and stop.
+    if (argc == 4 && ! strcmp(argv[1], "-pack"))
+    {
+        ICAP icap;
+        if (! icap.Open(argv[2], "", "", true) || ! icap.PackHpgs(argv[3]))
+        {
+            printf("ERROR: %s\n", icap.getErrorMessage().c_str());
+            return 1;
+        }
+        printf("Saved HPG bundle %s.\n", argv[3]);
+        return 0;
+    }
+
     // Get the files from the command line or console input.
     char inputFile[MAXFNAME + 1];
     char outputFile[MAXFNAME + 1];
@@ -92,6 +119,7 @@ int main(int argc, char** argv)
 
 	printf("Opening ICAP...\n");
     ICAP icap;
+    icap.SetHpgLoadProgress([](int loaded, int count) { printf("Loaded HPG %d of %d...\n", loaded, count); });
     bool result = icap.Open(inputFile, reportFile, outputFile, true);
     if (! result)
         DEBUG_EXIT;
@@ -141,6 +141,16 @@ bool IcapGeometry::processOptions()
 {
     this->freeSurfaceOnlyComputations = false;
     this->routeStep = 1;
+    this->hpgCompileError = 0.0;
+    this->hpgCompileVolumeError = 0.001;
+    this->hpgLoadThreads = 0;
+    this->hpgLazySplines = false;
+    this->hpgShareIdentical = false;
+    this->hpgCacheSize = 0;
+    this->hpgCacheFlowTolerance = 0.0;
+    this->hpgCacheHeadTolerance = 0.0;
+    this->hpgDiskCache = "";
+    this->hpgDiskCacheSize = 0.0;
 
     std::vector<std::string> options = getOptionNames();
 
@@ -207,7 +217,7 @@ bool IcapGeometry::processOptions()
         this->hpgPath = (parentDir / this->hpgPath).string();
         if (!boost::filesystem::exists(this->hpgPath))
         {
-            setErrorMessage("Invalid path to HPG folder '" + this->hpgPath + "'");
+            setErrorMessage("Invalid path to HPG folder or bundle '" + this->hpgPath + "'");
             return false;
         }
     }
@@ -236,6 +246,100 @@ bool IcapGeometry::processOptions()
         }
     }
 
+    if (hasOption("hpg_compile_error"))
+    {
+        if (!tryParse(getOption("hpg_compile_error"), this->hpgCompileError) || this->hpgCompileError < 0.0)
+        {
+            setErrorMessage("Invalid hpg_compile_error option is provided.");
+            return false;
+        }
+    }
+
+    if (hasOption("hpg_compile_volume_error"))
+    {
+        if (!tryParse(getOption("hpg_compile_volume_error"), this->hpgCompileVolumeError) || this->hpgCompileVolumeError <= 0.0)
+        {
+            setErrorMessage("Invalid hpg_compile_volume_error option is provided.");
+            return false;
+        }
+    }
+
+    if (hasOption("hpg_load_threads"))
+    {
+        if (!tryParse(getOption("hpg_load_threads"), this->hpgLoadThreads) || this->hpgLoadThreads < 0)
+        {
+            setErrorMessage("Invalid hpg_load_threads option is provided.");
+            return false;
+        }
+    }
+
+    if (hasOption("hpg_lazy_splines"))
+    {
+        std::string opt(getOption("hpg_lazy_splines"));
+        boost::algorithm::to_lower(opt);
+        if (opt == "true")
+        {
+            this->hpgLazySplines = true;
+        }
+    }
+
+    if (hasOption("hpg_share_identical"))
+    {
+        std::string opt(getOption("hpg_share_identical"));
+        boost::algorithm::to_lower(opt);
+        if (opt == "true")
+        {
+            this->hpgShareIdentical = true;
+        }
+    }
+
+    if (hasOption("hpg_cache_size"))
+    {
+        if (!tryParse(getOption("hpg_cache_size"), this->hpgCacheSize) || this->hpgCacheSize < 0)
+        {
+            setErrorMessage("Invalid hpg_cache_size option is provided.");
+            return false;
+        }
+    }
+
+    if (hasOption("hpg_cache_flow_tolerance"))
+    {
+        if (!tryParse(getOption("hpg_cache_flow_tolerance"), this->hpgCacheFlowTolerance) || this->hpgCacheFlowTolerance < 0.0)
+        {
+            setErrorMessage("Invalid hpg_cache_flow_tolerance option is provided.");
+            return false;
+        }
+    }
+
+    if (hasOption("hpg_cache_head_tolerance"))
+    {
+        if (!tryParse(getOption("hpg_cache_head_tolerance"), this->hpgCacheHeadTolerance) || this->hpgCacheHeadTolerance < 0.0)
+        {
+            setErrorMessage("Invalid hpg_cache_head_tolerance option is provided.");
+            return false;
+        }
+    }
+
+    if (hasOption("hpg_disk_cache"))
+    {
+        // A relative cache directory is in the directory of the input file.
+        this->hpgDiskCache = getOption("hpg_disk_cache");
+        if (fs::path(this->hpgDiskCache).is_relative())
+        {
+            fs::path parentDir = fs::path(this->geomFilePath).parent_path();
+            this->hpgDiskCache = (parentDir / this->hpgDiskCache).string();
+        }
+    }
+
+    if (hasOption("hpg_disk_cache_size"))
+    {
+        if (!tryParse(getOption("hpg_disk_cache_size"), this->hpgDiskCacheSize) || this->hpgDiskCacheSize < 0.0)
+        {
+            setErrorMessage("Invalid hpg_disk_cache_size option is provided.");
+            return false;
+        }
+    }
+
     return true;
 }
 
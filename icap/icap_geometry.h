@@ -67,6 +67,16 @@ private:
     double routeStep;
     double reportStep;
     bool freeSurfaceOnlyComputations;
+    double hpgCompileError;
+    double hpgCompileVolumeError;
+    int hpgLoadThreads;
+    bool hpgLazySplines;
+    bool hpgShareIdentical;
+    int hpgCacheSize;
+    double hpgCacheFlowTolerance;
+    double hpgCacheHeadTolerance;
+    std::string hpgDiskCache;
+    double hpgDiskCacheSize;
 
 protected:
     virtual bool processOptions();
@@ -77,6 +87,25 @@ public:
     double getRoutingStep() { return this->routeStep; }
     double getReportStep() { return this->reportStep; }
     bool freeSurfaceOnly() { return this->freeSurfaceOnlyComputations; }
+    /// Largest upstream head error of the compiled HPG tables, 0 to not compile the HPGs.
+    double getHpgCompileError() { return this->hpgCompileError; }
+    /// Largest relative volume error of the compiled HPG tables.
+    double getHpgCompileVolumeError() { return this->hpgCompileVolumeError; }
+    /// Number of threads that load the HPGs, 0 for one per core.
+    int getHpgLoadThreads() { return this->hpgLoadThreads; }
+    /// Build the HPG curve splines on first use instead of at load time.
+    bool getHpgLazySplines() { return this->hpgLazySplines; }
+    /// Load one HPG for all of the reaches with the same diameter, roughness, length and slope.
+    bool getHpgShareIdentical() { return this->hpgShareIdentical; }
+    /// Number of HPG queries cached for each link, 0 for no cache.
+    int getHpgCacheSize() { return this->hpgCacheSize; }
+    /// Flow and downstream head tolerances of the HPG query cache.
+    double getHpgCacheFlowTolerance() { return this->hpgCacheFlowTolerance; }
+    double getHpgCacheHeadTolerance() { return this->hpgCacheHeadTolerance; }
+    /// Directory of the HPG disk cache shared by projects, empty for no cache.
+    std::string getHpgDiskCache() { return this->hpgDiskCache; }
+    /// Largest size of the HPG disk cache in MB, 0 for no limit.
+    double getHpgDiskCacheSize() { return this->hpgDiskCacheSize; }
     void enableRealTimeStatus();
 
     ///////////////////////////////////////////////////////////////////////
@@ -351,22 +351,124 @@ bool ICAP::loadInputFile(const std::string& inputFile)
 }
 
 
+HpgLoadOptions ICAP::getHpgLoadOptions()
+{
+    HpgLoadOptions options;
+    options.compileError = m_geometry->getHpgCompileError();
+    options.compileVolumeError = m_geometry->getHpgCompileVolumeError();
+    options.threads = m_geometry->getHpgLoadThreads();
+    options.lazySplines = m_geometry->getHpgLazySplines();
+    options.shareIdentical = m_geometry->getHpgShareIdentical();
+    options.cache.size = m_geometry->getHpgCacheSize();
+    options.cache.flowTolerance = m_geometry->getHpgCacheFlowTolerance();
+    options.cache.headTolerance = m_geometry->getHpgCacheHeadTolerance();
+    options.diskCache = m_geometry->getHpgDiskCache();
+    options.diskCacheSize = (unsigned long long)(m_geometry->getHpgDiskCacheSize() * 1024 * 1024);
+    options.progress = m_hpgLoadProgress;
+    return options;
+}
+
+
+void ICAP::SetHpgLoadProgress(std::function<void (int loaded, int count)> progress)
+{
+    m_hpgLoadProgress = progress;
+}
+
+
 bool ICAP::loadHpgs(const std::string& hpgPath)
 {
+    HpgLoadOptions options = getHpgLoadOptions();
+
     // Load the HPGs.
-    if (! m_hpgList.loadHpgs(hpgPath, m_geometry->getLinkList()))
+    if (! m_hpgList.loadHpgs(hpgPath, m_geometry->getLinkList(), options))
     {   
         BOOST_LOG_SEV(m_log, loglevel::error) << "HPG's failed to load: " << m_hpgList.getErrorMessage();
         setErrorMessage("HPG's failed to load: " + m_hpgList.getErrorMessage());
         return false;
     }
 
+    if (options.shareIdentical)
+    {
+        HpgShareStats stats = m_hpgList.getShareStats();
+        BOOST_LOG_SEV(m_log, loglevel::info) << "Loaded " << stats.instances << " HPGs for " << stats.links <<
+            " links (" << stats.ratio() << " links per HPG)";
+    }
+
+    if (! options.diskCache.empty())
+    {
+        HpgDiskCacheStats stats = m_hpgList.getDiskCacheStats();
+        BOOST_LOG_SEV(m_log, loglevel::info) << "HPG disk cache: " << stats.hits << " HPGs loaded, " <<
+            stats.stores << " added, " << stats.evictions << " removed";
+    }
+
+    // Report how well each compiled HPG matches its splines.
+    if (options.compileError > 0.0)
+    {
+        geometry::LinkList* linkList = m_geometry->getLinkList();
+        for (int i = 0; i < linkList->count(); i++)
+        {
+            auto link = linkList->get(i);
+            hpg::CompileStats stats;
+            if (m_hpgList.getCompileStats(link->getId(), stats))
+            {
+                BOOST_LOG_SEV(m_log, loglevel::info) << "Compiled HPG " << link->getName() <<
+                    ": max head error=" << stats.maxHeadError <<
+                    " max volume error=" << stats.maxVolumeError <<
+                    " cells=" << stats.cells << " (" << stats.exactCells << " left to splines)" <<
+                    " memory=" << stats.memory << " bytes";
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool ICAP::PackHpgs(const std::string& bundlePath)
+{
+    if (! m_hpgList.saveBundle(bundlePath, getRoutingOrder()))
+    {
+        BOOST_LOG_SEV(m_log, loglevel::error) << "Failed to save HPG bundle: " << m_hpgList.getErrorMessage();
+        setErrorMessage("Failed to save HPG bundle: " + m_hpgList.getErrorMessage());
+        return false;
+    }
+
     return true;
 }
 
 
+HpgCacheStats ICAP::GetHpgCacheStats()
+{
+    return m_hpgList.getCacheStats();
+}
+
+
+bool ICAP::GetHpgCacheStats(const std::string& linkId, HpgCacheStats& stats)
+{
+    std::shared_ptr<geometry::Link> link = m_geometry->getLink(linkId);
+    if (link == NULL)
+        return false;
+
+    return m_hpgList.getCacheStats(link->getId(), stats);
+}
+
+
+void ICAP::ResetHpgCacheStats()
+{
+    m_hpgList.resetCacheStats();
+}
+
+
+void ICAP::SetHpgCacheOptions(const HpgCacheOptions& options)
+{
+    m_hpgList.setCacheOptions(options);
+}
+
+
 int ICAP::loadNextHpg()
 {
+    m_hpgList.setLoadOptions(getHpgLoadOptions());
+
     // Load the HPGs.
     int result = m_hpgList.loadNextHpg(m_hpgPath, m_geometry->getLinkList());
     if (result > 0)
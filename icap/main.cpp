@@ -53,18 +53,62 @@
 #include <iostream>
 #include <string>
 #include <cmath>
+#include <cstring>
 
 #include "../../icap/icap.h"
+#include "../../icap/hpg_batch.h"
 #include "../../util/math.h"
 
 
 namespace fs = boost::filesystem;
 
+
+// icap -hpgs <input_file> <hpg_dir> [<threads>] [-force] [-cache <cache_dir>] [-cache_size <MB>]
+//
+// Creates the missing and out of date HPGs of every conduit in the input file,
+// using the HPG disk cache in cache_dir if one is given.
+void CreateHpgs(int argc, char** argv)
+{
+    using namespace std;
+
+    HpgBatchOptions options;
+    for (int i = 4; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-force"))
+            options.force = true;
+        else if (!strcmp(argv[i], "-cache") && i + 1 < argc)
+            options.diskCache = argv[++i];
+        else if (!strcmp(argv[i], "-cache_size") && i + 1 < argc)
+            options.diskCacheSize = (unsigned long long)(std::max(0.0, atof(argv[++i])) * 1024 * 1024);
+        else
+            options.threads = (unsigned int)std::max(0, atoi(argv[i]));
+    }
+    options.progress = [](int done, int count)
+    {
+        cout << "HPG " << done << " of " << count << "                  \r" << flush;
+    };
+
+    HpgBatch batch;
+    bool result = batch.run(argv[2], argv[3], options);
+    cout << endl;
+    batch.writeSummary(cout);
+
+    if (!result)
+        cout << "Unable to create the HPGs: " << batch.getErrorMessage() << endl;
+}
+
+
 void main(int argc, char** argv)
 {
     using namespace std;
     bool status;
 
+    if (argc >= 4 && !strcmp(argv[1], "-hpgs"))
+    {
+        CreateHpgs(argc, argv);
+        return;
+    }
+
     if (argc < 2)
     {
         cout << "Require two command line arguments" << endl;
@@ -118,6 +118,51 @@ bool ICAP::steadyRoute(const id_type& sinkNodeIdx, bool ponded)
 }
 
 
+std::vector<std::shared_ptr<geometry::Link>> ICAP::getRoutingOrder()
+{
+    using namespace std;
+
+    vector<shared_ptr<geometry::Link>> order;
+    map<id_type, bool> listed;
+
+    // The same traversal as steadyRoute.
+    map<id_type, bool> followList;
+    vector<id_type> toFollow;
+
+    toFollow.push_back(m_sinkNodeIdx);
+
+    while (! toFollow.empty())
+    {
+        id_type nodeId = toFollow.back();
+        toFollow.pop_back();
+
+        if (followList.find(nodeId) != followList.end())
+            continue;
+
+        std::shared_ptr<geometry::Node> node = m_geometry->getNode(nodeId);
+
+        for (auto link: node->getUpstreamLinks())
+        {
+            if (listed.insert(std::make_pair(link->getId(), true)).second)
+                order.push_back(link);
+            toFollow.push_back(link->getUpstreamNode()->getId());
+        }
+
+        followList.insert(std::make_pair(nodeId, true));
+    }
+
+    geometry::LinkList* links = m_geometry->getLinkList();
+    for (int i = 0; i < links->count(); i++)
+    {
+        auto link = links->get(i);
+        if (listed.insert(std::make_pair(link->getId(), true)).second)
+            order.push_back(link);
+    }
+
+    return order;
+}
+
+
 /// <summary>
 /// The goal of this function is to pass a node depth to the downstream end
 /// of upstream conduits.  Node depths can be different than conduit depths
@@ -293,18 +338,18 @@ bool ICAP::steadyRouteLink(const id_type& linkId)
     //// In this case there is flow.  Interpolate from our HPGs now.
     //else
     //{
-    if (!m_hpgList.getUpstream(linkId, dsDepth + dsInvert, flow, usDepth))
+    // Get the upstream and the volume with one HPG query.
+    hpg::InterpResult values;
+    if (!m_hpgList.getValues(linkId, dsDepth + dsInvert, flow, values, hpg::InterpFlag_Upstream | hpg::InterpFlag_Volume))
     {
-        BOOST_LOG_SEV(m_log, loglevel::error) << "Unable to query the HPG for upstream using the parameters dsDepth=" << 
+        BOOST_LOG_SEV(m_log, loglevel::error) << "Unable to query the HPG for upstream and volume using the parameters dsDepth=" << 
             dsDepth << " flow=" << flow << " link=" << m_geometry->getLink(linkId)->getName() << "; error: " << m_hpgList.getErrorMessage();
         okToContinue = false;
     }
-
-    if (okToContinue && !m_hpgList.getVolume(linkId, dsDepth + dsInvert, flow, volume))
+    else
     {
-        BOOST_LOG_SEV(m_log, loglevel::error) << "Unable to query the HPG for volume using the parameters dsDepth=" << 
-            dsDepth << " flow=" << flow << " link=" << m_geometry->getLink(linkId)->getName() << "; error: " << m_hpgList.getErrorMessage();
-        okToContinue = false;
+        usDepth = values.upstream;
+        volume = values.volume;
     }
 	//}
 
@@ -66,6 +66,35 @@ bool ICAP::End()
     m_results.complete();
     m_report.complete();
 
+    // Report how much of each HPG the run used, when the splines were only
+    // built for the curves that were interpolated.
+    if (m_geometry->getHpgLazySplines())
+    {
+        geometry::LinkList* linkList = m_geometry->getLinkList();
+        unsigned int curves = 0, builtCurves = 0;
+        for (int i = 0; i < linkList->count(); i++)
+        {
+            auto link = linkList->get(i);
+            hpg::SplineStats stats;
+            if (m_hpgList.getSplineStats(link->getId(), stats))
+            {
+                BOOST_LOG_SEV(m_log, loglevel::debug) << "HPG " << link->getName() <<
+                    ": splines built for " << stats.builtCurves << " of " << stats.curves << " curves" <<
+                    " memory=" << stats.memory << " bytes";
+                curves += stats.curves;
+                builtCurves += stats.builtCurves;
+            }
+        }
+        BOOST_LOG_SEV(m_log, loglevel::info) << "HPG splines built for " << builtCurves << " of " << curves << " curves";
+    }
+
+    if (m_geometry->getHpgCacheSize() > 0)
+    {
+        HpgCacheStats stats = m_hpgList.getCacheStats();
+        BOOST_LOG_SEV(m_log, loglevel::info) << "HPG query cache: hits=" << stats.hits <<
+            " misses=" << stats.misses << " evictions=" << stats.evictions;
+    }
+
     return result;
 }
 
@@ -539,23 +568,26 @@ bool ICAP::setHfAndDE(Eigen::VectorXf& curQ, Eigen::VectorXf& curH)
         const id_type& dsId = links->get(i)->getDownstreamNode()->getId();
         const id_type& usId = links->get(i)->getUpstreamNode()->getId();
 
-        double dsDepth =  m_geometry->getNodeVariable(dsId, variables::NodeDepth);
-        double usDepth =  m_geometry->getNodeVariable(usId, variables::NodeDepth);
-
-        double hf = 0;
-        if (!m_hpgList.getHf(
-            i,
-           dsDepth,
-            m_geometry->getLinkVariable(links->id(i), variables::LinkFlow), hf))
+        // Use the current iterate, not the values of the last time step.
+        double flow = curQ(i);
+        double dsDepth = curH(dsId);
+        double usDepth = curH(usId);
+
+        // The residual of the link is hf(Q, DS) + DS - US.  Its derivatives
+        // by Q and DS come from the HPG; the -1 for US is already set in
+        // the connectivity matrix.
+        hpg::InterpResult values;
+        hpg::InterpSlopes slopes;
+        if (!m_hpgList.getValues(i, dsDepth, flow, values, slopes, hpg::InterpFlag_Hf))
         {
             return false;
         }
 
-        m_matrixLhs(i, i) = hf;
+        m_matrixLhs(i, i) = slopes.dHfdQ;
+        m_matrixLhs(i, linkCount + dsId) = 1 + slopes.dHfdDs;
 
-        m_matrixRhs(i) = hf + dsDepth - usDepth;
+        m_matrixRhs(i) = values.hf + dsDepth - usDepth;
 
-        double flow = m_geometry->getLinkVariable(links->id(i), variables::LinkFlow);
         m_matrixRhs(linkCount + dsId) += flow;
         m_matrixRhs(linkCount + usId) -= flow;
     }
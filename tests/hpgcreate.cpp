@@ -51,10 +51,12 @@
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <cmath>
 #include <fstream>
+#include <iterator>
 
 #include "../hpg_creation/hpg_creator.hpp"
 #include "../hpg_creation/profile.h"
@@ -642,6 +644,327 @@ namespace TestGeometryRead
             Assert::AreEqual(hpg.getMaxDepthFraction(), 1., L"Failed to read header properly");
         }
         
+        std::string readFile(const char* path)
+        {
+            std::ifstream in(path);
+            return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+
+		TEST_METHOD(ParallelCreateTest)
+		{
+            using namespace std;
+
+            // The cross section used to hand back the angle of the last
+            // depth it computed for depths close to zero.
+            xs::Circular circ(10);
+            circ.computeArea(5);
+            Assert::AreEqual(0., circ.computeArea(0));
+
+            xs::Reach reach = makeReach(2.66, 1530);
+
+            // The curves are added in flow order, so the HPG can't depend on
+            // the number of threads that computed them.
+            HpgCreator serial;
+            serial.setNumThreads(1);
+            std::shared_ptr<hpg::Hpg> hpg1 = serial.AutoCreateHpg(reach);
+            Assert::IsTrue(hpg1 != NULL, L"Serial HPG creation failed");
+            hpg1->SaveToFile("parallel.serial.txt");
+
+            HpgCreator parallel;
+            parallel.setNumThreads(4);
+            std::shared_ptr<hpg::Hpg> hpg4 = parallel.AutoCreateHpg(reach);
+            Assert::IsTrue(hpg4 != NULL, L"Parallel HPG creation failed");
+            hpg4->SaveToFile("parallel.threads.txt");
+
+            Assert::IsTrue(readFile("parallel.serial.txt") == readFile("parallel.threads.txt"), L"HPG depends on the number of threads");
+        }
+
+        /// computeAll must give what the functions give one by one, with or
+        /// without the lookup table, for the depths the solvers use.
+        /// Reports the time of a set of properties both ways.
+		TEST_METHOD(CircularPropertiesTest)
+		{
+            using namespace std;
+            using namespace std::chrono;
+
+            xs::Circular circ(10), table(10);
+            table.setLookupTable(true);
+
+            const int depths = 100000;
+            double maxError = 0, maxTableError = 0;
+            for (int i = 0; i <= depths; i++)
+            {
+                double y = 0.001 + (10 - 0.002) * i / depths;
+                double expected[] = { circ.computeArea(y), circ.computeWettedPerimiter(y), circ.computeTopWidth(y), circ.computeDpDy(y), circ.computeDtDy(y) };
+
+                xs::Properties p, t;
+                circ.computeAll(y, p);
+                table.computeAll(y, t);
+                double fused[] = { p.area, p.wettedPerimeter, p.topWidth, p.dPdy, p.dTdy };
+                double fromTable[] = { t.area, t.wettedPerimeter, t.topWidth, t.dPdy, t.dTdy };
+                for (int k = 0; k < 5; k++)
+                {
+                    double scale = max(1., abs(expected[k]));
+                    maxError = max(maxError, abs(fused[k] - expected[k]) / scale);
+                    maxTableError = max(maxTableError, abs(fromTable[k] - expected[k]) / scale);
+                }
+            }
+
+            Assert::IsTrue(maxError < 1e-10, L"computeAll differs from the functions one by one");
+            Assert::IsTrue(maxTableError < 1e-10, L"The lookup table differs from the functions one by one");
+
+            // The empty and full pipe are the same as one by one.
+            xs::Properties full;
+            circ.computeAll(10, full);
+            Assert::AreEqual(circ.computeArea(10), full.area);
+            Assert::AreEqual(circ.computeWettedPerimiter(10), full.wettedPerimeter);
+
+            double rates[3] = { 0, 0, 0 };
+            double sum = 0;
+            for (int mode = 0; mode < 3; mode++)
+            {
+                auto t0 = steady_clock::now();
+                for (int i = 0; i < depths; i++)
+                {
+                    double y = 0.001 + (10 - 0.002) * ((i * 7919) % depths) / depths;
+                    if (mode == 0)
+                    {
+                        sum += circ.computeArea(y) + circ.computeWettedPerimiter(y) + circ.computeTopWidth(y) + circ.computeDpDy(y) + circ.computeDtDy(y);
+                    }
+                    else
+                    {
+                        xs::Properties p;
+                        (mode == 1 ? circ : table).computeAll(y, p);
+                        sum += p.area + p.wettedPerimeter + p.topWidth + p.dPdy + p.dTdy;
+                    }
+                }
+                rates[mode] = duration<double, std::nano>(steady_clock::now() - t0).count() / depths;
+            }
+
+            char msg[256];
+            sprintf_s(msg, "CircularPropertiesTest: %.1f ns one by one, %.1f ns with computeAll, %.1f ns with the table (%g)",
+                rates[0], rates[1], rates[2], sum);
+            Logger::WriteMessage(msg);
+        }
+
+        /// Continuing each profile of a curve from the one before it has to
+        /// give the same curves, to the tolerance of the Newton solves, in
+        /// fewer iterations.
+		TEST_METHOD(WarmStartTest)
+		{
+            using namespace std;
+
+            xs::Reach reach = makeReach(2.66, 1530);
+
+            HpgCreator cold, warm;
+            cold.setWarmStart(false);
+            warm.setWarmStart(true);
+
+            ProfileWorkspace coldWorkspace, warmWorkspace;
+            double maxDiff = 0;
+            for (int q = 1; q <= 20; q++)
+            {
+                double yNormal, yCritical;
+                hpg::hpgvec coldCurve, warmCurve;
+                cold.computeHpgCurve(reach, q * 50.0, 1000, false, yNormal, yCritical, coldCurve, NULL, &coldWorkspace);
+                warm.computeHpgCurve(reach, q * 50.0, 1000, false, yNormal, yCritical, warmCurve, NULL, &warmWorkspace);
+
+                Assert::AreEqual(coldCurve.size(), warmCurve.size(), L"A warm start changed the number of points of a curve");
+                for (size_t i = 0; i < coldCurve.size(); i++)
+                {
+                    maxDiff = max(maxDiff, abs(coldCurve[i].y - warmCurve[i].y));
+                    maxDiff = max(maxDiff, abs(coldCurve[i].hf - warmCurve[i].hf));
+                }
+            }
+
+            Assert::IsTrue(maxDiff < 1e-4, L"A warm start changed the curves");
+
+            const ProfileStats& c = coldWorkspace.stats;
+            const ProfileStats& w = warmWorkspace.stats;
+            Assert::AreEqual(c.profiles, w.profiles);
+            Assert::IsTrue(w.iterations < c.iterations, L"A warm start didn't save any iterations");
+
+            char msg[256];
+            sprintf_s(msg, "WarmStartTest: %.2f Newton iterations per solve cold, %.2f warm; curves within %.2e ft",
+                (double)c.iterations / c.solves, (double)w.iterations / w.solves, maxDiff);
+            Logger::WriteMessage(msg);
+        }
+
+        /// A reused workspace must give the same profiles as a new one for
+        /// each profile, including after a profile with more sections.
+        /// Reports profiles per second both ways.
+		TEST_METHOD(ProfileBenchmark)
+		{
+            using namespace std;
+            using namespace std::chrono;
+
+            xs::Reach reach = makeReach(0.5, 500);
+            const int repeats = 200;
+            const int flows = 50;
+            int nC[] = { 600, 152 };
+
+            ProfileWorkspace workspace;
+            for (int n = 0; n < 2; n++)
+            {
+                double sums[2] = { 0, 0 };
+                double rates[2] = { 0, 0 };
+                for (int reuse = 0; reuse < 2; reuse++)
+                {
+                    auto t0 = steady_clock::now();
+                    for (int r = 0; r < repeats; r++)
+                    {
+                        for (int q = 1; q <= flows; q++)
+                        {
+                            double yUp, volume, hf;
+                            if (!ComputeCombinedProfile(reach, q * 20.0, 0.2 * (r % 50), nC[n], false, false, g, kn, 1.0, yUp, volume, hf, reuse ? &workspace : NULL))
+                                sums[reuse] += yUp + volume + hf;
+                        }
+                    }
+                    rates[reuse] = repeats * flows / duration<double>(steady_clock::now() - t0).count();
+                }
+
+                Assert::AreEqual(sums[0], sums[1], L"A reused workspace changed the profiles");
+
+                char msg[256];
+                sprintf_s(msg, "ProfileBenchmark: %d sections, %.0f profiles/s with a new workspace, %.0f profiles/s reusing one",
+                    nC[n], rates[0], rates[1]);
+                Logger::WriteMessage(msg);
+            }
+        }
+
+        /// The profiles of ComputeProfiles have to be the ones that
+        /// ComputeCombinedProfile and ComputeFreeProfile compute one after the
+        /// other with a warm workspace, to the bit.  Reports profiles per
+        /// second both ways.
+		TEST_METHOD(ProfileLanesTest)
+		{
+            using namespace std;
+            using namespace std::chrono;
+
+            xs::Reach reach = makeReach(0.5, 500);
+            const int repeats = 20;
+            const int flows = 50;
+            const int depths = 40;
+            const int nC = 152;
+
+            for (int freeOnly = 0; freeOnly < 2; freeOnly++)
+            {
+                double rates[2] = { 0, 0 };
+                vector<double> results[2];
+                for (int lanes = 0; lanes < 2; lanes++)
+                {
+                    ProfileWorkspace workspace;
+                    workspace.setWarmStart(true);
+                    results[lanes].clear();
+
+                    auto t0 = steady_clock::now();
+                    for (int r = 0; r < repeats; r++)
+                    {
+                        for (int q = 1; q <= flows; q++)
+                        {
+                            workspace.clearGuess();
+                            for (int d = 0; d < depths; d += PROFILE_LANES)
+                            {
+                                int n = min(PROFILE_LANES, depths - d);
+                                double yInit[PROFILE_LANES], yUp[PROFILE_LANES], volume[PROFILE_LANES], hf[PROFILE_LANES];
+                                int errors[PROFILE_LANES];
+                                for (int k = 0; k < n; k++)
+                                {
+                                    yInit[k] = 0.25 * (d + k);
+                                    yUp[k] = 0;
+                                }
+
+                                if (lanes)
+                                {
+                                    ComputeProfiles(reach, q * 20.0, n, yInit, nC, false, freeOnly != 0, g, kn, 1.0, yUp, volume, hf, errors, workspace);
+                                }
+                                else
+                                {
+                                    for (int k = 0; k < n; k++)
+                                    {
+                                        if (freeOnly)
+                                            errors[k] = ComputeFreeProfile(reach, q * 20.0, yInit[k], nC, false, false, g, kn, 1.0, yUp[k], volume[k], hf[k], &workspace);
+                                        else
+                                            errors[k] = ComputeCombinedProfile(reach, q * 20.0, yInit[k], nC, false, false, g, kn, 1.0, yUp[k], volume[k], hf[k], &workspace);
+                                    }
+                                }
+
+                                if (r == 0)
+                                {
+                                    for (int k = 0; k < n; k++)
+                                    {
+                                        results[lanes].push_back(errors[k]);
+                                        results[lanes].push_back(yUp[k]);
+                                        results[lanes].push_back(volume[k]);
+                                        results[lanes].push_back(hf[k]);
+                                    }
+                                }
+                            }
+                        }
+                    }
+                    rates[lanes] = repeats * flows * depths / duration<double>(steady_clock::now() - t0).count();
+                }
+
+                Assert::IsTrue(results[0] == results[1], L"The lanes changed the profiles");
+
+                char msg[256];
+                sprintf_s(msg, "ProfileLanesTest: %s, %.0f profiles/s one at a time, %.0f profiles/s in %d lanes",
+                    freeOnly ? "free surface" : "combined", rates[0], rates[1], PROFILE_LANES);
+                Logger::WriteMessage(msg);
+            }
+        }
+
+		TEST_METHOD(AdaptiveProfileTest)
+		{
+            using namespace std;
+
+            // The reaches of the tests above and a mile-long one, at the
+            // number of steps that AutoCreateHpg uses for them.
+            xs::Reach reaches[] = { makeReach(1, 500), makeReach(0.1, 500), makeReach(3.44, 664.318, 13.75), makeReach(26.4, 26400) };
+            const double tolerance = 0.001;
+
+            for (int r = 0; r < 4; r++)
+            {
+                xs::Reach& reach = reaches[r];
+                double diameter = reach.getMaxDepth();
+                int nC = max(1000, (int)round(reach.getLength() / 10.0));
+
+                double maxError = 0;
+                long fixedSteps = 0, adaptiveSteps = 0;
+                for (int q = 1; q <= 20; q++)
+                {
+                    for (int d = 0; d <= 15; d++)
+                    {
+                        double flow = q * 1.8 * diameter * diameter;
+                        double yInit = d * 0.1 * diameter;
+
+                        double yFixed, volumeFixed, hfFixed;
+                        int fixedError = ComputeCombinedProfile(reach, flow, yInit, nC, false, false, g, kn, 1.0, yFixed, volumeFixed, hfFixed);
+
+                        double yAdaptive, volumeAdaptive, hfAdaptive;
+                        int steps = 0;
+                        int adaptiveError = ComputeAdaptiveProfile(reach, flow, yInit, nC, false, false, g, kn, 1.0, tolerance, yAdaptive, volumeAdaptive, hfAdaptive, NULL, &steps);
+
+                        Assert::AreEqual(fixedError, adaptiveError, L"Adaptive steps changed the outcome of a profile");
+                        if (fixedError)
+                            continue;
+
+                        maxError = max(maxError, abs(yAdaptive - yFixed));
+                        fixedSteps += nC;
+                        adaptiveSteps += steps;
+                    }
+                }
+
+                Assert::IsTrue(maxError < tolerance, L"Adaptive steps moved the upstream head more than the tolerance");
+                Assert::IsTrue(adaptiveSteps * 4 < fixedSteps, L"Adaptive steps didn't save any steps");
+
+                char msg[256];
+                sprintf_s(msg, "AdaptiveProfileTest: %.0f ft reach, head within %.2e ft of %d fixed steps, %.1f times fewer steps",
+                    reach.getLength(), maxError, nC, (double)fixedSteps / adaptiveSteps);
+                Logger::WriteMessage(msg);
+            }
+        }
+
 		TEST_METHOD(FindFlowIncrementsTest)
 		{
             using namespace std;
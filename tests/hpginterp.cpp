@@ -0,0 +1,1183 @@
+// ==============================================================================
+// ICAP License
+// ==============================================================================
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2014-2016 University of Illinois at Urbana-Champaign.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Nils Oberg
+//     Blake J. Landry, PhD
+//     Arthur R. Schmidt, PhD
+//     Ven Te Chow Hydrosystems Lab
+// 
+//     University of Illinois at Urbana-Champaign
+// 
+//     https://vtchl.illinois.edu
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the Ven Te Chow Hydrosystems Lab, University of
+// 	  Illinois at Urbana-Champaign, nor the names of its contributors may be
+// 	  used to endorse or promote products derived from this Software without
+// 	  specific prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <Windows.h>
+#include <Psapi.h>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+#include "../hpg_creation/hpg_creator.hpp"
+#include "../hpg_interp/hpg.hpp"
+#include "../hpg_interp/errors.hpp"
+#include "../hpg_interp/spline-tk.h"
+#include "../xslib/circular.h"
+
+#pragma comment(lib, "psapi.lib")
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+namespace fs = boost::filesystem;
+
+// HPG used by the interpolation tests.  Created on first use.
+static const char* interpHpgPath = "..\\test\\hpg.interp.txt";
+// Steep HPG used by the regime benchmark.  Created on first use.
+static const char* steepHpgPath = "..\\test\\hpg.steep.txt";
+// Directory of HPGs (e.g. a copy of a model's DT*.txt files) used for the
+// load/query benchmark.  The benchmark is skipped if it doesn't exist.
+static const char* benchHpgDir = "..\\test\\hpgs";
+
+namespace TestGeometryRead
+{
+	TEST_CLASS(HpgInterpTest)
+	{
+	public:
+
+        void hpgInit()
+        {
+            if (!fs::exists(interpHpgPath))
+            {
+                xs::Reach reach;
+                reach.setLength(1530);
+                reach.setRoughness(0.015);
+                reach.setDsInvert(0);
+                reach.setUsInvert(2.66);
+                reach.setXs(std::shared_ptr<xs::CrossSection>(new xs::Circular(10)));
+
+                HpgCreator c;
+                std::shared_ptr<hpg::Hpg> hpgTemp = c.AutoCreateHpg(reach);
+                hpgTemp->SaveToFile(interpHpgPath);
+            }
+        }
+
+        void steepHpgInit()
+        {
+            if (!fs::exists(steepHpgPath))
+            {
+                xs::Reach reach;
+                reach.setLength(1000);
+                reach.setRoughness(0.013);
+                reach.setDsInvert(0);
+                reach.setUsInvert(20);
+                reach.setXs(std::shared_ptr<xs::CrossSection>(new xs::Circular(10)));
+
+                HpgCreator c;
+                std::shared_ptr<hpg::Hpg> hpgTemp = c.AutoCreateHpg(reach);
+                hpgTemp->SaveToFile(steepHpgPath);
+            }
+        }
+
+        /// Query a grid of flows and downstream depths that covers both flow
+        /// directions, the interpolation and the extrapolation regions.
+        std::vector<double> queryGrid(hpg::Hpg& hpg)
+        {
+            std::vector<double> results;
+            for (double q = -2000; q <= 15000; q += 37.3)
+            {
+                for (double ds = -1; ds <= 60; ds += 0.73)
+                {
+                    double us = 0, vol = 0, hf = 0;
+                    results.push_back(hpg.InterpUpstreamHead(q, ds, us) ? -1 : us);
+                    results.push_back(hpg.InterpVolume(q, ds, vol) ? -1 : vol);
+                    results.push_back(hpg.InterpHf(q, ds, hf) ? -1 : hf);
+                }
+            }
+            return results;
+        }
+
+        static size_t workingSet()
+        {
+            PROCESS_MEMORY_COUNTERS pmc;
+            if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+                return 0;
+            return pmc.WorkingSetSize;
+        }
+
+		TEST_METHOD(SaveLoadRoundTripTest)
+		{
+            using namespace std;
+
+            hpgInit();
+
+            hpg::Hpg hpg1;
+            Assert::IsTrue(hpg1.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", hpg1.getErrorMessage()).c_str());
+
+            string copyPath = string(interpHpgPath) + ".copy";
+            hpg1.setSourceHash("0123456789abcdef");
+            Assert::IsTrue(hpg1.SaveToFile(copyPath), makeInfo(L"Failed to save HPG: ", hpg1.getErrorMessage()).c_str());
+
+            hpg::Hpg hpg2;
+            Assert::IsTrue(hpg2.LoadFromFile(copyPath), makeInfo(L"Failed to reload HPG: ", hpg2.getErrorMessage()).c_str());
+            Assert::IsTrue(hpg2.getSourceHash() == "0123456789abcdef");
+
+            hpg::Hpg header;
+            Assert::IsTrue(header.LoadHeaderFromFile(copyPath), makeInfo(L"Failed to read HPG header: ", header.getErrorMessage()).c_str());
+            Assert::IsTrue(header.getSourceHash() == "0123456789abcdef");
+            Assert::AreEqual(hpg1.getDsInvert(), header.getDsInvert());
+
+            vector<double> r1 = queryGrid(hpg1);
+            vector<double> r2 = queryGrid(hpg2);
+            Assert::AreEqual((int)r1.size(), (int)r2.size());
+            for (size_t i = 0; i < r1.size(); i++)
+                Assert::AreEqual(r1[i], r2[i], 1e-6);
+
+            fs::remove(copyPath);
+        }
+
+        /// A binary HPG must load with exactly the same curves and splines as
+        /// the text HPG it was saved from.
+		TEST_METHOD(BinaryRoundTripTest)
+		{
+            using namespace std;
+
+            hpgInit();
+
+            hpg::Hpg text;
+            Assert::IsTrue(text.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", text.getErrorMessage()).c_str());
+            Assert::IsFalse(hpg::Hpg::IsBinaryFile(interpHpgPath));
+
+            string binPath = string(interpHpgPath) + ".hpgb";
+            text.setSourceHash("0123456789abcdef");
+            Assert::IsTrue(text.SaveBinary(binPath), makeInfo(L"Failed to save binary HPG: ", text.getErrorMessage()).c_str());
+            Assert::IsTrue(hpg::Hpg::IsBinaryFile(binPath));
+
+            // LoadFromFile hands binary files on to LoadBinary.
+            hpg::Hpg binary, viaText;
+            Assert::IsTrue(binary.LoadBinary(binPath), makeInfo(L"Failed to load binary HPG: ", binary.getErrorMessage()).c_str());
+            Assert::IsTrue(viaText.LoadFromFile(binPath), makeInfo(L"Failed to load binary HPG: ", viaText.getErrorMessage()).c_str());
+            Assert::AreEqual(text.getVersion(), binary.getVersion());
+            Assert::AreEqual(text.getDsInvert(), binary.getDsInvert());
+            Assert::AreEqual(text.isLengthValid(), binary.isLengthValid());
+            Assert::IsTrue(binary.getSourceHash() == text.getSourceHash());
+
+            vector<double> r1 = queryGrid(text);
+            vector<double> r2 = queryGrid(binary);
+            vector<double> r3 = queryGrid(viaText);
+            Assert::AreEqual((int)r1.size(), (int)r2.size());
+            Assert::AreEqual((int)r1.size(), (int)r3.size());
+            for (size_t i = 0; i < r1.size(); i++)
+            {
+                Assert::AreEqual(r1[i], r2[i]);
+                Assert::AreEqual(r1[i], r3[i]);
+            }
+
+            // A truncated file must be rejected rather than read past its end.
+            string truncPath = binPath + ".trunc";
+            {
+                ifstream in(binPath, ios::binary);
+                string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+                ofstream out(truncPath, ios::binary);
+                out.write(data.data(), data.size() - 16);
+            }
+            hpg::Hpg truncated;
+            Assert::IsFalse(truncated.LoadBinary(truncPath));
+            Assert::AreEqual(hpg::err::InvalidFileFormat, truncated.getErrorCode());
+
+            fs::remove(binPath);
+            fs::remove(truncPath);
+        }
+
+        /// Lazy splines must give exactly the same values as the splines set
+        /// up at load time, and only be built for the curves that are used.
+		TEST_METHOD(LazySplinesTest)
+		{
+            using namespace std;
+
+            hpgInit();
+
+            hpg::Hpg eager;
+            Assert::IsTrue(eager.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", eager.getErrorMessage()).c_str());
+            hpg::SplineStats eagerStats;
+            eager.getSplineStats(eagerStats);
+            Assert::IsTrue(eagerStats.curves > 4);
+            Assert::AreEqual(eagerStats.curves, eagerStats.builtCurves);
+
+            hpg::Hpg lazy;
+            lazy.SetLazySplines(true);
+            Assert::IsTrue(lazy.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", lazy.getErrorMessage()).c_str());
+            Assert::IsTrue(lazy.IsLazySplines());
+            hpg::SplineStats stats;
+            lazy.getSplineStats(stats);
+            Assert::AreEqual(eagerStats.curves, stats.curves);
+            Assert::AreEqual(0u, stats.builtCurves);
+            Assert::AreEqual((size_t)0, stats.memory);
+
+            // A single query only needs the two curves that bracket its flow.
+            // The depth is on the curves, below the full pipe, whose heads
+            // are computed in closed form without the splines.
+            double us1 = 0, us2 = 0;
+            Assert::AreEqual(eager.InterpUpstreamHead(1000, 8, us1), lazy.InterpUpstreamHead(1000, 8, us2));
+            Assert::AreEqual(us1, us2);
+            lazy.getSplineStats(stats);
+            Assert::AreEqual(2u, stats.builtCurves);
+
+            vector<double> r1 = queryGrid(eager);
+            vector<double> r2 = queryGrid(lazy);
+            Assert::AreEqual((int)r1.size(), (int)r2.size());
+            for (size_t i = 0; i < r1.size(); i++)
+                Assert::AreEqual(r1[i], r2[i]);
+
+            lazy.getSplineStats(stats);
+            Assert::IsTrue(stats.builtCurves <= stats.curves);
+            Assert::IsTrue(stats.memory > 0);
+
+            // Switching back builds the splines of every curve.
+            lazy.SetLazySplines(false);
+            lazy.getSplineStats(stats);
+            Assert::AreEqual(eagerStats.builtCurves, stats.builtCurves);
+            Assert::AreEqual(eagerStats.memory, stats.memory);
+        }
+
+        /// The fused query must give exactly the same values and status as
+        /// the separate upstream/volume/hf queries, for any subset of values.
+		TEST_METHOD(FusedQueryTest)
+		{
+            hpgInit();
+
+            hpg::Hpg hpg;
+            Assert::IsTrue(hpg.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", hpg.getErrorMessage()).c_str());
+
+            for (double q = -2000; q <= 15000; q += 37.3)
+            {
+                for (double ds = -1; ds <= 60; ds += 0.73)
+                {
+                    double us = 0, vol = 0, hf = 0;
+                    int usStatus = hpg.InterpUpstreamHead(q, ds, us);
+                    int volStatus = hpg.InterpVolume(q, ds, vol);
+                    int hfStatus = hpg.InterpHf(q, ds, hf);
+
+                    hpg::InterpResult all;
+                    int status = hpg.Interp(q, ds, all);
+                    Assert::AreEqual(usStatus || volStatus || hfStatus, status != 0);
+                    if (status == 0)
+                    {
+                        Assert::AreEqual(us, all.upstream);
+                        Assert::AreEqual(vol, all.volume);
+                        Assert::AreEqual(hf, all.hf);
+                    }
+
+                    hpg::InterpResult usVol;
+                    status = hpg.Interp(q, ds, usVol, hpg::InterpFlag_Upstream | hpg::InterpFlag_Volume);
+                    Assert::AreEqual(usStatus || volStatus, status != 0);
+                    if (status == 0)
+                    {
+                        Assert::AreEqual(us, usVol.upstream);
+                        Assert::AreEqual(vol, usVol.volume);
+                    }
+                }
+            }
+        }
+
+        /// The batch queries must give exactly the same values and statuses
+        /// as the single queries, in any order.  Also reports the throughput
+        /// of the two.
+		TEST_METHOD(BatchQueryTest)
+		{
+            using namespace std;
+            using namespace std::chrono;
+
+            hpgInit();
+
+            hpg::Hpg hpg;
+            Assert::IsTrue(hpg.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", hpg.getErrorMessage()).c_str());
+
+            vector<double> flows, downstreams;
+            for (double q = -2000; q <= 15000; q += 37.3)
+            {
+                for (double ds = -1; ds <= 60; ds += 0.73)
+                {
+                    flows.push_back(q);
+                    downstreams.push_back(ds);
+                }
+            }
+            for (double ds = -1; ds <= 60; ds += 0.73)
+            {
+                flows.push_back(0);
+                downstreams.push_back(ds);
+            }
+
+            // Scatter the queries so that the batch can't rely on their order.
+            srand(1);
+            for (size_t i = flows.size() - 1; i > 0; i--)
+            {
+                size_t j = rand() % (i + 1);
+                swap(flows[i], flows[j]);
+                swap(downstreams[i], downstreams[j]);
+            }
+
+            size_t n = flows.size();
+            vector<hpg::InterpResult> results(n);
+            vector<int> status(n);
+            hpg.InterpBatch(&flows[0], &downstreams[0], &results[0], &status[0], n);
+
+            vector<double> upstream(n);
+            vector<int> usStatus(n);
+            hpg.InterpUpstreamHeadBatch(&flows[0], &downstreams[0], &upstream[0], &usStatus[0], n);
+
+            for (size_t i = 0; i < n; i++)
+            {
+                double us = 0;
+                int s = hpg.InterpUpstreamHead(flows[i], downstreams[i], us);
+                Assert::AreEqual(s, usStatus[i]);
+                if (s == 0)
+                    Assert::AreEqual(us, upstream[i]);
+            }
+
+            for (size_t i = 0; i < n; i++)
+            {
+                hpg::InterpResult r;
+                int s = hpg.Interp(flows[i], downstreams[i], r);
+                Assert::AreEqual(s, status[i]);
+                if (s == 0)
+                {
+                    Assert::AreEqual(r.upstream, results[i].upstream);
+                    Assert::AreEqual(r.volume, results[i].volume);
+                    Assert::AreEqual(r.hf, results[i].hf);
+                }
+            }
+
+            // Time the same upstream head queries both ways, into the same
+            // arrays, and keep the best of a few runs of each.
+            double times[2] = { 1e30, 1e30 };
+            for (int run = 0; run < 5; run++)
+            {
+                auto t0 = steady_clock::now();
+                hpg.InterpUpstreamHeadBatch(&flows[0], &downstreams[0], &upstream[0], &usStatus[0], n);
+                auto t1 = steady_clock::now();
+                for (size_t i = 0; i < n; i++)
+                    usStatus[i] = hpg.InterpUpstreamHead(flows[i], downstreams[i], upstream[i]);
+                auto t2 = steady_clock::now();
+                times[0] = min(times[0], duration<double, nano>(t1 - t0).count() / n);
+                times[1] = min(times[1], duration<double, nano>(t2 - t1).count() / n);
+            }
+
+            char msg[256];
+            sprintf_s(msg, "BatchQueryTest: %d queries, batch %.1f ns/query, single %.1f ns/query",
+                (int)n, times[0], times[1]);
+            Logger::WriteMessage(msg);
+        }
+
+        /// Say if an analytic derivative matches a finite difference.  The
+        /// difference of two values of size 'value' a step h apart is only
+        /// good to about 1e-13 * value / h.
+        static bool matchesDifference(double analytic, double difference, double value, double h)
+        {
+            return fabs(analytic - difference) <= 1e-4 * fabs(analytic) + 1e-7 + 1e-12 * fabs(value) / h;
+        }
+
+        /// The derivatives from Interp must match finite differences of the
+        /// values.  The values are piecewise linear, so the derivative at a
+        /// kink is one-sided: it must match either the forward or the
+        /// backward difference.
+		TEST_METHOD(DerivativesTest)
+		{
+            hpgInit();
+            steepHpgInit();
+
+            const char* paths[] = { interpHpgPath, steepHpgPath };
+            for (int p = 0; p < 2; p++)
+            {
+                hpg::Hpg hpg;
+                Assert::IsTrue(hpg.LoadFromFile(paths[p]), makeInfo(L"Failed to load HPG: ", hpg.getErrorMessage()).c_str());
+
+                const double hq = 1e-3;
+                const double hd = 1e-5;
+                int checked = 0;
+                for (double q = -2000; q <= 15000; q += 37.3)
+                {
+                    for (double ds = -1; ds <= 60; ds += 0.73)
+                    {
+                        hpg::InterpResult r;
+                        hpg::InterpSlopes slopes;
+                        if (hpg.Interp(q, ds, r, slopes))
+                            continue;
+
+                        // The values with and without the derivatives are the same.
+                        hpg::InterpResult plain;
+                        Assert::AreEqual(0, hpg.Interp(q, ds, plain));
+                        Assert::AreEqual(plain.upstream, r.upstream);
+                        Assert::AreEqual(plain.volume, r.volume);
+                        Assert::AreEqual(plain.hf, r.hf);
+
+                        hpg::InterpResult qUp, qDown, dsUp, dsDown;
+                        if (hpg.Interp(q + hq, ds, qUp) || hpg.Interp(q - hq, ds, qDown) ||
+                            hpg.Interp(q, ds + hd, dsUp) || hpg.Interp(q, ds - hd, dsDown))
+                            continue;
+                        checked++;
+
+                        const double values[3] = { r.upstream, r.volume, r.hf };
+                        const double byQ[3] = { slopes.dUsdQ, slopes.dVoldQ, slopes.dHfdQ };
+                        const double byDs[3] = { slopes.dUsdDs, slopes.dVoldDs, slopes.dHfdDs };
+                        const double valuesQUp[3] = { qUp.upstream, qUp.volume, qUp.hf };
+                        const double valuesQDown[3] = { qDown.upstream, qDown.volume, qDown.hf };
+                        const double valuesDsUp[3] = { dsUp.upstream, dsUp.volume, dsUp.hf };
+                        const double valuesDsDown[3] = { dsDown.upstream, dsDown.volume, dsDown.hf };
+                        for (int k = 0; k < 3; k++)
+                        {
+                            Assert::IsTrue(
+                                matchesDifference(byQ[k], (valuesQUp[k] - values[k]) / hq, values[k], hq) ||
+                                matchesDifference(byQ[k], (values[k] - valuesQDown[k]) / hq, values[k], hq),
+                                L"Derivative by Q differs from the finite difference");
+                            Assert::IsTrue(
+                                matchesDifference(byDs[k], (valuesDsUp[k] - values[k]) / hd, values[k], hd) ||
+                                matchesDifference(byDs[k], (values[k] - valuesDsDown[k]) / hd, values[k], hd),
+                                L"Derivative by DS differs from the finite difference");
+                        }
+                    }
+                }
+                Assert::IsTrue(checked > 1000);
+            }
+        }
+
+        /// Many threads querying one HPG at once through the const query
+        /// functions must get exactly the values and statuses of a single
+        /// thread using Interp.  The shared HPG builds its splines lazily,
+        /// so the threads also race to build the same curves.
+		TEST_METHOD(ConcurrentQueryTest)
+		{
+            using namespace std;
+
+            hpgInit();
+
+            hpg::Hpg single;
+            Assert::IsTrue(single.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", single.getErrorMessage()).c_str());
+
+            vector<double> flows, downstreams;
+            for (double q = -2000; q <= 15000; q += 37.3)
+            {
+                for (double ds = -1; ds <= 60; ds += 0.73)
+                {
+                    flows.push_back(q);
+                    downstreams.push_back(ds);
+                }
+            }
+            size_t n = flows.size();
+            vector<hpg::InterpResult> expected(n);
+            vector<int> expectedStatus(n);
+            for (size_t i = 0; i < n; i++)
+                expectedStatus[i] = single.Interp(flows[i], downstreams[i], expected[i]);
+
+            hpg::Hpg shared;
+            shared.SetLazySplines(true);
+            Assert::IsTrue(shared.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", shared.getErrorMessage()).c_str());
+            const hpg::Hpg& hpg = shared;
+
+            // The test framework's asserts can't be used off the test thread,
+            // so each thread counts its mismatches.
+            const int threadCount = 8;
+            vector<int> mismatches(threadCount, 0);
+            vector<thread> threads;
+            for (int t = 0; t < threadCount; t++)
+            {
+                threads.push_back(thread([&, t]()
+                {
+                    for (int pass = 0; pass < 4; pass++)
+                    {
+                        // Each thread walks the queries in a different order.
+                        for (size_t k = 0; k < n; k++)
+                        {
+                            size_t i = (k * (2 * t + 1) + pass * 7919) % n;
+                            hpg::InterpResult r;
+                            int s = hpg.Query(flows[i], downstreams[i], r);
+                            if (s != expectedStatus[i] || (s == 0 &&
+                                (r.upstream != expected[i].upstream || r.volume != expected[i].volume || r.hf != expected[i].hf)))
+                                mismatches[t]++;
+
+                            double us = 0;
+                            s = hpg.QueryUpstreamHead(flows[i], downstreams[i], us);
+                            if (s != expectedStatus[i] || (s == 0 && us != expected[i].upstream))
+                                mismatches[t]++;
+                        }
+
+                        vector<hpg::InterpResult> results(n);
+                        vector<int> status(n);
+                        hpg.QueryBatch(&flows[0], &downstreams[0], &results[0], &status[0], n);
+                        for (size_t i = 0; i < n; i++)
+                        {
+                            if (status[i] != expectedStatus[i] || (status[i] == 0 &&
+                                (results[i].upstream != expected[i].upstream || results[i].volume != expected[i].volume || results[i].hf != expected[i].hf)))
+                                mismatches[t]++;
+                        }
+                    }
+                }));
+            }
+            for (size_t t = 0; t < threads.size(); t++)
+                threads[t].join();
+
+            for (int t = 0; t < threadCount; t++)
+                Assert::AreEqual(0, mismatches[t], L"Concurrent query differs from the single-threaded one");
+
+            // The queries don't touch the error code.
+            Assert::AreEqual(0, shared.getErrorCode());
+        }
+
+		TEST_METHOD(CompileTest)
+		{
+            using namespace std;
+
+            hpgInit();
+
+            hpg::Hpg exact, compiled;
+            Assert::IsTrue(exact.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", exact.getErrorMessage()).c_str());
+            Assert::IsTrue(compiled.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", compiled.getErrorMessage()).c_str());
+
+            const double maxHeadError = 0.01;
+            Assert::IsFalse(compiled.IsCompiled());
+            Assert::AreNotEqual(0, compiled.Compile(0.0));
+            Assert::AreEqual(0, compiled.Compile(maxHeadError));
+            Assert::IsTrue(compiled.IsCompiled());
+
+            hpg::CompileStats stats;
+            Assert::IsTrue(compiled.getCompileStats(stats));
+            Assert::IsTrue(stats.cells > stats.exactCells);
+            Assert::IsTrue(stats.maxHeadError <= maxHeadError);
+            Assert::IsTrue(stats.maxVolumeError <= 0.001);
+
+            // The table must fail the same queries as the splines, and be
+            // within the error bound for the rest.
+            double worst = 0;
+            for (double q = -2000; q <= 15000; q += 37.3)
+            {
+                for (double ds = -1; ds <= 60; ds += 0.073)
+                {
+                    hpg::InterpResult a, b;
+                    int status = exact.Interp(q, ds, a);
+                    Assert::AreEqual(status, compiled.Interp(q, ds, b));
+                    if (status == 0)
+                    {
+                        worst = max(worst, max(fabs(a.upstream - b.upstream), fabs(a.hf - b.hf)));
+                        Assert::IsTrue(worst <= maxHeadError + 1e-9);
+                    }
+                }
+            }
+
+            char msg[256];
+            sprintf_s(msg, "CompileTest: %u cells, %u left to splines, %d bytes, max head error %g (measured %g)",
+                stats.cells, stats.exactCells, (int)stats.memory, stats.maxHeadError, worst);
+            Logger::WriteMessage(msg);
+        }
+
+        /// Say if two query results are the same.  NaN matches NaN: the
+        /// first flows of the steep HPG are so small that they are all saved
+        /// as Q=0.0, so a zero flow query there divides by a zero flow step.
+        static bool sameValue(double a, double b)
+        {
+            return a == b || (a != a && b != b);
+        }
+
+        /// The batch functions of a compiled HPG must give exactly what
+        /// Interp gives, table lookups and splines alike, including the
+        /// steep and zero flow queries that the batch leaves to Interp.
+		TEST_METHOD(CompiledBatchTest)
+		{
+            using namespace std;
+
+            hpgInit();
+            steepHpgInit();
+
+            const char* paths[] = { interpHpgPath, steepHpgPath };
+            for (int k = 0; k < 2; k++)
+            {
+                hpg::Hpg exact, compiled;
+                Assert::IsTrue(exact.LoadFromFile(paths[k]), makeInfo(L"Failed to load HPG: ", exact.getErrorMessage()).c_str());
+                Assert::IsTrue(compiled.LoadFromFile(paths[k]), makeInfo(L"Failed to load HPG: ", compiled.getErrorMessage()).c_str());
+                Assert::AreEqual(0, compiled.Compile(0.01));
+
+                vector<double> flows, downstreams;
+                for (double q = -2000; q <= 15000; q += 37.3)
+                {
+                    for (double ds = -1; ds <= 60; ds += 0.173)
+                    {
+                        flows.push_back(q);
+                        downstreams.push_back(ds);
+                    }
+                }
+                for (double ds = -1; ds <= 60; ds += 0.173)
+                {
+                    flows.push_back(0);
+                    downstreams.push_back(ds);
+                }
+
+                size_t n = flows.size();
+                vector<hpg::InterpResult> results(n), queried(n);
+                vector<int> status(n), queryStatus(n), usStatus(n);
+                vector<double> upstream(n);
+                compiled.InterpBatch(&flows[0], &downstreams[0], &results[0], &status[0], n);
+                compiled.QueryBatch(&flows[0], &downstreams[0], &queried[0], &queryStatus[0], n);
+                compiled.InterpUpstreamHeadBatch(&flows[0], &downstreams[0], &upstream[0], &usStatus[0], n);
+
+                int fromTable = 0;
+                for (size_t i = 0; i < n; i++)
+                {
+                    hpg::InterpResult r, e;
+                    int s = compiled.Interp(flows[i], downstreams[i], r);
+                    Assert::AreEqual(s, status[i]);
+                    Assert::AreEqual(s, queryStatus[i]);
+                    double us = 0;
+                    int usS = compiled.InterpUpstreamHead(flows[i], downstreams[i], us);
+                    Assert::AreEqual(usS, usStatus[i]);
+                    if (usS == 0)
+                        Assert::IsTrue(sameValue(us, upstream[i]));
+                    if (s != 0)
+                        continue;
+
+                    Assert::IsTrue(sameValue(r.upstream, results[i].upstream));
+                    Assert::IsTrue(sameValue(r.volume, results[i].volume));
+                    Assert::IsTrue(sameValue(r.hf, results[i].hf));
+                    Assert::IsTrue(sameValue(r.upstream, queried[i].upstream));
+                    Assert::IsTrue(sameValue(r.volume, queried[i].volume));
+                    Assert::IsTrue(sameValue(r.hf, queried[i].hf));
+
+                    if (exact.Interp(flows[i], downstreams[i], e) == 0 && e.upstream != r.upstream)
+                        fromTable++;
+                }
+
+                // Make sure that the table was actually used.
+                Assert::IsTrue(fromTable > 0);
+            }
+        }
+
+        /// Past the end of curves that are full there, the upstream is the
+        /// downstream plus the full-pipe friction loss, interpolated by flow,
+        /// and the volume and hf don't change.  The loss must survive a save
+        /// and load, and the batch queries must agree.
+		TEST_METHOD(FullPipeTest)
+		{
+            using namespace std;
+
+            const double diameter = 10.0;
+            hpg::Hpg gen;
+            for (int i = 0; i < 6; i++)
+            {
+                double q = 100.0 + 400.0 * i;
+                double fullHf = 2e-7 * q * q;
+                double yc = 0.02 * sqrt(q) + 0.1;
+                hpg::hpgvec curve;
+                for (int j = 0; j < 20; j++)
+                {
+                    double x = yc + (diameter - yc) * j / 19;
+                    double hf = fullHf * (1 + 2.0 / (x + 1)) / (1 + 2.0 / (diameter + 1));
+                    curve.push_back(hpg::point(x, x + hf, x * 100, hf));
+                }
+                curve.push_back(hpg::point(diameter + 1, diameter + 1 + fullHf, diameter * 100, fullHf));
+                gen.AddCurve(q, curve, curve.front(), fullHf);
+            }
+
+            const char* path = "..\\test\\hpg.full.txt";
+            Assert::IsTrue(gen.SaveToFile(path), makeInfo(L"Failed to save HPG: ", gen.getErrorMessage()).c_str());
+            hpg::Hpg hpg;
+            bool loaded = hpg.LoadFromFile(path);
+            fs::remove(path);
+            Assert::IsTrue(loaded, makeInfo(L"Failed to load HPG: ", hpg.getErrorMessage()).c_str());
+
+            vector<double> flows, downstreams;
+            for (double q = 150; q <= 2000; q += 91.7)
+            {
+                double lo = 100.0 + 400.0 * floor((q - 100) / 400);
+                double hi = lo + 400.0;
+                double fullHf = 2e-7 * (lo * lo + (q - lo) / 400.0 * (hi * hi - lo * lo));
+                for (double ds = diameter + 1.5; ds < 40; ds += 3.1)
+                {
+                    hpg::InterpResult r;
+                    Assert::AreEqual(0, hpg.Interp(q, ds, r));
+                    Assert::AreEqual(ds + fullHf, r.upstream, 1e-9);
+                    Assert::AreEqual(fullHf, r.hf, 1e-9);
+                    Assert::AreEqual(diameter * 100, r.volume, 1e-9);
+                    flows.push_back(q);
+                    downstreams.push_back(ds);
+                }
+            }
+
+            vector<hpg::InterpResult> results(flows.size());
+            vector<int> status(flows.size());
+            hpg.QueryBatch(&flows[0], &downstreams[0], &results[0], &status[0], flows.size());
+            for (size_t i = 0; i < flows.size(); i++)
+            {
+                hpg::InterpResult r;
+                Assert::AreEqual(0, hpg.Interp(flows[i], downstreams[i], r));
+                Assert::AreEqual(0, status[i]);
+                Assert::AreEqual(r.upstream, results[i].upstream);
+                Assert::AreEqual(r.volume, results[i].volume);
+                Assert::AreEqual(r.hf, results[i].hf);
+            }
+        }
+
+        /// Thinning must keep what the HPG answers within the tolerances, and
+        /// report no more than that.  Curves that are straight lines, and
+        /// linear in the flow, thin down to the fewest points and curves.
+		TEST_METHOD(ThinTest)
+		{
+            using namespace std;
+
+            hpgInit();
+
+            hpg::Hpg original, thinned;
+            Assert::IsTrue(original.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", original.getErrorMessage()).c_str());
+            Assert::IsTrue(thinned.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", thinned.getErrorMessage()).c_str());
+            Assert::AreEqual(hpg::err::InvalidParam, thinned.Thin(0.0));
+
+            const double maxHeadError = 0.01;
+            hpg::ThinStats stats;
+            Assert::AreEqual(0, thinned.Thin(maxHeadError, 0.001, &stats));
+            Assert::IsTrue(stats.pointsAfter < stats.pointsBefore);
+            Assert::IsTrue(stats.curvesAfter <= stats.curvesBefore);
+            Assert::IsTrue(stats.maxHeadError <= maxHeadError);
+            Assert::IsTrue(stats.maxVolumeError <= 0.001);
+            Assert::IsTrue(stats.samples > 0);
+            Assert::IsFalse(original.getSourceHash().empty());
+            Assert::IsTrue(thinned.getSourceHash().empty(), L"A thinned HPG kept the source hash");
+
+            // queryGrid gives the upstream, volume and hf of each pair, or -1
+            // where the query fails.
+            vector<double> r1 = queryGrid(original);
+            vector<double> r2 = queryGrid(thinned);
+            Assert::AreEqual((int)r1.size(), (int)r2.size());
+            for (size_t i = 0; i < r1.size(); i++)
+            {
+                Assert::AreEqual(r1[i] == -1, r2[i] == -1);
+                if (i % 3 != 1)
+                    Assert::AreEqual(r1[i], r2[i], maxHeadError);
+            }
+
+            hpg::Hpg gen;
+            for (int i = 0; i <= 10; i++)
+            {
+                double q = 100.0 * i;
+                hpg::hpgvec curve;
+                for (int j = 0; j < 40; j++)
+                {
+                    double x = 1 + 19.0 * j / 39;
+                    curve.push_back(hpg::point(x, x + 0.001 * q * (21 - x), 100 * x, 0.001 * q * (21 - x)));
+                }
+                gen.AddCurve(q, curve, curve.front());
+            }
+            const char* path = "..\\test\\hpg.linear.txt";
+            Assert::IsTrue(gen.SaveToFile(path), makeInfo(L"Failed to save HPG: ", gen.getErrorMessage()).c_str());
+            hpg::Hpg linear;
+            bool loaded = linear.LoadFromFile(path);
+            fs::remove(path);
+            Assert::IsTrue(loaded, makeInfo(L"Failed to load HPG: ", linear.getErrorMessage()).c_str());
+
+            Assert::AreEqual(0, linear.Thin(0.001, 0.001, &stats));
+            Assert::AreEqual(11u, stats.curvesBefore);
+            Assert::AreEqual(2u, stats.curvesAfter);
+            Assert::AreEqual(440u, stats.pointsBefore);
+            Assert::AreEqual(8u, stats.pointsAfter);
+            Assert::IsTrue(stats.maxHeadError <= 0.001);
+        }
+
+        /// The natural cubic spline coefficients must pass through the
+        /// points, be continuous in the first and second derivatives at the
+        /// knots and have no curvature at the ends.
+		TEST_METHOD(NaturalCubicTest)
+		{
+            using namespace std;
+
+            unsigned int r = 12345;
+            for (int k = 0; k < 100; k++)
+            {
+                r = r * 1103515245 + 12345;
+                int n = 2 + (r >> 8) % 60;
+                vector<double> x(n), y(n), a(n), b(n), c(n);
+                double xv = 0;
+                for (int i = 0; i < n; i++)
+                {
+                    r = r * 1103515245 + 12345;
+                    xv += 0.01 + ((r >> 8) % 1000) / 300.0;
+                    x[i] = xv;
+                    y[i] = 10 * sin(xv) + ((r >> 12) % 100) / 100.0;
+                }
+                tk::natural_cubic_coeffs(&x[0], &y[0], n, &a[0], &b[0], &c[0]);
+
+                Assert::AreEqual(0.0, b[0]);
+                Assert::AreEqual(0.0, b[n - 1]);
+                for (int i = 0; i + 1 < n; i++)
+                {
+                    double h = x[i + 1] - x[i];
+                    double tol = 1e-9 * (1 + fabs(y[i + 1]) + fabs(c[i]) + fabs(b[i]));
+                    Assert::AreEqual(y[i + 1], ((a[i] * h + b[i]) * h + c[i]) * h + y[i], tol);
+                    Assert::AreEqual(b[i + 1], b[i] + 3 * a[i] * h, tol);
+                    if (i + 2 < n)
+                        Assert::AreEqual(c[i + 1], (3 * a[i] * h + 2 * b[i]) * h + c[i], tol);
+                }
+            }
+
+            // A straight line is reproduced exactly, cubic or not.
+            vector<double> x, y;
+            for (int i = 0; i < 10; i++)
+            {
+                x.push_back(i * i * 0.5);
+                y.push_back(2 * x.back() + 1);
+            }
+            tk::spline cubic, linear;
+            cubic.set_points(x, y, true);
+            linear.set_points(x, y, false);
+            for (double t = -3; t < 50; t += 0.7)
+            {
+                Assert::AreEqual(2 * t + 1, cubic(t), 1e-9);
+                Assert::AreEqual(2 * t + 1, linear(t), 1e-9);
+            }
+        }
+
+        /// Load every HPG in benchHpgDir and report the memory they take and
+        /// the query throughput.
+		TEST_METHOD(LoadAndQueryBenchmark)
+		{
+            using namespace std;
+            using namespace std::chrono;
+
+            if (!fs::exists(benchHpgDir))
+            {
+                Logger::WriteMessage("LoadAndQueryBenchmark: no HPG directory, skipping");
+                return;
+            }
+
+            size_t memBefore = workingSet();
+            auto t0 = steady_clock::now();
+
+            vector<shared_ptr<hpg::Hpg>> hpgs;
+            for (fs::directory_iterator it(benchHpgDir); it != fs::directory_iterator(); it++)
+            {
+                if (it->path().extension() != ".txt")
+                    continue;
+                shared_ptr<hpg::Hpg> hpg(new hpg::Hpg());
+                if (hpg->LoadFromFile(it->path().string()))
+                    hpgs.push_back(hpg);
+            }
+
+            auto t1 = steady_clock::now();
+            size_t memAfter = workingSet();
+
+            long long queries = 0;
+            double checksum = 0;
+            for (auto& hpg : hpgs)
+            {
+                for (double q = 0; q <= 5000; q += 97.1)
+                {
+                    for (double ds = 0; ds <= 40; ds += 0.37)
+                    {
+                        double us = 0, vol = 0;
+                        if (!hpg->InterpUpstreamHead(q, ds, us) && !hpg->InterpVolume(q, ds, vol))
+                            checksum += us + vol;
+                        queries += 2;
+                    }
+                }
+            }
+
+            auto t2 = steady_clock::now();
+
+            double loadSec = duration<double>(t1 - t0).count();
+            double querySec = duration<double>(t2 - t1).count();
+            char msg[512];
+            sprintf_s(msg, "LoadAndQueryBenchmark: %d HPGs, load %.2f s, %.1f MB (%.1f KB/HPG), %lld queries at %.3f us/query (checksum %g)",
+                (int)hpgs.size(), loadSec, (memAfter - memBefore) / 1048576.0,
+                hpgs.size() ? (memAfter - memBefore) / 1024.0 / hpgs.size() : 0.0,
+                queries, queries ? querySec * 1e6 / queries : 0.0, checksum);
+            Logger::WriteMessage(msg);
+        }
+
+        /// Build a synthetic HPG with the given number of curves of 40 points
+        /// each, save it and load it back so that the splines are set up the
+        /// same way as for a file read in by ICAP.
+        std::shared_ptr<hpg::Hpg> makeSyntheticHpg(int numCurves)
+        {
+            hpg::Hpg gen;
+            for (int i = 0; i < numCurves; i++)
+            {
+                double q = 5000.0 * i / (numCurves - 1);
+                double yc = 0.02 * sqrt(q) + 0.1;
+                hpg::hpgvec curve;
+                for (int j = 0; j < 40; j++)
+                {
+                    double x = yc + 20.0 * j / 39;
+                    curve.push_back(hpg::point(x, x + 1e-4 * q * (1 + 20.0 / (x + 1)), x * 100, 0.001 * q));
+                }
+                gen.AddCurve(q, curve, curve.front());
+            }
+
+            char path[256];
+            sprintf_s(path, "..\\test\\hpg.bench%d.txt", numCurves);
+            gen.SaveToFile(path);
+
+            std::shared_ptr<hpg::Hpg> hpg(new hpg::Hpg());
+            bool loaded = hpg->LoadFromFile(path);
+            fs::remove(path);
+            Assert::IsTrue(loaded, makeInfo(L"Failed to load synthetic HPG: ", hpg->getErrorMessage()).c_str());
+            return hpg;
+        }
+
+        /// Report the query latency against the number of curves in the HPG,
+        /// both for slowly varying queries (successive time steps of a link)
+        /// and for random ones.  The latency should stay flat as the number
+        /// of curves grows.
+		TEST_METHOD(BracketingBenchmark)
+		{
+            using namespace std;
+            using namespace std::chrono;
+
+            // The first half of the queries vary slowly, the second half are
+            // random.
+            const int numQueries = 200000;
+            vector<double> flows(2 * numQueries), downstreams(2 * numQueries);
+            unsigned int r = 12345;
+            for (int i = 0; i < numQueries; i++)
+            {
+                flows[i] = 2500 + 2400 * sin(i * 1e-3);
+                downstreams[i] = 10 + 8 * cos(i * 7e-4);
+                r = r * 1103515245 + 12345;
+                flows[numQueries + i] = (r >> 8) % 5000000 / 1000.0;
+                r = r * 1103515245 + 12345;
+                downstreams[numQueries + i] = (r >> 8) % 20000 / 1000.0;
+            }
+
+            int sizes[] = { 20, 100, 500 };
+            for (int s = 0; s < 3; s++)
+            {
+                shared_ptr<hpg::Hpg> hpg = makeSyntheticHpg(sizes[s]);
+                vector<double> results(2 * numQueries, -1);
+                vector<int> status(2 * numQueries);
+                double checksum = 0;
+
+                auto t0 = steady_clock::now();
+                for (int i = 0; i < numQueries; i++)
+                {
+                    status[i] = hpg->InterpUpstreamHead(flows[i], downstreams[i], results[i]);
+                    if (!status[i])
+                        checksum += results[i];
+                }
+
+                auto t1 = steady_clock::now();
+                for (int i = numQueries; i < 2 * numQueries; i++)
+                {
+                    status[i] = hpg->InterpUpstreamHead(flows[i], downstreams[i], results[i]);
+                    if (!status[i])
+                        checksum += results[i];
+                }
+
+                auto t2 = steady_clock::now();
+
+                // The hinted search must find the same curves as Query, which
+                // keeps no hints.
+                int mismatches = 0;
+                for (int i = 0; i < 2 * numQueries; i++)
+                {
+                    double us = -1;
+                    int st = hpg->QueryUpstreamHead(flows[i], downstreams[i], us);
+                    if (st != status[i] || (!st && us != results[i]))
+                        mismatches++;
+                }
+                Assert::AreEqual(0, mismatches, L"InterpUpstreamHead differs from QueryUpstreamHead");
+
+                char msg[256];
+                sprintf_s(msg, "BracketingBenchmark: %d curves, smooth %.1f ns/query, random %.1f ns/query (checksum %g)",
+                    sizes[s], duration<double, nano>(t1 - t0).count() / numQueries,
+                    duration<double, nano>(t2 - t1).count() / numQueries, checksum);
+                Logger::WriteMessage(msg);
+            }
+        }
+
+        /// Time InterpUpstreamHead in each region of the HPG: on mild
+        /// curves, between the first points of steep curves, on adverse
+        /// curves and past the end of the curves.
+		TEST_METHOD(RegimeBenchmark)
+		{
+            using namespace std;
+            using namespace std::chrono;
+
+            hpgInit();
+            steepHpgInit();
+
+            hpg::Hpg mild;
+            Assert::IsTrue(mild.LoadFromFile(interpHpgPath), makeInfo(L"Failed to load HPG: ", mild.getErrorMessage()).c_str());
+            hpg::Hpg steep;
+            Assert::IsTrue(steep.LoadFromFile(steepHpgPath), makeInfo(L"Failed to load HPG: ", steep.getErrorMessage()).c_str());
+
+            struct Regime
+            {
+                const char* name;
+                hpg::Hpg* hpg;
+                double minFlow, maxFlow;
+                double minDs, maxDs;
+            };
+            Regime regimes[] = {
+                { "mild", &mild, 50, 1500, 8, 14 },
+                { "steep", &steep, 10, 990, 20.5, 26 },
+                { "adverse", &mild, -300, -5, 8, 14 },
+                { "extrapolation", &mild, 50, 1500, 600, 700 },
+            };
+
+            const int numQueries = 200000;
+            for (int k = 0; k < 4; k++)
+            {
+                const Regime& g = regimes[k];
+                vector<double> flows(numQueries), downstreams(numQueries);
+                unsigned int r = 12345;
+                for (int i = 0; i < numQueries; i++)
+                {
+                    r = r * 1103515245 + 12345;
+                    flows[i] = g.minFlow + (g.maxFlow - g.minFlow) * ((r >> 8) % 100000) / 100000.0;
+                    r = r * 1103515245 + 12345;
+                    downstreams[i] = g.minDs + (g.maxDs - g.minDs) * ((r >> 8) % 100000) / 100000.0;
+                }
+
+                double checksum = 0;
+                int failures = 0;
+                auto t0 = steady_clock::now();
+                for (int i = 0; i < numQueries; i++)
+                {
+                    double us = 0;
+                    if (g.hpg->InterpUpstreamHead(flows[i], downstreams[i], us))
+                        failures++;
+                    else
+                        checksum += us;
+                }
+                auto t1 = steady_clock::now();
+                Assert::AreEqual(0, failures);
+
+                char msg[256];
+                sprintf_s(msg, "RegimeBenchmark: %s %.1f ns/query (checksum %g)",
+                    g.name, duration<double, nano>(t1 - t0).count() / numQueries, checksum);
+                Logger::WriteMessage(msg);
+            }
+        }
+
+        /// Report the cost of setting up cubic and linear splines against
+        /// the number of points.
+		TEST_METHOD(SplineSetupBenchmark)
+		{
+            using namespace std;
+            using namespace std::chrono;
+
+            int sizes[] = { 20, 100, 1000 };
+            for (int s = 0; s < 3; s++)
+            {
+                int n = sizes[s];
+                vector<double> x(n), y(n);
+                for (int i = 0; i < n; i++)
+                {
+                    x[i] = 0.1 * i + 0.01 * sin(i * 1.0);
+                    y[i] = cos(x[i]);
+                }
+
+                const int reps = 2000000 / n;
+                double checksum = 0;
+                tk::spline cubic, linear;
+                auto t0 = steady_clock::now();
+                for (int i = 0; i < reps; i++)
+                {
+                    cubic = tk::spline();
+                    cubic.set_points(x, y, true);
+                    checksum += cubic(x[n / 2] + 0.05);
+                }
+                auto t1 = steady_clock::now();
+                for (int i = 0; i < reps; i++)
+                {
+                    linear = tk::spline();
+                    linear.set_points(x, y, false);
+                    checksum += linear(x[n / 2] + 0.05);
+                }
+                auto t2 = steady_clock::now();
+
+                // Check the splines against a natural cubic worked out from
+                // its second derivatives M (M[0] = M[n-1] = 0), solving
+                //   h[i-1] M[i-1] + 2 (h[i-1] + h[i]) M[i] + h[i] M[i+1] = 6 (d[i] - d[i-1])
+                // with d the divided differences, and against straight lines.
+                vector<double> m(n, 0.0), diag(n), rhs(n);
+                for (int i = 1; i + 1 < n; i++)
+                {
+                    double h0 = x[i] - x[i - 1], h1 = x[i + 1] - x[i];
+                    diag[i] = 2 * (h0 + h1);
+                    rhs[i] = 6 * ((y[i + 1] - y[i]) / h1 - (y[i] - y[i - 1]) / h0);
+                    if (i > 1)
+                    {
+                        double f = h0 / diag[i - 1];
+                        diag[i] -= f * h0;
+                        rhs[i] -= f * rhs[i - 1];
+                    }
+                }
+                for (int i = n - 2; i >= 1; i--)
+                    m[i] = (rhs[i] - (i + 2 < n ? (x[i + 1] - x[i]) * m[i + 1] : 0.0)) / diag[i];
+
+                for (int i = 0; i + 1 < n; i++)
+                {
+                    double h = x[i + 1] - x[i];
+                    for (int k = 1; k < 4; k++)
+                    {
+                        double t = x[i] + h * k / 4;
+                        double a = (x[i + 1] - t) / h, b = (t - x[i]) / h;
+                        double ref = a * y[i] + b * y[i + 1] + ((a * a * a - a) * m[i] + (b * b * b - b) * m[i + 1]) * h * h / 6;
+                        Assert::AreEqual(ref, cubic(t), 1e-10, L"Cubic spline differs from the reference");
+                        Assert::AreEqual(a * y[i] + b * y[i + 1], linear(t), 1e-12, L"Linear spline differs from the reference");
+                    }
+                }
+
+                char msg[256];
+                sprintf_s(msg, "SplineSetupBenchmark: %d points, cubic %.1f ns/point, linear %.1f ns/point (checksum %g)",
+                    n, duration<double, nano>(t1 - t0).count() / reps / n,
+                    duration<double, nano>(t2 - t1).count() / reps / n, checksum);
+                Logger::WriteMessage(msg);
+            }
+        }
+
+        std::wstring makeInfo(wchar_t* p1, std::string p2)
+        {
+            std::wstring str = p1;
+            str = str + std::wstring(p2.begin(), p2.end());
+            return str;
+        }
+	};
+
+}
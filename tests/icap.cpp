@@ -52,11 +52,16 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/log/core.hpp>
 #include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
 #include <cmath>
 
 #include "../icap/icap.h"
+#include "../icap/hpg_batch.h"
+#include "../icap/hpg_bundle.h"
+#include "../icap/hpg_cache.h"
 #include "../util/math.h"
 
 
@@ -133,6 +138,372 @@ namespace TestGeometryRead
             }
         }
 
+        /// Identical HPGs must only be stored once in a bundle, and load
+        /// back with their own node IDs.
+		TEST_METHOD(HpgBundleTest)
+		{
+            using namespace std;
+
+            string bundlePath = "..\\test\\hpgs.bundle";
+
+            vector<string> names;
+            vector<shared_ptr<hpg::Hpg>> hpgs;
+            for (int i = 0; i < 3; i++)
+            {
+                // The first two only differ by node ID.
+                shared_ptr<hpg::Hpg> h(new hpg::Hpg());
+                for (int q = 0; q < 5; q++)
+                {
+                    hpg::hpgvec curve;
+                    for (int j = 0; j < 10; j++)
+                        curve.push_back(hpg::point(0.5 + j, 0.5 + j + (i == 2 ? 0.2 : 0.1) * q, 10.0 * j, 0.01 * q));
+                    h->AddCurve(100.0 * q, curve, curve.front());
+                }
+                h->setNodeId("N" + to_string(i));
+                names.push_back("L" + to_string(i));
+                hpgs.push_back(h);
+            }
+
+            HpgBundle bundle;
+            Assert::IsTrue(bundle.write(bundlePath, names, hpgs), makeInfo(L"Failed to write bundle: ", bundle.getErrorMessage()).c_str());
+            Assert::IsTrue(HpgBundle::isBundle(bundlePath));
+            Assert::IsTrue(bundle.open(bundlePath), makeInfo(L"Failed to open bundle: ", bundle.getErrorMessage()).c_str());
+
+            Assert::AreEqual(-1, bundle.find("L3"));
+            Assert::IsTrue(bundle.offset(bundle.find("L0")) == bundle.offset(bundle.find("L1")));
+            Assert::IsTrue(bundle.offset(bundle.find("L0")) != bundle.offset(bundle.find("L2")));
+
+            double us[3];
+            for (int i = 0; i < 3; i++)
+            {
+                hpg::Hpg h;
+                Assert::IsTrue(bundle.load(bundle.find(names[i]), h), makeInfo(L"Failed to load HPG: ", h.getErrorMessage()).c_str());
+                Assert::IsTrue(hpgs[i]->getNodeId() == h.getNodeId());
+                Assert::AreEqual(0, h.InterpUpstreamHead(250.0, 4.2, us[i]));
+            }
+            Assert::AreEqual(us[0], us[1]);
+            Assert::AreNotEqual(us[0], us[2]);
+
+            bundle.close();
+            fs::remove(bundlePath);
+        }
+
+        /// HPGs are only created again when their reach or the creator
+        /// settings change.
+		TEST_METHOD(HpgBatchTest)
+		{
+            using namespace std;
+
+            string inputFile = "..\\geometry_test.inp";
+            string dir = "..\\test\\batch_hpgs";
+            fs::remove_all(dir);
+
+            HpgBatch batch;
+            batch.creator().setNumberOfCurves(5);
+            Assert::IsTrue(batch.run(inputFile, dir), makeInfo(L"Failed to create HPGs: ", batch.getErrorMessage()).c_str());
+            HpgBatchStats first = batch.getStats();
+            Assert::IsTrue(first.created > 0);
+            Assert::AreEqual(0, first.upToDate);
+            Assert::AreEqual(first.links, first.created + first.noHpg);
+
+            Assert::IsTrue(batch.run(inputFile, dir), makeInfo(L"Failed to check HPGs: ", batch.getErrorMessage()).c_str());
+            Assert::AreEqual(0, batch.getStats().created);
+            Assert::AreEqual(first.created, batch.getStats().upToDate);
+
+            batch.creator().setNumberOfCurves(6);
+            Assert::IsTrue(batch.run(inputFile, dir), makeInfo(L"Failed to create HPGs: ", batch.getErrorMessage()).c_str());
+            Assert::AreEqual(first.created, batch.getStats().created);
+
+            fs::remove_all(dir);
+        }
+
+        /// Load the HPGs of the links with the given options and query each
+        /// one over a few flows and depths.  Returns false, with the error
+        /// message, if the HPGs don't load.
+        bool loadAndQuery(const std::string& path, geometry::LinkList* linkList, const HpgLoadOptions& options,
+            std::vector<double>& values, std::string& error)
+        {
+            IcapHpg list;
+            if (! list.loadHpgs(path, linkList, options))
+            {
+                error = list.getErrorMessage();
+                return false;
+            }
+
+            values.clear();
+            for (int i = 0; i < linkList->count(); i++)
+            {
+                std::shared_ptr<geometry::Link> link = linkList->get(i);
+                if (link->getGeometryType() != xs::xstype::circular)
+                    continue;
+                for (double q = 10; q < 1000; q += 245.5)
+                {
+                    for (double depth = 0.5; depth < 12; depth += 2.3)
+                    {
+                        hpg::InterpResult r;
+                        if (list.getValues(link->getId(), link->getDownstreamInvert() + depth, q, r))
+                        {
+                            values.push_back(r.upstream);
+                            values.push_back(r.volume);
+                            values.push_back(r.hf);
+                        }
+                        else
+                            values.push_back(-1);
+                    }
+                }
+            }
+            return true;
+        }
+
+        /// Loading the HPGs on any number of threads, from a directory,
+        /// through the disk cache or from a bundle, must give the same HPGs.
+        /// When links fail, the error must be the one of the first failed
+        /// link in the link list, whichever thread gets to it first.
+		TEST_METHOD(HpgParallelLoadTest)
+		{
+            using namespace std;
+
+            string inputFile = "..\\geometry_test.inp";
+            string dir = "..\\test\\parallel_hpgs";
+            string cacheDir = "..\\test\\parallel_cache";
+            string bundlePath = "..\\test\\parallel.bundle";
+            fs::remove_all(dir);
+            fs::remove_all(cacheDir);
+            fs::remove(bundlePath);
+
+            HpgBatch batch;
+            batch.creator().setNumberOfCurves(5);
+            Assert::IsTrue(batch.run(inputFile, dir), makeInfo(L"Failed to create HPGs: ", batch.getErrorMessage()).c_str());
+
+            geometry::Geometry geom;
+            Assert::IsTrue(geom.loadFromFile(inputFile, geometry::FileFormatSwmm5));
+            geometry::LinkList* linkList = geom.getLinkList();
+
+            HpgLoadOptions options;
+            options.threads = 1;
+            vector<double> reference;
+            string error;
+            Assert::IsTrue(loadAndQuery(dir, linkList, options, reference, error), makeInfo(L"Failed to load HPGs: ", error).c_str());
+            Assert::IsTrue(reference.size() > 0);
+
+            vector<shared_ptr<geometry::Link>> links;
+            for (int i = 0; i < linkList->count(); i++)
+                links.push_back(linkList->get(i));
+            IcapHpg list;
+            Assert::IsTrue(list.loadHpgs(dir, linkList, options), makeInfo(L"Failed to load HPGs: ", list.getErrorMessage()).c_str());
+            Assert::IsTrue(list.saveBundle(bundlePath, links), makeInfo(L"Failed to save bundle: ", list.getErrorMessage()).c_str());
+
+            // The first pass through the disk cache fills it, the second
+            // loads from it.
+            unsigned int threads[] = { 1, 2, 3, 8 };
+            for (int t = 0; t < 4; t++)
+            {
+                options.threads = threads[t];
+                vector<double> values;
+
+                options.diskCache = "";
+                Assert::IsTrue(loadAndQuery(dir, linkList, options, values, error), makeInfo(L"Failed to load HPGs: ", error).c_str());
+                Assert::IsTrue(vectorEqual(reference, values), L"HPGs differ with threads");
+
+                options.diskCache = cacheDir;
+                for (int pass = 0; pass < 2; pass++)
+                {
+                    Assert::IsTrue(loadAndQuery(dir, linkList, options, values, error), makeInfo(L"Failed to load HPGs through the disk cache: ", error).c_str());
+                    Assert::IsTrue(vectorEqual(reference, values), L"HPGs differ through the disk cache");
+                }
+                fs::remove_all(cacheDir);
+
+                options.diskCache = "";
+                Assert::IsTrue(loadAndQuery(bundlePath, linkList, options, values, error), makeInfo(L"Failed to load HPG bundle: ", error).c_str());
+                Assert::IsTrue(vectorEqual(reference, values), L"HPGs differ from a bundle");
+            }
+
+            // Take away the HPGs of the second and the last links that have
+            // one.  The error must always be the one of the second.
+            vector<const HpgBatchResult*> removed;
+            const vector<HpgBatchResult>& results = batch.getResults();
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                if (results[i].status == HpgBatch_Created)
+                    removed.push_back(&results[i]);
+            }
+            Assert::IsTrue(removed.size() >= 3);
+            removed.erase(removed.begin());
+            removed.erase(removed.begin() + 1, removed.end() - 1);
+            for (size_t i = 0; i < removed.size(); i++)
+                fs::remove(removed[i]->path);
+
+            string firstError;
+            for (int t = 0; t < 4; t++)
+            {
+                options.threads = threads[t];
+                vector<double> values;
+                Assert::IsFalse(loadAndQuery(dir, linkList, options, values, error));
+                if (t == 0)
+                    firstError = error;
+                Assert::IsTrue(error == firstError, makeInfo(L"Different error with threads: ", error).c_str());
+            }
+            Assert::IsTrue(firstError == "HPG not found.  File=" + dir + "\\" + removed[0]->link + ".txt",
+                makeInfo(L"Not the error of the first failed link: ", firstError).c_str());
+
+            fs::remove_all(dir);
+            fs::remove(bundlePath);
+        }
+
+        /// A second project must get the HPGs that the first one made from
+        /// the disk cache, unchanged, and a full cache must drop the least
+        /// recently used HPGs.
+		TEST_METHOD(HpgDiskCacheTest)
+		{
+            using namespace std;
+
+            string inputFile = "..\\geometry_test.inp";
+            string dir1 = "..\\test\\cache_hpgs1";
+            string dir2 = "..\\test\\cache_hpgs2";
+            string cacheDir = "..\\test\\hpg_cache";
+            fs::remove_all(dir1);
+            fs::remove_all(dir2);
+            fs::remove_all(cacheDir);
+
+            HpgBatchOptions options;
+            options.diskCache = cacheDir;
+
+            HpgBatch batch;
+            batch.creator().setNumberOfCurves(5);
+            Assert::IsTrue(batch.run(inputFile, dir1, options), makeInfo(L"Failed to create HPGs: ", batch.getErrorMessage()).c_str());
+            int created = batch.getStats().created;
+            Assert::IsTrue(created > 0);
+            Assert::AreEqual((unsigned long long)created, batch.getDiskCacheStats().stores);
+
+            Assert::IsTrue(batch.run(inputFile, dir2, options), makeInfo(L"Failed to copy HPGs: ", batch.getErrorMessage()).c_str());
+            Assert::AreEqual(0, batch.getStats().created);
+            Assert::AreEqual(created, batch.getStats().cached);
+
+            const vector<HpgBatchResult>& results = batch.getResults();
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                if (results[i].status != HpgBatch_Cached)
+                    continue;
+                ifstream f1((fs::path(dir1) / fs::path(results[i].path).filename()).string(), ios::binary);
+                ifstream f2(results[i].path, ios::binary);
+                string s1((istreambuf_iterator<char>(f1)), istreambuf_iterator<char>());
+                string s2((istreambuf_iterator<char>(f2)), istreambuf_iterator<char>());
+                Assert::IsTrue(s1 == s2, makeInfo(L"Cached HPG differs: ", results[i].link).c_str());
+            }
+
+            // Half of the cache is trimmed to 90% of that.
+            HpgDiskCache cache;
+            Assert::IsTrue(cache.open(cacheDir));
+            unsigned long long size = cache.getSize();
+            Assert::IsTrue(cache.open(cacheDir, size / 2));
+            Assert::IsTrue(cache.getStats().evictions > 0);
+            Assert::IsTrue(cache.getSize() <= size / 2 / 10 * 9);
+
+            hpg::Hpg h;
+            Assert::IsFalse(cache.load("0123456789abcdef", "", h));
+            Assert::IsFalse(cache.load("..\\hpg", "", h));
+            Assert::IsFalse(cache.load("0123456789abcdef", "..\\hpg", h));
+
+            // The text hash of a HPG doesn't depend on its node ID, but does
+            // on its curves, even if the source hash stays the same.
+            size_t first = 0;
+            while (results[first].status != HpgBatch_Cached)
+                first++;
+            string path = results[first].path;
+            string copy = dir2 + "\\copy.txt";
+            Assert::IsTrue(h.LoadFromFile(path), makeInfo(L"Failed to load HPG: ", h.getErrorMessage()).c_str());
+            string sourceHash = h.getSourceHash();
+            Assert::IsFalse(HpgDiskCache::textHash(path).empty());
+            h.setNodeId("copy");
+            Assert::IsTrue(h.SaveToFile(copy));
+            Assert::IsTrue(HpgDiskCache::textHash(path) == HpgDiskCache::textHash(copy));
+            Assert::AreEqual(0, h.Thin(0.01));
+            h.setSourceHash(sourceHash);
+            Assert::IsTrue(h.SaveToFile(copy));
+            Assert::IsTrue(HpgDiskCache::textHash(path) != HpgDiskCache::textHash(copy));
+            Assert::IsTrue(HpgDiskCache::textHash(dir2 + "\\missing.txt").empty());
+
+            fs::remove_all(dir1);
+            fs::remove_all(dir2);
+            fs::remove_all(cacheDir);
+        }
+
+        /// A query must be answered from the cache only in the cell of an
+        /// earlier query that computed the values asked for, and the oldest
+        /// cell must make room for new ones.
+		TEST_METHOD(HpgQueryCacheTest)
+		{
+            HpgQueryCache cache;
+            hpg::InterpResult r = { 12.5, 300.0, 0.25 };
+            hpg::InterpResult found;
+
+            // Off by default.
+            cache.insert(1, 100.1, 4.02, hpg::InterpFlag_Upstream, r);
+            Assert::IsFalse(cache.find(1, 100.1, 4.02, hpg::InterpFlag_Upstream, found));
+
+            HpgCacheOptions options;
+            options.size = 2;
+            options.flowTolerance = 0.5;
+            options.headTolerance = 0.1;
+            cache.configure(options);
+
+            cache.insert(1, 100.1, 4.02, hpg::InterpFlag_Upstream, r);
+            Assert::IsTrue(cache.find(1, 100.3, 4.05, hpg::InterpFlag_Upstream, found));
+            Assert::AreEqual(12.5, found.upstream);
+            Assert::IsFalse(cache.find(1, 100.3, 4.05, hpg::InterpFlag_Upstream | hpg::InterpFlag_Volume, found));
+            Assert::IsFalse(cache.find(1, 100.6, 4.05, hpg::InterpFlag_Upstream, found));
+            Assert::IsFalse(cache.find(2, 100.1, 4.02, hpg::InterpFlag_Upstream, found));
+
+            // Adding the volume to the cell answers both.
+            cache.insert(1, 100.2, 4.03, hpg::InterpFlag_Volume, r);
+            Assert::IsTrue(cache.find(1, 100.0, 4.04, hpg::InterpFlag_Upstream | hpg::InterpFlag_Volume, found));
+            Assert::AreEqual(300.0, found.volume);
+
+            // A third cell drops the first.
+            cache.insert(1, 200.0, 4.0, hpg::InterpFlag_All, r);
+            cache.insert(1, 300.0, 4.0, hpg::InterpFlag_All, r);
+            Assert::IsFalse(cache.find(1, 100.1, 4.02, hpg::InterpFlag_Upstream, found));
+            Assert::IsTrue(cache.find(1, 300.2, 4.0, hpg::InterpFlag_Hf, found));
+
+            HpgCacheStats stats;
+            Assert::IsTrue(cache.getStats(1, stats));
+            Assert::AreEqual(3ull, stats.hits);
+            Assert::AreEqual(3ull, stats.misses);
+            Assert::AreEqual(1ull, stats.evictions);
+            Assert::AreEqual(4ull, cache.getStats().misses);
+
+            // Without tolerances only the same query is reused.
+            options.flowTolerance = options.headTolerance = 0.0;
+            cache.configure(options);
+            Assert::IsFalse(cache.getStats(1, stats));
+            cache.insert(1, 100.1, 4.02, hpg::InterpFlag_All, r);
+            Assert::IsTrue(cache.find(1, 100.1, 4.02, hpg::InterpFlag_All, found));
+            Assert::IsFalse(cache.find(1, 100.1000001, 4.02, hpg::InterpFlag_All, found));
+        }
+
+        /// Reaches must share a signature when they only differ by the
+        /// height of their inverts.
+		TEST_METHOD(HpgSignatureTest)
+		{
+            // 32.91 - 2.81 isn't exactly 30.1.
+            HpgSignature s1(10.0, 0.013, 1000.0, 30.1);
+            HpgSignature s2(10.0, 0.013, 1000.0, 32.91 - 2.81);
+            Assert::IsTrue(s1 == s2);
+            Assert::IsFalse(s1 < s2 || s2 < s1);
+
+            HpgSignature s3(10.0, 0.015, 1000.0, 30.1);
+            Assert::IsFalse(s1 == s3);
+            Assert::IsTrue(s1 < s3 || s3 < s1);
+            Assert::IsFalse(s1 == HpgSignature(10.0, 0.013, 1000.0, -30.1));
+            Assert::IsFalse(s1 == HpgSignature(8.0, 0.013, 1000.0, 30.1));
+
+            HpgShareStats stats;
+            Assert::AreEqual(0.0, stats.ratio());
+            stats.links = 12;
+            stats.instances = 4;
+            Assert::AreEqual(3.0, stats.ratio());
+        }
+
         template<class T>
         bool vectorEqual(const std::vector<T>& v1, const std::vector<T>& v2) const
         {
@@ -57,9 +57,8 @@ namespace xs
     {
     private:
         double diameter;
-        double lastDepth;
-        double theta;
-        double getTheta(double depth);
+        bool lookupTable;
+        double getTheta(double depth) const;
         void init();
 
     public:
@@ -68,6 +67,10 @@ namespace xs
         Circular(const Circular* rhs);
 
         void setDiameter(double diameter) { this->diameter = diameter; }
+        /// Makes computeAll take the angle of the water surface from a
+        /// table of y/D instead of asin (see circular.cpp); off by default.
+        void setLookupTable(bool use) { this->lookupTable = use; }
+        bool getLookupTable() const { return this->lookupTable; }
         virtual double getMaxDepth() { return this->diameter; }
 
         virtual bool setParameters(std::vector<std::string>::const_iterator firstPart, std::vector<std::string>::const_iterator end);
@@ -78,6 +81,8 @@ namespace xs
         virtual double computeDpDy(double depth);
         virtual double computeDaDy(double depth);
         virtual double computeDtDy(double depth);
+        virtual void computeAll(double depth, Properties& props);
+        virtual void computeAll(int count, const double* depths, Properties* props);
 
         virtual std::shared_ptr<CrossSection> clone();
     };
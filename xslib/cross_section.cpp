@@ -57,6 +57,21 @@
 
 namespace xs
 {
+    void CrossSection::computeAll(double depth, Properties& props)
+    {
+        props.area = computeArea(depth);
+        props.wettedPerimeter = computeWettedPerimiter(depth);
+        props.topWidth = computeTopWidth(depth);
+        props.dPdy = computeDpDy(depth);
+        props.dTdy = computeDtDy(depth);
+    }
+
+    void CrossSection::computeAll(int count, const double* depths, Properties* props)
+    {
+        for (int i = 0; i < count; i++)
+            computeAll(depths[i], props[i]);
+    }
+
     CrossSection* Factory::create(const CrossSection* xs)
     {
         if (xs->getType() == xstype::circular)
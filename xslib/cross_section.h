@@ -60,6 +60,17 @@
 
 namespace xs
 {
+    /// The properties of a cross section at one depth (see
+    /// CrossSection::computeAll).
+    struct Properties
+    {
+        double area;
+        double wettedPerimeter;
+        double topWidth;
+        double dPdy;
+        double dTdy;
+    };
+
     class CrossSection : public Parseable
     {
     protected:
@@ -78,6 +89,17 @@ namespace xs
         virtual double computeDaDy(double depth) = 0;
         virtual double computeDtDy(double depth) = 0;
 
+        /// Computes all of the properties above at once (dA/dy is the top
+        /// width), for the solvers that need several of them at each depth.
+        /// This calls the functions one by one; cross sections override it
+        /// when the properties share work.  It must be safe to call from
+        /// several threads at once.
+        virtual void computeAll(double depth, Properties& props);
+        /// computeAll at each of count depths, for solvers that work on
+        /// several depths at once.  Cross sections override it when the
+        /// depths can be computed together in one loop.
+        virtual void computeAll(int count, const double* depths, Properties* props);
+
         virtual std::shared_ptr<CrossSection> clone() = 0;
     };
 